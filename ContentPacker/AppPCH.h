@@ -0,0 +1,8 @@
+//-------------------------------------------------------------------------------
+//
+// Gumshoe Framework v1.00
+//   - Based on MJP's DX11 Sample Framework (http://mynameismjp.wordpress.com/)
+//
+//  All code licensed under the MIT license
+//
+//-------------------------------------------------------------------------------
@@ -0,0 +1,102 @@
+//-------------------------------------------------------------------------------
+//
+// ContentPacker
+//   - Using GumshoeFramework (v1.00)
+//
+//  Packs a content directory into a single archive that the framework mounts at
+//  startup (see ContentArchive.h), so that loading doesn't pay for opening every
+//  texture and mesh separately.
+//
+//  Usage: ContentPacker <contentDir> <archive> [-compress ext,ext,...]
+//
+//  e.g.   ContentPacker ..\Content ..\Content\Content.pak -compress obj,sdkmesh,meshdata
+//
+//  All code licensed under the MIT license
+//
+//-------------------------------------------------------------------------------
+
+#include <PCH.h>
+
+#include <ContentArchive.h>
+#include <ThreadPool.h>
+
+using namespace GumshoeFramework10;
+
+static void ParseExtensions(const wchar* arg, std::vector<std::wstring>& extensions)
+{
+    std::wstring extension;
+    for(const wchar* c = arg; ; ++c)
+    {
+        if(*c == L',' || *c == 0)
+        {
+            if(extension.length() > 0 && extension[0] == L'.')
+                extension.erase(0, 1);
+            if(extension.length() > 0)
+                extensions.push_back(extension);
+            extension.clear();
+
+            if(*c == 0)
+                break;
+        }
+        else
+            extension += *c;
+    }
+}
+
+int wmain(int argc, wchar** argv)
+{
+    const wchar* contentDir = nullptr;
+    const wchar* archivePath = nullptr;
+    std::vector<std::wstring> compressedExtensions;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        const wchar* arg = argv[i];
+        if(wcscmp(arg, L"-compress") == 0 && i + 1 < argc)
+            ParseExtensions(argv[++i], compressedExtensions);
+        else if(contentDir == nullptr)
+            contentDir = arg;
+        else if(archivePath == nullptr)
+            archivePath = arg;
+        else
+        {
+            fwprintf(stderr, L"Unknown argument: %ls\n", arg);
+            return 1;
+        }
+    }
+
+    if(contentDir == nullptr || archivePath == nullptr)
+    {
+        fwprintf(stderr, L"Usage: ContentPacker <contentDir> <archive> [-compress ext,ext,...]\n");
+        return 1;
+    }
+
+    if(DirectoryExists(contentDir) == false)
+    {
+        fwprintf(stderr, L"Content directory %ls doesn't exist\n", contentDir);
+        return 1;
+    }
+
+    // Compressed entries are deflated in parallel blocks
+    ThreadPool::GlobalPool.Initialize();
+
+    int result = 0;
+    try
+    {
+        const ContentArchiveStats stats = BuildContentArchive(contentDir, archivePath, compressedExtensions);
+
+        wprintf(L"Packed %llu files (%llu compressed) into %ls\n", stats.NumFiles, stats.NumCompressed, archivePath);
+        wprintf(L"  Content size: %llu bytes\n", stats.Size);
+        wprintf(L"  Stored size:  %llu bytes\n", stats.StoredSize);
+        wprintf(L"  Archive size: %llu bytes\n", stats.ArchiveSize);
+    }
+    catch(Exception& e)
+    {
+        fwprintf(stderr, L"Failed to build the archive: %ls\n", e.GetMessage().c_str());
+        result = 1;
+    }
+
+    ThreadPool::GlobalPool.Shutdown();
+
+    return result;
+}
@@ -14,8 +14,10 @@
 #include "Graphics\\Profiler.h"
 #include "GF_Math.h"
 #include "FileIO.h"
+#include "ContentArchive.h"
 #include "Settings.h"
 #include "TwHelper.h"
+#include "ThreadPool.h"
 
 // AppSettings framework
 namespace AppSettings
@@ -74,6 +76,15 @@ int32 App::Run()
 
         Profiler::GlobalProfiler.Initialize(deviceManager.Device(), deviceManager.ImmediateContext());
 
+        ThreadPool::GlobalPool.Initialize();
+
+        // A few threads are enough to keep the disk busy with asynchronous requests
+        File::IOPool.Initialize(4);
+
+        // Serve the content out of the packed archive if one has been built
+        if(FileExistsOnDisk(L"..\\Content\\Content.pak"))
+            MountContentArchive(L"..\\Content\\Content.pak", L"..\\Content\\");
+
         window.RegisterMessageCallback(WM_SIZE, OnWindowResized, this);
 
         // Initialize AntTweakBar
@@ -139,6 +150,11 @@ int32 App::Run()
 
     ShutdownShaders();
 
+    UnmountContentArchives();
+
+    File::IOPool.Shutdown();
+    ThreadPool::GlobalPool.Shutdown();
+
     TwCall(TwTerminate());
 
     if(createConsole)
@@ -0,0 +1,370 @@
+//-------------------------------------------------------------------------------
+// Gumshoe Framework v1.00
+//   - Based on MJP's DX11 Sample Framework (http://mynameismjp.wordpress.com/)
+//
+//  All code licensed under the MIT license
+//
+//-------------------------------------------------------------------------------
+
+#include "PCH.h"
+
+#include "ContentArchive.h"
+#include "Serialization.h"
+
+namespace GumshoeFramework10
+{
+
+// Deflate can't shrink data by more than this, so a compressed entry that claims to inflate
+// to more is corrupt, and shouldn't get to allocate that much
+static const uint64 MaxDeflateRatio = 1032;
+
+static Hash HashContentPath(const std::wstring& path)
+{
+    return GenerateHash(path.c_str(), int(path.length() * sizeof(wchar)));
+}
+
+static bool HashLess(const Hash& a, const Hash& b)
+{
+    return a.A < b.A || (a.A == b.A && a.B < b.B);
+}
+
+static void LowerCaseContentPath(std::wstring& path)
+{
+    for(uint64 i = 0; i < path.length(); ++i)
+    {
+        if(path[i] == L'/')
+            path[i] = L'\\';
+    }
+
+    if(path.length() > 0)
+        CharLowerBuff(&path[0], DWORD(path.length()));
+}
+
+std::wstring NormalizeContentPath(const wchar* filePath)
+{
+    Assert_(filePath != nullptr);
+
+    wchar fullPath[MAX_PATH];
+    const DWORD length = GetFullPathName(filePath, MAX_PATH, fullPath, NULL);
+    std::wstring path = (length > 0 && length < MAX_PATH) ? std::wstring(fullPath, length) : std::wstring(filePath);
+    LowerCaseContentPath(path);
+    return path;
+}
+
+// == ContentArchive ==============================================================================
+
+ContentArchive::ContentArchive(const wchar* archivePath) : entries(nullptr), numEntries(0),
+                                                           paths(nullptr), pathsLength(0)
+{
+    // Entries are read in whatever order the app asks for them
+    file = std::make_shared<MappedFile>(archivePath, FileAccessPattern::Random);
+
+    const uint64 fileSize = file->Size();
+    if(fileSize < sizeof(ContentArchiveFooter))
+        throw Exception(std::wstring(L"Content archive ") + archivePath + L" is too small to be valid");
+
+    ContentArchiveFooter footer;
+    memcpy(&footer, file->Data() + fileSize - sizeof(ContentArchiveFooter), sizeof(ContentArchiveFooter));
+    if(footer.Magic != ContentArchiveMagic)
+        throw Exception(std::wstring(L"File ") + archivePath + L" is not a content archive");
+    if(footer.Version != ContentArchiveVersion)
+        throw Exception(std::wstring(L"Content archive ") + archivePath + L" was built with an unsupported version");
+
+    const uint64 dataEnd = fileSize - sizeof(ContentArchiveFooter);
+    const uint64 indexSize = footer.NumEntries * sizeof(ContentArchiveEntry);
+    if(footer.NumEntries > dataEnd / sizeof(ContentArchiveEntry) || footer.IndexOffset > dataEnd - indexSize
+       || footer.PathsOffset > dataEnd || footer.PathsSize > dataEnd - footer.PathsOffset
+       || footer.IndexOffset % sizeof(uint64) != 0 || footer.PathsOffset % sizeof(wchar) != 0)
+        throw Exception(std::wstring(L"Content archive ") + archivePath + L" has a corrupt index");
+
+    entries = reinterpret_cast<const ContentArchiveEntry*>(file->Data() + footer.IndexOffset);
+    numEntries = footer.NumEntries;
+    paths = reinterpret_cast<const wchar*>(file->Data() + footer.PathsOffset);
+    pathsLength = footer.PathsSize / sizeof(wchar);
+
+    for(uint64 i = 0; i < numEntries; ++i)
+    {
+        const ContentArchiveEntry& entry = entries[i];
+        const bool compressed = (entry.Flags & ContentArchiveEntryFlag_Compressed) != 0;
+        if(entry.Offset > dataEnd || entry.StoredSize > dataEnd - entry.Offset
+           || entry.PathOffset > pathsLength || entry.PathLength > pathsLength - entry.PathOffset
+           || (compressed == false && entry.Size != entry.StoredSize)
+           || (compressed && entry.Size / MaxDeflateRatio > entry.StoredSize))
+            throw Exception(std::wstring(L"Content archive ") + archivePath + L" has a corrupt index");
+    }
+}
+
+const ContentArchiveEntry* ContentArchive::FindEntry(const std::wstring& relativePath) const
+{
+    const Hash hash = HashContentPath(relativePath);
+
+    uint64 first = 0;
+    uint64 last = numEntries;
+    while(first < last)
+    {
+        const uint64 middle = first + (last - first) / 2;
+        if(HashLess(entries[middle].PathHash, hash))
+            first = middle + 1;
+        else
+            last = middle;
+    }
+
+    if(first == numEntries || entries[first].PathHash != hash)
+        return nullptr;
+
+    // Make sure it's not a collision with some other file
+    const ContentArchiveEntry& entry = entries[first];
+    if(entry.PathLength != relativePath.length()
+       || memcmp(paths + entry.PathOffset, relativePath.c_str(), entry.PathLength * sizeof(wchar)) != 0)
+        return nullptr;
+
+    return &entry;
+}
+
+void ContentArchive::ReadEntry(const ContentArchiveEntry& entry, ArchivedFile& archivedFile) const
+{
+    const uint8* storedData = file->Data() + entry.Offset;
+
+    if((entry.Flags & ContentArchiveEntryFlag_Compressed) == 0)
+    {
+        archivedFile.Data = storedData;
+        archivedFile.Size = entry.Size;
+        archivedFile.Owner = file;
+        return;
+    }
+
+    std::shared_ptr<std::vector<uint8>> contents = std::make_shared<std::vector<uint8>>(size_t(entry.Size));
+    MemoryReadSerializer storedSerializer(storedData, entry.StoredSize);
+    CompressedReadSerializer<MemoryReadSerializer> serializer(storedSerializer);
+    serializer.SerializeData(entry.Size, contents->data());
+
+    archivedFile.Data = contents->data();
+    archivedFile.Size = entry.Size;
+    archivedFile.Owner = contents;
+}
+
+std::wstring ContentArchive::EntryPath(const ContentArchiveEntry& entry) const
+{
+    return std::wstring(paths + entry.PathOffset, entry.PathLength);
+}
+
+// == Mounting ====================================================================================
+
+struct MountedArchive
+{
+    std::wstring Directory;
+    std::shared_ptr<ContentArchive> Archive;
+};
+
+static std::vector<MountedArchive> MountedArchives;
+
+void MountContentArchive(const wchar* archivePath, const wchar* mountDirectory)
+{
+    MountedArchive mount;
+    mount.Directory = NormalizeContentPath(mountDirectory);
+    if(mount.Directory.length() > 0 && mount.Directory.back() != L'\\')
+        mount.Directory += L'\\';
+    mount.Archive = std::make_shared<ContentArchive>(archivePath);
+
+    MountedArchives.push_back(mount);
+}
+
+void UnmountContentArchives()
+{
+    MountedArchives.clear();
+}
+
+// Returns the archive and entry for a file path, or null if no mounted archive has it
+static const ContentArchiveEntry* FindMountedEntry(const wchar* filePath, const ContentArchive** archive)
+{
+    if(MountedArchives.size() == 0 || filePath == nullptr)
+        return nullptr;
+
+    const std::wstring path = NormalizeContentPath(filePath);
+    for(uint64 i = 0; i < MountedArchives.size(); ++i)
+    {
+        const MountedArchive& mount = MountedArchives[i];
+        if(path.compare(0, mount.Directory.length(), mount.Directory) != 0)
+            continue;
+
+        const ContentArchiveEntry* entry = mount.Archive->FindEntry(path.substr(mount.Directory.length()));
+        if(entry != nullptr)
+        {
+            *archive = mount.Archive.get();
+            return entry;
+        }
+    }
+
+    return nullptr;
+}
+
+bool ArchivedFileExists(const wchar* filePath)
+{
+    const ContentArchive* archive = nullptr;
+    return FindMountedEntry(filePath, &archive) != nullptr;
+}
+
+bool FindArchivedFile(const wchar* filePath, ArchivedFile& archivedFile)
+{
+    const ContentArchive* archive = nullptr;
+    const ContentArchiveEntry* entry = FindMountedEntry(filePath, &archive);
+    if(entry == nullptr)
+        return false;
+
+    archive->ReadEntry(*entry, archivedFile);
+    return true;
+}
+
+// == Building ====================================================================================
+
+// Appends the paths of all files under directory, relative to the root
+static void FindContentFiles(const std::wstring& root, const std::wstring& subDirectory,
+                             std::vector<std::wstring>& relativePaths)
+{
+    WIN32_FIND_DATA findData;
+    HANDLE findHandle = FindFirstFile((root + subDirectory + L"*").c_str(), &findData);
+    if(findHandle == INVALID_HANDLE_VALUE)
+        return;
+
+    do
+    {
+        const std::wstring name = findData.cFileName;
+        if(name == L"." || name == L"..")
+            continue;
+
+        if(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            FindContentFiles(root, subDirectory + name + L"\\", relativePaths);
+        else
+            relativePaths.push_back(subDirectory + name);
+    }
+    while(FindNextFile(findHandle, &findData));
+
+    FindClose(findHandle);
+}
+
+static void WritePadding(FileWriteSerializer& serializer, uint64& offset, uint64 alignment)
+{
+    static const uint8 Zeros[ContentArchiveAlignment] = { };
+
+    const uint64 padding = (alignment - offset % alignment) % alignment;
+    serializer.SerializeData(padding, Zeros);
+    offset += padding;
+}
+
+ContentArchiveStats BuildContentArchive(const wchar* contentDirectory, const wchar* archivePath,
+                                        const std::vector<std::wstring>& compressedExtensions)
+{
+    std::wstring root = NormalizeContentPath(contentDirectory);
+    if(root.length() > 0 && root.back() != L'\\')
+        root += L'\\';
+
+    std::vector<std::wstring> relativePaths;
+    FindContentFiles(root, L"", relativePaths);
+
+    std::vector<std::wstring> extensions = compressedExtensions;
+    for(uint64 i = 0; i < extensions.size(); ++i)
+        LowerCaseContentPath(extensions[i]);
+
+    const std::wstring normalizedArchivePath = NormalizeContentPath(archivePath);
+
+    ContentArchiveStats stats = { };
+    std::vector<ContentArchiveEntry> entries;
+    std::wstring pathTable;
+
+    FileWriteSerializer serializer(archivePath);
+    uint64 offset = 0;
+
+    std::vector<uint8> contents;
+    std::vector<uint8> compressed;
+    for(uint64 i = 0; i < relativePaths.size(); ++i)
+    {
+        const std::wstring fullPath = root + relativePaths[i];
+
+        // Don't pack an older copy of the archive into the new one
+        std::wstring relativePath = relativePaths[i];
+        LowerCaseContentPath(relativePath);
+        if(root + relativePath == normalizedArchivePath)
+            continue;
+
+        File file(fullPath.c_str(), FileOpenMode::Read);
+        contents.resize(size_t(file.Size()));
+        if(contents.size() > 0)
+            file.Read(contents.size(), contents.data());
+        file.Close();
+
+        ContentArchiveEntry entry = { };
+        entry.PathHash = HashContentPath(relativePath);
+        entry.PathOffset = pathTable.length();
+        entry.PathLength = uint32(relativePath.length());
+        entry.Size = contents.size();
+        entry.StoredSize = contents.size();
+        pathTable += relativePath;
+
+        const std::wstring extension = GetFileExtension(relativePath.c_str());
+        const uint8* storedData = contents.data();
+        if(contents.size() > 0 && std::find(extensions.begin(), extensions.end(), extension) != extensions.end())
+        {
+            compressed.clear();
+            MemoryWriteSerializer compressedSerializer(compressed);
+            CompressedWriteSerializer<MemoryWriteSerializer> compressor(compressedSerializer);
+            compressor.SerializeData(contents.size(), contents.data());
+            compressor.Finish();
+
+            if(compressed.size() < contents.size())
+            {
+                entry.Flags |= ContentArchiveEntryFlag_Compressed;
+                entry.StoredSize = compressed.size();
+                storedData = compressed.data();
+                ++stats.NumCompressed;
+            }
+        }
+
+        WritePadding(serializer, offset, ContentArchiveAlignment);
+        entry.Offset = offset;
+        serializer.SerializeData(entry.StoredSize, storedData);
+        offset += entry.StoredSize;
+
+        entries.push_back(entry);
+        stats.Size += entry.Size;
+        stats.StoredSize += entry.StoredSize;
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const ContentArchiveEntry& a, const ContentArchiveEntry& b)
+    {
+        return HashLess(a.PathHash, b.PathHash);
+    });
+
+    for(uint64 i = 1; i < entries.size(); ++i)
+    {
+        if(entries[i - 1].PathHash == entries[i].PathHash)
+            throw Exception(L"Two content paths hash to the same value: " +
+                            pathTable.substr(size_t(entries[i].PathOffset), entries[i].PathLength));
+    }
+
+    ContentArchiveFooter footer = { };
+    footer.Magic = ContentArchiveMagic;
+    footer.Version = ContentArchiveVersion;
+    footer.NumEntries = entries.size();
+
+    WritePadding(serializer, offset, sizeof(uint64));
+    footer.IndexOffset = offset;
+    if(entries.size() > 0)
+        serializer.SerializeData(entries.size() * sizeof(ContentArchiveEntry), entries.data());
+    offset += entries.size() * sizeof(ContentArchiveEntry);
+
+    footer.PathsOffset = offset;
+    footer.PathsSize = pathTable.length() * sizeof(wchar);
+    if(pathTable.length() > 0)
+        serializer.SerializeData(footer.PathsSize, pathTable.c_str());
+    offset += footer.PathsSize;
+
+    serializer.SerializeItem(footer);
+    offset += sizeof(ContentArchiveFooter);
+    serializer.Flush();
+
+    stats.NumFiles = entries.size();
+    stats.ArchiveSize = offset;
+    return stats;
+}
+
+}
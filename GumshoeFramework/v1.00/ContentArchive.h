@@ -0,0 +1,117 @@
+//-------------------------------------------------------------------------------
+// Gumshoe Framework v1.00
+//   - Based on MJP's DX11 Sample Framework (http://mynameismjp.wordpress.com/)
+//
+//  All code licensed under the MIT license
+//
+//-------------------------------------------------------------------------------
+
+#pragma once
+
+#include "PCH.h"
+
+#include "FileIO.h"
+#include "MurmurHash.h"
+
+namespace GumshoeFramework10
+{
+
+// A content archive is a directory of files packed into one file, so that loading a scene
+// opens and maps a single file instead of hundreds of small ones. The layout is:
+//
+//   [file data, each entry starting on a ContentArchiveAlignment boundary]
+//   [index: ContentArchiveEntry x NumEntries, sorted by path hash]
+//   [path table: the wchar paths of all entries, not null-terminated]
+//   [ContentArchiveFooter]
+//
+// Paths are stored relative to the packed directory, lower case and with '\\' separators.
+
+static const uint32 ContentArchiveMagic = 0x4B504647;    // "GFPK"
+static const uint32 ContentArchiveVersion = 1;
+static const uint64 ContentArchiveAlignment = 4096;
+
+enum ContentArchiveEntryFlags
+{
+    ContentArchiveEntryFlag_Compressed = 1,
+};
+
+struct ContentArchiveEntry
+{
+    Hash PathHash;
+    uint64 Offset;
+    uint64 StoredSize;
+    uint64 Size;
+    uint64 PathOffset;      // In characters, from the start of the path table
+    uint32 PathLength;
+    uint32 Flags;
+};
+
+struct ContentArchiveFooter
+{
+    uint64 IndexOffset;
+    uint64 NumEntries;
+    uint64 PathsOffset;
+    uint64 PathsSize;       // In bytes
+    uint32 Version;
+    uint32 Magic;
+};
+
+// A mapped archive. Lookups are a binary search over the index, so nothing is read until an
+// entry is actually opened.
+class ContentArchive
+{
+
+private:
+
+    std::shared_ptr<MappedFile> file;
+    const ContentArchiveEntry* entries;
+    uint64 numEntries;
+    const wchar* paths;
+    uint64 pathsLength;
+
+public:
+
+    explicit ContentArchive(const wchar* archivePath);
+
+    // Takes a path relative to the packed directory, in the form produced by NormalizeContentPath()
+    const ContentArchiveEntry* FindEntry(const std::wstring& relativePath) const;
+
+    // Uncompressed entries point straight into the mapping. Compressed ones are inflated into
+    // a new buffer every time they're read.
+    void ReadEntry(const ContentArchiveEntry& entry, ArchivedFile& archivedFile) const;
+
+    uint64 NumEntries() const { return numEntries; }
+    const ContentArchiveEntry& Entry(uint64 idx) const { Assert_(idx < numEntries); return entries[idx]; }
+    std::wstring EntryPath(const ContentArchiveEntry& entry) const;
+};
+
+// Full path, lower case, with '\\' separators
+std::wstring NormalizeContentPath(const wchar* filePath);
+
+// Makes the files packed into an archive visible to File, MappedFile and FileExists() as if
+// they were still in mountDirectory. Archived files take precedence over loose files with
+// the same path. Mount before any loading threads are started.
+void MountContentArchive(const wchar* archivePath, const wchar* mountDirectory);
+void UnmountContentArchives();
+
+// Checks the index of the mounted archives, without reading any file data
+bool ArchivedFileExists(const wchar* filePath);
+bool FindArchivedFile(const wchar* filePath, ArchivedFile& archivedFile);
+
+struct ContentArchiveStats
+{
+    uint64 NumFiles;
+    uint64 NumCompressed;
+    uint64 Size;
+    uint64 StoredSize;
+    uint64 ArchiveSize;
+};
+
+// Packs every file under contentDirectory into a new archive. Files whose extension is in
+// compressedExtensions (without the dot, e.g. L"obj") are deflated, and kept that way if
+// it made them smaller. The files are read through File, so this shouldn't be run while
+// an archive is mounted over contentDirectory.
+ContentArchiveStats BuildContentArchive(const wchar* contentDirectory, const wchar* archivePath,
+                                        const std::vector<std::wstring>& compressedExtensions);
+
+}
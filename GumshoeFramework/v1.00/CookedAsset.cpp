@@ -0,0 +1,222 @@
+//-------------------------------------------------------------------------------
+// Gumshoe Framework v1.00
+//   - Based on MJP's DX11 Sample Framework (http://mynameismjp.wordpress.com/)
+//
+//  All code licensed under the MIT license
+//
+//-------------------------------------------------------------------------------
+
+#include "PCH.h"
+
+#include "CookedAsset.h"
+
+namespace GumshoeFramework10
+{
+
+static Hash ChecksumHeader(CookedAssetHeader header, const CookedAssetSection* sections)
+{
+    header.HeaderChecksum = Hash();
+    Hash checksum = GenerateHash(&header, int(sizeof(CookedAssetHeader)));
+    if(header.NumSections > 0)
+        checksum = GenerateHash(sections, int(header.NumSections * sizeof(CookedAssetSection)), uint32(checksum.A));
+    return checksum;
+}
+
+const wchar* CookedAssetStatusString(CookedAssetStatus status)
+{
+    switch(status)
+    {
+    case CookedAssetStatus::Valid: return L"valid";
+    case CookedAssetStatus::Missing: return L"file not found";
+    case CookedAssetStatus::NotAnAsset: return L"not a cooked asset";
+    case CookedAssetStatus::WrongFormatVersion: return L"written with a different container version";
+    case CookedAssetStatus::WrongAssetType: return L"wrong asset type";
+    case CookedAssetStatus::WrongAssetVersion: return L"written with a different asset version";
+    case CookedAssetStatus::SourceChanged: return L"source content has changed";
+    case CookedAssetStatus::Truncated: return L"file is truncated";
+    case CookedAssetStatus::Corrupted: return L"file is corrupted";
+    default: return L"unknown";
+    }
+}
+
+Hash ChecksumData(const void* data, uint64 size)
+{
+    static const uint64 ChunkSize = 1024 * 1024 * 1024;
+
+    const uint8* bytes = reinterpret_cast<const uint8*>(data);
+    Hash checksum = GenerateHash(bytes, int(std::min(size, ChunkSize)));
+    for(uint64 offset = ChunkSize; offset < size; offset += ChunkSize)
+    {
+        const Hash chunk = GenerateHash(bytes + offset, int(std::min(size - offset, ChunkSize)), uint32(checksum.A));
+        checksum = Hash(checksum.A ^ chunk.A, chunk.B);
+    }
+
+    return checksum;
+}
+
+// == CookedAssetWriter ===========================================================================
+
+CookedAssetWriter::CookedAssetWriter(uint32 assetType_, uint32 assetVersion_, const Hash& sourceHash_)
+    : assetType(assetType_), assetVersion(assetVersion_), sourceHash(sourceHash_)
+{
+}
+
+std::vector<uint8>& CookedAssetWriter::AddSection(uint32 type)
+{
+    sectionTypes.push_back(type);
+    sectionData.push_back(std::vector<uint8>());
+    return sectionData.back();
+}
+
+void CookedAssetWriter::Write(const wchar* filePath) const
+{
+    const uint32 numSections = uint32(sectionData.size());
+
+    std::vector<CookedAssetSection> sections(numSections);
+    uint64 offset = sizeof(CookedAssetHeader) + numSections * sizeof(CookedAssetSection);
+    for(uint32 i = 0; i < numSections; ++i)
+    {
+        offset = (offset + CookedAssetSectionAlignment - 1) & ~(CookedAssetSectionAlignment - 1);
+
+        CookedAssetSection& section = sections[i];
+        section.Type = sectionTypes[i];
+        section.Padding = 0;
+        section.Offset = offset;
+        section.Size = sectionData[i].size();
+        section.Checksum = ChecksumData(sectionData[i].data(), section.Size);
+        offset += section.Size;
+    }
+
+    CookedAssetHeader header = { };
+    header.Magic = CookedAssetMagic;
+    header.FormatVersion = CookedAssetFormatVersion;
+    header.AssetType = assetType;
+    header.AssetVersion = assetVersion;
+    header.SourceHash = sourceHash;
+    header.FileSize = offset;
+    header.NumSections = numSections;
+    header.HeaderChecksum = ChecksumHeader(header, sections.data());
+
+    const std::wstring tempPath = std::wstring(filePath) + L".tmp";
+    {
+        FileWriteSerializer serializer(tempPath.c_str());
+        serializer.SerializeItem(header);
+        if(numSections > 0)
+            serializer.SerializeData(numSections * sizeof(CookedAssetSection), sections.data());
+
+        uint64 pos = sizeof(CookedAssetHeader) + numSections * sizeof(CookedAssetSection);
+        for(uint32 i = 0; i < numSections; ++i)
+        {
+            static const uint8 Zeros[CookedAssetSectionAlignment] = { };
+            serializer.SerializeData(sections[i].Offset - pos, Zeros);
+            if(sections[i].Size > 0)
+                serializer.SerializeData(sections[i].Size, sectionData[i].data());
+            pos = sections[i].Offset + sections[i].Size;
+        }
+
+        serializer.Flush();
+    }
+
+    if(MoveFileEx(tempPath.c_str(), filePath, MOVEFILE_REPLACE_EXISTING) == FALSE)
+        throw Exception(std::wstring(L"Failed to write cooked asset ") + filePath + L":\n" + GetWin32ErrorString(GetLastError()));
+}
+
+// == CookedAssetReader ===========================================================================
+
+CookedAssetReader::CookedAssetReader() : sections(nullptr)
+{
+    header = CookedAssetHeader();
+}
+
+CookedAssetStatus CookedAssetReader::Open(const wchar* filePath, uint32 assetType, uint32 assetVersion,
+                                          const Hash* sourceHash)
+{
+    Close();
+
+    if(FileExists(filePath) == false)
+        return CookedAssetStatus::Missing;
+
+    std::shared_ptr<MappedFile> mapping = std::make_shared<MappedFile>(filePath, FileAccessPattern::Random);
+    const uint64 fileSize = mapping->Size();
+    if(fileSize < sizeof(CookedAssetHeader))
+        return fileSize < sizeof(uint32) ? CookedAssetStatus::NotAnAsset : CookedAssetStatus::Truncated;
+
+    CookedAssetHeader fileHeader;
+    memcpy(&fileHeader, mapping->Data(), sizeof(CookedAssetHeader));
+    if(fileHeader.Magic != CookedAssetMagic)
+        return CookedAssetStatus::NotAnAsset;
+    if(fileHeader.FormatVersion != CookedAssetFormatVersion)
+        return CookedAssetStatus::WrongFormatVersion;
+    if(fileHeader.AssetType != assetType)
+        return CookedAssetStatus::WrongAssetType;
+    if(fileHeader.AssetVersion != assetVersion)
+        return CookedAssetStatus::WrongAssetVersion;
+    if(sourceHash != nullptr && fileHeader.SourceHash != *sourceHash)
+        return CookedAssetStatus::SourceChanged;
+    if(fileHeader.FileSize != fileSize)
+        return fileHeader.FileSize > fileSize ? CookedAssetStatus::Truncated : CookedAssetStatus::Corrupted;
+
+    const uint64 tableSize = uint64(fileHeader.NumSections) * sizeof(CookedAssetSection);
+    if(tableSize > fileSize - sizeof(CookedAssetHeader))
+        return CookedAssetStatus::Corrupted;
+
+    const CookedAssetSection* fileSections = reinterpret_cast<const CookedAssetSection*>(mapping->Data() + sizeof(CookedAssetHeader));
+    if(ChecksumHeader(fileHeader, fileSections) != fileHeader.HeaderChecksum)
+        return CookedAssetStatus::Corrupted;
+
+    for(uint32 i = 0; i < fileHeader.NumSections; ++i)
+    {
+        const CookedAssetSection& section = fileSections[i];
+        if(section.Offset > fileSize || section.Size > fileSize - section.Offset)
+            return CookedAssetStatus::Corrupted;
+    }
+
+    file = mapping;
+    header = fileHeader;
+    sections = fileSections;
+
+    return CookedAssetStatus::Valid;
+}
+
+void CookedAssetReader::Close()
+{
+    file = nullptr;
+    header = CookedAssetHeader();
+    sections = nullptr;
+}
+
+const CookedAssetSection* CookedAssetReader::FindSection(uint32 type) const
+{
+    for(uint32 i = 0; i < header.NumSections; ++i)
+    {
+        if(sections[i].Type == type)
+            return &sections[i];
+    }
+
+    return nullptr;
+}
+
+MappedReadSerializer CookedAssetReader::ReadSection(uint32 type) const
+{
+    Assert_(IsOpen());
+
+    const CookedAssetSection* section = FindSection(type);
+    if(section == nullptr)
+        throw Exception(L"Cooked asset is missing a section");
+
+    // The section is about to be read in its entirety anyway
+    file->Prefetch(section->Offset, section->Size);
+    if(ChecksumData(file->Data() + section->Offset, section->Size) != section->Checksum)
+        throw Exception(L"Cooked asset section failed its checksum");
+
+    return MappedReadSerializer(file, section->Offset, section->Size);
+}
+
+CookedAssetStatus ValidateCookedAsset(const wchar* filePath, uint32 assetType, uint32 assetVersion,
+                                      const Hash* sourceHash)
+{
+    CookedAssetReader reader;
+    return reader.Open(filePath, assetType, assetVersion, sourceHash);
+}
+
+}
@@ -0,0 +1,143 @@
+//-------------------------------------------------------------------------------
+// Gumshoe Framework v1.00
+//   - Based on MJP's DX11 Sample Framework (http://mynameismjp.wordpress.com/)
+//
+//  All code licensed under the MIT license
+//
+//-------------------------------------------------------------------------------
+
+#pragma once
+
+#include "PCH.h"
+
+#include "FileIO.h"
+#include "MurmurHash.h"
+#include "Serialization.h"
+
+namespace GumshoeFramework10
+{
+
+// Cooked assets are stored in a container that can be checked without reading the payload:
+//
+//   [CookedAssetHeader]
+//   [CookedAssetSection x NumSections]
+//   [section data, each section starting on a CookedAssetSectionAlignment boundary]
+//
+// The header records what the asset is and which version of its serialization code wrote
+// it, along with a hash of the source content it was cooked from. Every section carries a
+// checksum of its data, and the header carries one of itself and the section table, so a
+// stale, truncated or corrupted file is caught before any of it is deserialized.
+
+static const uint32 CookedAssetMagic = 0x41434647;          // "GFCA"
+static const uint32 CookedAssetFormatVersion = 1;
+static const uint64 CookedAssetSectionAlignment = 16;
+
+struct CookedAssetHeader
+{
+    uint32 Magic;
+    uint32 FormatVersion;           // Version of the container layout
+    uint32 AssetType;               // FourCC of the payload
+    uint32 AssetVersion;            // Version of the payload's serialization
+    Hash SourceHash;                // Hash of whatever the asset was cooked from
+    uint64 FileSize;
+    uint32 NumSections;
+    uint32 Padding;
+    Hash HeaderChecksum;            // Covers this header (with this field zeroed) and the section table
+};
+
+struct CookedAssetSection
+{
+    uint32 Type;                    // FourCC
+    uint32 Padding;
+    uint64 Offset;
+    uint64 Size;
+    Hash Checksum;
+};
+
+// Why a cooked asset was rejected
+enum class CookedAssetStatus
+{
+    Valid = 0,
+    Missing,
+    NotAnAsset,
+    WrongFormatVersion,
+    WrongAssetType,
+    WrongAssetVersion,
+    SourceChanged,
+    Truncated,
+    Corrupted,
+};
+
+const wchar* CookedAssetStatusString(CookedAssetStatus status);
+
+// MurmurHash of a buffer of any size, in 1GB chunks
+Hash ChecksumData(const void* data, uint64 size);
+
+// Collects the sections of an asset in memory, then writes the whole file. The file is
+// written under a temporary name and renamed into place, so a crash while cooking never
+// leaves a truncated asset behind.
+class CookedAssetWriter
+{
+
+private:
+
+    uint32 assetType;
+    uint32 assetVersion;
+    Hash sourceHash;
+    std::vector<uint32> sectionTypes;
+    std::vector<std::vector<uint8>> sectionData;
+
+public:
+
+    CookedAssetWriter(uint32 assetType, uint32 assetVersion, const Hash& sourceHash);
+
+    // Returns the buffer for a new section, to be filled with a MemoryWriteSerializer
+    std::vector<uint8>& AddSection(uint32 type);
+
+    template<typename T> void AddSection(uint32 type, T& item)
+    {
+        MemoryWriteSerializer serializer(AddSection(type));
+        SerializeItem(serializer, item);
+    }
+
+    void Write(const wchar* filePath) const;
+};
+
+// Maps a cooked asset and validates it. Open() only reads the header and the section
+// table, the section checksums are checked when a section is read.
+class CookedAssetReader
+{
+
+private:
+
+    std::shared_ptr<MappedFile> file;
+    CookedAssetHeader header;
+    const CookedAssetSection* sections;
+
+public:
+
+    CookedAssetReader();
+
+    // Pass a null source hash to accept whatever the asset was cooked from. Returns the
+    // reason the asset can't be used, and leaves the reader closed in that case.
+    CookedAssetStatus Open(const wchar* filePath, uint32 assetType, uint32 assetVersion,
+                           const Hash* sourceHash = nullptr);
+    void Close();
+
+    bool IsOpen() const { return file != nullptr; }
+    const CookedAssetHeader& Header() const { return header; }
+
+    uint32 NumSections() const { return header.NumSections; }
+    const CookedAssetSection& Section(uint32 idx) const { Assert_(idx < header.NumSections); return sections[idx]; }
+    const CookedAssetSection* FindSection(uint32 type) const;
+
+    // Checks the section's data against its checksum, and returns a serializer that reads it
+    // straight out of the mapping. Throws if the section is missing or corrupted.
+    MappedReadSerializer ReadSection(uint32 type) const;
+};
+
+// Cheap check that a cooked asset exists and matches the expected type, version and source
+CookedAssetStatus ValidateCookedAsset(const wchar* filePath, uint32 assetType, uint32 assetVersion,
+                                      const Hash* sourceHash = nullptr);
+
+}
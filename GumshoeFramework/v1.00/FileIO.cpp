@@ -9,12 +9,22 @@
 #include "PCH.h"
 
 #include "FileIO.h"
+#include "ContentArchive.h"
 
 namespace GumshoeFramework10
 {
 
-// Returns true if a file exits
+// Returns true if a file exits, either on disk or in a mounted content archive
 bool FileExists(const wchar* filePath)
+{
+    if(filePath == NULL)
+        return false;
+
+    return FileExistsOnDisk(filePath) || ArchivedFileExists(filePath);
+}
+
+// Returns true if a file exists on disk, ignoring mounted content archives
+bool FileExistsOnDisk(const wchar* filePath)
 {
     if(filePath == NULL)
         return false;
@@ -134,12 +144,75 @@ void WriteStringAsFile(const wchar* filePath, const std::string& data)
 
 // == File ========================================================================================
 
-File::File() : fileHandle(INVALID_HANDLE_VALUE), openMode(FileOpenMode::Read)
+ThreadPool File::IOPool;
+
+// Reads or writes at an absolute offset given through an OVERLAPPED. On a synchronous handle
+// this still moves the file pointer to the end of the transfer, so it can't be mixed with
+// Read()/Write() calls in flight at the same time. Returns the number of bytes transferred.
+static uint64 TransferAt(HANDLE fileHandle, uint64 offset, uint64 size, void* data, bool write)
+{
+    uint8* bytes = reinterpret_cast<uint8*>(data);
+    uint64 numTransferred = 0;
+    while(numTransferred < size)
+    {
+        const uint64 position = offset + numTransferred;
+        const DWORD chunkSize = DWORD(std::min<uint64>(size - numTransferred, 0x80000000ULL));
+
+        OVERLAPPED overlapped = { };
+        overlapped.Offset = DWORD(position & 0xFFFFFFFF);
+        overlapped.OffsetHigh = DWORD(position >> 32);
+
+        DWORD chunkTransferred = 0;
+        BOOL succeeded = write ? WriteFile(fileHandle, bytes + numTransferred, chunkSize, &chunkTransferred, &overlapped)
+                               : ReadFile(fileHandle, bytes + numTransferred, chunkSize, &chunkTransferred, &overlapped);
+        if(succeeded == FALSE)
+        {
+            const DWORD error = GetLastError();
+            if(write == false && error == ERROR_HANDLE_EOF)
+                break;
+
+            throw Exception(std::wstring(L"Asynchronous file I/O failed:\n") + GetWin32ErrorString(error));
+        }
+
+        numTransferred += chunkTransferred;
+        if(chunkTransferred < chunkSize)
+            break;
+    }
+
+    return numTransferred;
+}
+
+// Runs a transfer on the I/O pool and reports the result through a future
+static std::future<uint64> QueueTransfer(const std::function<uint64()>& transfer, const FileIOCallback& callback)
+{
+    std::shared_ptr<std::promise<uint64>> promise(new std::promise<uint64>());
+    std::future<uint64> future = promise->get_future();
+
+    File::IOPool.Enqueue([=]()
+    {
+        try
+        {
+            const uint64 numBytes = transfer();
+            if(callback)
+                callback(numBytes);
+            promise->set_value(numBytes);
+        }
+        catch(...)
+        {
+            promise->set_exception(std::current_exception());
+        }
+    });
+
+    return future;
+}
+
+File::File() : fileHandle(INVALID_HANDLE_VALUE), openMode(FileOpenMode::Read), archived(false), archivePos(0)
 {
 }
 
 File::File(const wchar* filePath, FileOpenMode openMode) : fileHandle(INVALID_HANDLE_VALUE),
-                                                           openMode(FileOpenMode::Read)
+                                                           openMode(FileOpenMode::Read),
+                                                           archived(false), archivePos(0)
 {
     Open(filePath, openMode);
 }
@@ -152,11 +225,19 @@ File::~File()
 
 void File::Open(const wchar* filePath, FileOpenMode openMode_)
 {
-    Assert_(fileHandle == INVALID_HANDLE_VALUE);
+    Assert_(fileHandle == INVALID_HANDLE_VALUE && archived == false);
     openMode = openMode_;
 
     if(openMode == FileOpenMode::Read)
     {
+        // Files in a mounted archive are read straight out of its mapping
+        if(FindArchivedFile(filePath, archivedFile))
+        {
+            archived = true;
+            archivePos = 0;
+            return;
+        }
+
         Assert_(FileExists(filePath));
 
         // Open the file
@@ -171,7 +252,7 @@ void File::Open(const wchar* filePath, FileOpenMode openMode_)
     else
     {
         // If the exists, delete it
-        if(FileExists(filePath))
+        if(FileExistsOnDisk(filePath))
             Win32Call(DeleteFile(filePath));
 
         // Create the file
@@ -187,6 +268,13 @@ void File::Open(const wchar* filePath, FileOpenMode openMode_)
 
 void File::Close()
 {
+    if(archived)
+    {
+        archivedFile = ArchivedFile();
+        archived = false;
+        archivePos = 0;
+    }
+
     if(fileHandle == INVALID_HANDLE_VALUE)
         return;
 
@@ -198,9 +286,20 @@ void File::Close()
 
 void File::Read(uint64 size, void* data) const
 {
-    Assert_(fileHandle != INVALID_HANDLE_VALUE);
     Assert_(openMode == FileOpenMode::Read);
 
+    if(archived)
+    {
+        if(size > archivedFile.Size - archivePos)
+            throw Exception(L"Attempted to read past the end of an archived file");
+
+        memcpy(data, archivedFile.Data + archivePos, size_t(size));
+        archivePos += size;
+        return;
+    }
+
+    Assert_(fileHandle != INVALID_HANDLE_VALUE);
+
     DWORD bytesRead = 0;
     Win32Call(ReadFile(fileHandle, data, static_cast<DWORD>(size), &bytesRead, NULL));
 }
@@ -214,8 +313,46 @@ void File::Write(uint64 size, const void* data) const
     Win32Call(WriteFile(fileHandle, data, static_cast<DWORD>(size), &bytesWritten, NULL));
 }
 
+std::future<uint64> File::ReadAsync(uint64 offset, uint64 size, void* data, const FileIOCallback& callback) const
+{
+    Assert_(openMode == FileOpenMode::Read);
+
+    if(archived)
+    {
+        // Copying out of the mapping may still fault in pages, so it goes on the pool too.
+        // The task holds its own reference to the archive in case the file is closed first.
+        const ArchivedFile source = archivedFile;
+        return QueueTransfer([=]() -> uint64
+        {
+            if(offset >= source.Size)
+                return uint64(0);
+
+            const uint64 numBytes = std::min(size, source.Size - offset);
+            memcpy(data, source.Data + offset, size_t(numBytes));
+            return numBytes;
+        }, callback);
+    }
+
+    Assert_(fileHandle != INVALID_HANDLE_VALUE);
+
+    const HANDLE handle = fileHandle;
+    return QueueTransfer([=]() { return TransferAt(handle, offset, size, data, false); }, callback);
+}
+
+std::future<uint64> File::WriteAsync(uint64 offset, uint64 size, const void* data, const FileIOCallback& callback) const
+{
+    Assert_(fileHandle != INVALID_HANDLE_VALUE);
+    Assert_(openMode == FileOpenMode::Write);
+
+    const HANDLE handle = fileHandle;
+    return QueueTransfer([=]() { return TransferAt(handle, offset, size, const_cast<void*>(data), true); }, callback);
+}
+
 uint64 File::Size() const
 {
+    if(archived)
+        return archivedFile.Size;
+
     Assert_(fileHandle != INVALID_HANDLE_VALUE);
 
     LARGE_INTEGER fileSize;
@@ -224,4 +361,130 @@ uint64 File::Size() const
     return fileSize.QuadPart;
 }
 
+// == MappedFile ==================================================================================
+
+// PrefetchVirtualMemory only exists on Windows 8 and up, so it's looked up at runtime
+struct PrefetchRangeEntry
+{
+    void* VirtualAddress;
+    SIZE_T NumberOfBytes;
+};
+
+typedef BOOL (WINAPI* PrefetchVirtualMemoryFunc)(HANDLE process, ULONG_PTR numEntries,
+                                                 PrefetchRangeEntry* entries, ULONG flags);
+
+static PrefetchVirtualMemoryFunc LookupPrefetchVirtualMemory()
+{
+    HMODULE kernel32 = GetModuleHandle(L"kernel32.dll");
+    if(kernel32 == NULL)
+        return nullptr;
+    return reinterpret_cast<PrefetchVirtualMemoryFunc>(GetProcAddress(kernel32, "PrefetchVirtualMemory"));
+}
+
+static const PrefetchVirtualMemoryFunc PrefetchVirtualMemoryPtr = LookupPrefetchVirtualMemory();
+
+MappedFile::MappedFile() : fileHandle(INVALID_HANDLE_VALUE), mappingHandle(NULL), data(nullptr), size(0)
+{
+}
+
+MappedFile::MappedFile(const wchar* filePath, FileAccessPattern accessPattern, bool diskOnly)
+    : fileHandle(INVALID_HANDLE_VALUE), mappingHandle(NULL), data(nullptr), size(0)
+{
+    Open(filePath, accessPattern, diskOnly);
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+    Assert_(fileHandle == INVALID_HANDLE_VALUE);
+}
+
+void MappedFile::Open(const wchar* filePath, FileAccessPattern accessPattern, bool diskOnly)
+{
+    Assert_(fileHandle == INVALID_HANDLE_VALUE && data == nullptr);
+
+    // Archived files are already in memory, so the view just points at them
+    ArchivedFile archivedFile;
+    if(diskOnly == false && FindArchivedFile(filePath, archivedFile))
+    {
+        data = archivedFile.Data;
+        size = archivedFile.Size;
+        archiveOwner = archivedFile.Owner;
+        return;
+    }
+
+    // The cache manager uses these to pick how far ahead to read, and how quickly pages that
+    // have been read can be dropped
+    DWORD flags = FILE_ATTRIBUTE_NORMAL;
+    if(accessPattern == FileAccessPattern::Sequential)
+        flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+    else if(accessPattern == FileAccessPattern::Random)
+        flags |= FILE_FLAG_RANDOM_ACCESS;
+
+    fileHandle = CreateFile(filePath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, flags, NULL);
+    if(fileHandle == INVALID_HANDLE_VALUE)
+    {
+        std::wstring errMsg = std::wstring(L"Failed to open file ") + filePath + L":\n" + GetWin32ErrorString(GetLastError());
+        Assert_(false);
+        throw Exception(errMsg);
+    }
+
+    LARGE_INTEGER fileSize;
+    Win32Call(GetFileSizeEx(fileHandle, &fileSize));
+    size = fileSize.QuadPart;
+
+    // Empty files can't be mapped, so just leave the data pointer null for those
+    if(size == 0)
+        return;
+
+    mappingHandle = CreateFileMapping(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(mappingHandle != NULL)
+        data = reinterpret_cast<const uint8*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+
+    if(data == nullptr)
+    {
+        std::wstring errMsg = std::wstring(L"Failed to map file ") + filePath + L":\n" + GetWin32ErrorString(GetLastError());
+        Close();
+        Assert_(false);
+        throw Exception(errMsg);
+    }
+}
+
+void MappedFile::Prefetch(uint64 offset, uint64 numBytes) const
+{
+    if(PrefetchVirtualMemoryPtr == nullptr || data == nullptr || offset >= size)
+        return;
+
+    PrefetchRangeEntry range;
+    range.VirtualAddress = const_cast<uint8*>(data + offset);
+    range.NumberOfBytes = SIZE_T(std::min(numBytes, size - offset));
+    PrefetchVirtualMemoryPtr(GetCurrentProcess(), 1, &range, 0);
+}
+
+void MappedFile::Close()
+{
+    if(archiveOwner)
+    {
+        archiveOwner.reset();
+        data = nullptr;
+        size = 0;
+    }
+
+    if(fileHandle == INVALID_HANDLE_VALUE)
+        return;
+
+    if(data != nullptr)
+        Win32Call(UnmapViewOfFile(data));
+
+    if(mappingHandle != NULL)
+        Win32Call(CloseHandle(mappingHandle));
+
+    Win32Call(CloseHandle(fileHandle));
+
+    fileHandle = INVALID_HANDLE_VALUE;
+    mappingHandle = NULL;
+    data = nullptr;
+    size = 0;
+}
+
 }
\ No newline at end of file
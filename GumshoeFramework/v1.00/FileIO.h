@@ -12,12 +12,16 @@
 
 #include "Exceptions.h"
 #include "Utility.h"
+#include "ThreadPool.h"
+
+#include <future>
 
 namespace GumshoeFramework10
 {
 
 // Utility functions
 bool FileExists(const wchar* filePath);
+bool FileExistsOnDisk(const wchar* filePath);
 bool DirectoryExists(const wchar* dirPath);
 std::wstring GetDirectoryFromFilePath(const wchar* filePath);
 std::wstring GetFileName(const wchar* filePath);
@@ -35,6 +39,19 @@ enum class FileOpenMode
     Write = 1,
 };
 
+// Called on an I/O thread once an asynchronous request has completed, with the number of
+// bytes that were transferred
+typedef std::function<void(uint64 numBytes)> FileIOCallback;
+
+// Contents of a file served from a mounted content archive (see ContentArchive.h). Owner
+// keeps the memory that Data points into alive.
+struct ArchivedFile
+{
+    const uint8* Data = nullptr;
+    uint64 Size = 0;
+    std::shared_ptr<const void> Owner;
+};
+
 class File
 {
 
@@ -43,6 +60,11 @@ private:
     HANDLE fileHandle;
     FileOpenMode openMode;
 
+    // Set when a file opened for reading was found in a mounted archive
+    bool archived;
+    ArchivedFile archivedFile;
+    mutable uint64 archivePos;
+
 public:
 
     // Lifetime
@@ -61,8 +83,71 @@ public:
     template<typename T> void Read(T& data) const;
     template<typename T> void Write(const T& data) const;
 
+    // Asynchronous I/O at an explicit offset, serviced by IOPool. The future holds the number
+    // of bytes transferred, which is less than size for a read that runs into the end of the
+    // file, or the exception if the request failed. The file and the buffer have to stay alive
+    // until the request completes, and Read()/Write() shouldn't be mixed with requests that are
+    // still in flight since they share the file pointer.
+    std::future<uint64> ReadAsync(uint64 offset, uint64 size, void* data,
+                                  const FileIOCallback& callback = FileIOCallback()) const;
+    std::future<uint64> WriteAsync(uint64 offset, uint64 size, const void* data,
+                                   const FileIOCallback& callback = FileIOCallback()) const;
+
     // Accessors
     uint64 Size() const;
+
+    // Threads that service asynchronous requests. They're kept apart from ThreadPool::GlobalPool
+    // so that requests waiting on the disk don't hold up CPU work. Until the pool is initialized,
+    // requests run on the calling thread.
+    static ThreadPool IOPool;
+};
+
+// How a mapped file is going to be read, so that the OS can adjust its read-ahead
+enum class FileAccessPattern
+{
+    Normal = 0,
+    Sequential = 1,
+    Random = 2,
+};
+
+// Maps a whole file read-only into the address space, so that it can be read through a
+// pointer instead of being copied into a buffer first. Pages are loaded on first access
+// and are shared with any other process that maps the same file.
+class MappedFile
+{
+
+private:
+
+    HANDLE fileHandle;
+    HANDLE mappingHandle;
+    const uint8* data;
+    uint64 size;
+
+    // Keeps the archive alive when the file was found in a mounted archive instead of on disk
+    std::shared_ptr<const void> archiveOwner;
+
+public:
+
+    // Lifetime
+    MappedFile();
+    explicit MappedFile(const wchar* filePath, FileAccessPattern accessPattern = FileAccessPattern::Normal,
+                        bool diskOnly = false);
+    ~MappedFile();
+
+    // Explicit Open and close. With diskOnly set the file on disk is mapped even if a mounted
+    // archive has a copy, for matching what an external library like Assimp will read.
+    void Open(const wchar* filePath, FileAccessPattern accessPattern = FileAccessPattern::Normal,
+              bool diskOnly = false);
+    void Close();
+
+    // Asks the OS to start reading in the pages that cover [offset, offset + numBytes) without
+    // waiting for them. Only a hint, which is ignored on versions of Windows before 8.
+    void Prefetch(uint64 offset, uint64 numBytes) const;
+    void PrefetchAll() const { Prefetch(0, size); }
+
+    // Accessors
+    const uint8* Data() const { return data; }
+    uint64 Size() const { return size; }
 };
 
 // == File ========================================================================================
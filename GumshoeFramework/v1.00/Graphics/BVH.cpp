@@ -0,0 +1,730 @@
+//-------------------------------------------------------------------------------
+//
+// Gumshoe Framework v1.00
+//   - Based on MJP's DX11 Sample Framework (http://mynameismjp.wordpress.com/)
+//
+//  All code licensed under the MIT license
+//
+//-------------------------------------------------------------------------------
+
+#include "PCH.h"
+
+#include "BVH.h"
+
+#include "..\\ThreadPool.h"
+#include "..\\Exceptions.h"
+#include "..\\CookedAsset.h"
+#include "Model.h"
+
+using std::vector;
+
+namespace GumshoeFramework10
+{
+
+// Ranges at most this big are binned on one thread
+static const uint32 BinBlockSize = 16 * 1024;
+
+// Past this depth the SAH is ignored and ranges are split at the median, so that a bad
+// distribution of triangles can't make the tree deep enough to overflow the traversal stack
+static const uint32 MaxSAHDepth = 48;
+static const uint32 TraversalStackSize = 256;
+
+struct BVHBounds
+{
+    Float3 Min = Float3(FLT_MAX);
+    Float3 Max = Float3(-FLT_MAX);
+
+    void Grow(const Float3& p)
+    {
+        Min = Float3(std::min(Min.x, p.x), std::min(Min.y, p.y), std::min(Min.z, p.z));
+        Max = Float3(std::max(Max.x, p.x), std::max(Max.y, p.y), std::max(Max.z, p.z));
+    }
+
+    void Grow(const BVHBounds& other)
+    {
+        Min = Float3(std::min(Min.x, other.Min.x), std::min(Min.y, other.Min.y), std::min(Min.z, other.Min.z));
+        Max = Float3(std::max(Max.x, other.Max.x), std::max(Max.y, other.Max.y), std::max(Max.z, other.Max.z));
+    }
+
+    float Area() const
+    {
+        if(Min.x > Max.x)
+            return 0.0f;
+
+        const Float3 size = Max - Min;
+        return size.x * size.y + size.y * size.z + size.z * size.x;
+    }
+};
+
+static float Component(const Float3& v, uint32 axis)
+{
+    return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+struct BVHPrimitive
+{
+    BVHBounds Bounds;
+    Float3 Centroid;
+    uint32 TriangleIdx;
+};
+
+struct BVHRange
+{
+    uint32 Start;
+    uint32 End;
+    BVHBounds Bounds;
+    BVHBounds CentroidBounds;
+
+    uint32 Count() const { return End - Start; }
+};
+
+struct BVHBin
+{
+    BVHBounds Bounds;
+    uint32 Count = 0;
+};
+
+// A range whose subtree gets built in parallel once the top of the tree is done
+struct BVHSubtree
+{
+    BVHRange Range;
+    uint32 Depth;
+    uint32 ParentNode;
+    uint32 ParentSlot;
+};
+
+struct BVHBuildContext
+{
+    vector<BVHPrimitive>& Primitives;
+    uint32 SubtreeSize;
+    vector<BVHSubtree>* Subtrees;       // Only set while building the top of the tree
+
+    BVHBuildContext(vector<BVHPrimitive>& primitives) : Primitives(primitives), SubtreeSize(0), Subtrees(nullptr)
+    {
+    }
+};
+
+// == Construction ================================================================================
+
+static void ComputeRangeBounds(const vector<BVHPrimitive>& primitives, BVHRange& range)
+{
+    range.Bounds = BVHBounds();
+    range.CentroidBounds = BVHBounds();
+    for(uint32 i = range.Start; i < range.End; ++i)
+    {
+        range.Bounds.Grow(primitives[i].Bounds);
+        range.CentroidBounds.Grow(primitives[i].Centroid);
+    }
+}
+
+static uint32 BinIndex(const BVHPrimitive& primitive, uint32 axis, float binStart, float binScale)
+{
+    const float bin = (Component(primitive.Centroid, axis) - binStart) * binScale;
+    return std::min(uint32(std::max(bin, 0.0f)), BVH::NumBins - 1);
+}
+
+// Splits the range in two where the surface area heuristic says it's cheapest to, trying
+// NumBins - 1 planes along each axis. Falls back to splitting at the median when the
+// centroids can't be told apart.
+static void SplitRange(BVHBuildContext& context, const BVHRange& range, uint32 depth, BVHRange& left, BVHRange& right)
+{
+    vector<BVHPrimitive>& primitives = context.Primitives;
+    const uint32 count = range.Count();
+    Assert_(count > 1);
+
+    uint32 bestAxis = 3;
+    uint32 bestSplit = 0;
+    float bestCost = FLT_MAX;
+    float binStart[3];
+    float binScale[3];
+    if(depth < MaxSAHDepth)
+    {
+        // Large ranges at the top of the tree are binned in blocks on every thread
+        const uint32 numBlocks = context.Subtrees != nullptr ? (count + BinBlockSize - 1) / BinBlockSize : 1;
+        const uint32 blockSize = (count + numBlocks - 1) / numBlocks;
+        vector<BVHBin> blockBins(numBlocks * 3 * BVH::NumBins);
+
+        for(uint32 axis = 0; axis < 3; ++axis)
+        {
+            binStart[axis] = Component(range.CentroidBounds.Min, axis);
+            const float extent = Component(range.CentroidBounds.Max, axis) - binStart[axis];
+            binScale[axis] = extent > 0.0f ? BVH::NumBins / extent : 0.0f;
+        }
+
+        auto binBlock = [&](uint32 blockIdx)
+        {
+            BVHBin* bins = &blockBins[blockIdx * 3 * BVH::NumBins];
+            const uint32 start = range.Start + blockIdx * blockSize;
+            const uint32 end = std::min(start + blockSize, range.End);
+            for(uint32 i = start; i < end; ++i)
+            {
+                for(uint32 axis = 0; axis < 3; ++axis)
+                {
+                    BVHBin& bin = bins[axis * BVH::NumBins + BinIndex(primitives[i], axis, binStart[axis], binScale[axis])];
+                    bin.Bounds.Grow(primitives[i].Bounds);
+                    ++bin.Count;
+                }
+            }
+        };
+
+        if(numBlocks > 1)
+            ThreadPool::GlobalPool.ParallelFor(numBlocks, binBlock);
+        else
+            binBlock(0);
+
+        BVHBin bins[3 * BVH::NumBins];
+        for(uint32 blockIdx = 0; blockIdx < numBlocks; ++blockIdx)
+        {
+            for(uint32 i = 0; i < 3 * BVH::NumBins; ++i)
+            {
+                bins[i].Bounds.Grow(blockBins[blockIdx * 3 * BVH::NumBins + i].Bounds);
+                bins[i].Count += blockBins[blockIdx * 3 * BVH::NumBins + i].Count;
+            }
+        }
+
+        // Sweep in from both sides, the cost of a split is the area of each side weighted by
+        // how many triangles it has
+        for(uint32 axis = 0; axis < 3; ++axis)
+        {
+            if(binScale[axis] == 0.0f)
+                continue;
+
+            const BVHBin* axisBins = &bins[axis * BVH::NumBins];
+            float rightCosts[BVH::NumBins];
+            BVHBounds rightBounds;
+            uint32 rightCount = 0;
+            for(uint32 i = BVH::NumBins - 1; i > 0; --i)
+            {
+                rightBounds.Grow(axisBins[i].Bounds);
+                rightCount += axisBins[i].Count;
+                rightCosts[i] = rightBounds.Area() * rightCount;
+            }
+
+            BVHBounds leftBounds;
+            uint32 leftCount = 0;
+            for(uint32 split = 1; split < BVH::NumBins; ++split)
+            {
+                leftBounds.Grow(axisBins[split - 1].Bounds);
+                leftCount += axisBins[split - 1].Count;
+                if(leftCount == 0 || leftCount == count)
+                    continue;
+
+                const float cost = leftBounds.Area() * leftCount + rightCosts[split];
+                if(cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = split;
+                }
+            }
+        }
+    }
+
+    uint32 mid = 0;
+    if(bestAxis < 3)
+    {
+        const float start = binStart[bestAxis];
+        const float scale = binScale[bestAxis];
+        auto firstRight = std::partition(primitives.begin() + range.Start, primitives.begin() + range.End,
+                                         [&](const BVHPrimitive& primitive)
+        {
+            return BinIndex(primitive, bestAxis, start, scale) < bestSplit;
+        });
+        mid = uint32(firstRight - primitives.begin());
+    }
+    else
+    {
+        // Sort around the median of the widest axis, so that the halves are still coherent
+        const Float3 extents = range.CentroidBounds.Max - range.CentroidBounds.Min;
+        const uint32 axis = extents.x >= extents.y && extents.x >= extents.z ? 0 : (extents.y >= extents.z ? 1 : 2);
+        mid = range.Start + count / 2;
+        std::nth_element(primitives.begin() + range.Start, primitives.begin() + mid, primitives.begin() + range.End,
+                         [&](const BVHPrimitive& a, const BVHPrimitive& b)
+        {
+            return Component(a.Centroid, axis) < Component(b.Centroid, axis);
+        });
+    }
+
+    Assert_(mid > range.Start && mid < range.End);
+    left.Start = range.Start;
+    left.End = mid;
+    right.Start = mid;
+    right.End = range.End;
+    ComputeRangeBounds(primitives, left);
+    ComputeRangeBounds(primitives, right);
+}
+
+// Builds a node for the range and everything below it, and returns its index
+static uint32 BuildNode(BVHBuildContext& context, const BVHRange& range, uint32 depth, vector<BVHNode>& nodes)
+{
+    // Keep splitting the child with the largest area until there are 4 of them
+    BVHRange children[4];
+    children[0] = range;
+    uint32 numChildren = 1;
+    while(numChildren < 4)
+    {
+        uint32 bestChild = 4;
+        float bestArea = -1.0f;
+        for(uint32 i = 0; i < numChildren; ++i)
+        {
+            if(children[i].Count() > BVH::MaxLeafTriangles && children[i].Bounds.Area() > bestArea)
+            {
+                bestChild = i;
+                bestArea = children[i].Bounds.Area();
+            }
+        }
+
+        if(bestChild == 4)
+            break;
+
+        BVHRange left;
+        BVHRange right;
+        SplitRange(context, children[bestChild], depth, left, right);
+        children[bestChild] = left;
+        children[numChildren++] = right;
+    }
+
+    const uint32 nodeIdx = uint32(nodes.size());
+    nodes.push_back(BVHNode());
+    for(uint32 slot = 0; slot < 4; ++slot)
+    {
+        BVHNode& node = nodes[nodeIdx];
+        node.Children[slot] = BVHNode::Empty;
+        node.NumTriangles[slot] = 0;
+        node.MinX[slot] = node.MinY[slot] = node.MinZ[slot] = 0.0f;
+        node.MaxX[slot] = node.MaxY[slot] = node.MaxZ[slot] = 0.0f;
+        if(slot >= numChildren)
+            continue;
+
+        const BVHRange& child = children[slot];
+        node.MinX[slot] = child.Bounds.Min.x;
+        node.MinY[slot] = child.Bounds.Min.y;
+        node.MinZ[slot] = child.Bounds.Min.z;
+        node.MaxX[slot] = child.Bounds.Max.x;
+        node.MaxY[slot] = child.Bounds.Max.y;
+        node.MaxZ[slot] = child.Bounds.Max.z;
+
+        if(child.Count() <= BVH::MaxLeafTriangles)
+        {
+            node.Children[slot] = child.Start;
+            node.NumTriangles[slot] = child.Count();
+        }
+        else if(context.Subtrees != nullptr && child.Count() <= context.SubtreeSize)
+        {
+            BVHSubtree subtree;
+            subtree.Range = child;
+            subtree.Depth = depth + 1;
+            subtree.ParentNode = nodeIdx;
+            subtree.ParentSlot = slot;
+            context.Subtrees->push_back(subtree);
+        }
+        else
+        {
+            // The recursion can reallocate the nodes
+            const uint32 childIdx = BuildNode(context, child, depth + 1, nodes);
+            nodes[nodeIdx].Children[slot] = childIdx;
+        }
+    }
+
+    return nodeIdx;
+}
+
+void BVH::Build(vector<BVHTriangle>& sourceTriangles)
+{
+    nodes.clear();
+    triangles.clear();
+
+    const uint32 numTriangles = uint32(sourceTriangles.size());
+    if(numTriangles == 0)
+        return;
+
+    ThreadPool& threadPool = ThreadPool::GlobalPool;
+    const uint32 numBlocks = (numTriangles + BinBlockSize - 1) / BinBlockSize;
+
+    vector<BVHPrimitive> primitives(numTriangles);
+    threadPool.ParallelFor(numBlocks, [&](uint32 blockIdx)
+    {
+        const uint32 start = blockIdx * BinBlockSize;
+        const uint32 end = std::min(start + BinBlockSize, numTriangles);
+        for(uint32 i = start; i < end; ++i)
+        {
+            const BVHTriangle& tri = sourceTriangles[i];
+            BVHPrimitive& primitive = primitives[i];
+            primitive.Bounds.Grow(tri.V0);
+            primitive.Bounds.Grow(tri.V0 + tri.Edge1);
+            primitive.Bounds.Grow(tri.V0 + tri.Edge2);
+            primitive.Centroid = (primitive.Bounds.Min + primitive.Bounds.Max) * 0.5f;
+            primitive.TriangleIdx = i;
+        }
+    });
+
+    BVHRange root;
+    root.Start = 0;
+    root.End = numTriangles;
+    ComputeRangeBounds(primitives, root);
+
+    // Build the top of the tree until the ranges are small enough to hand out one per task,
+    // then build those subtrees on their own and append them
+    vector<BVHSubtree> subtrees;
+    BVHBuildContext context(primitives);
+    context.SubtreeSize = std::max(numTriangles / (8 * (threadPool.NumWorkers() + 1)), BinBlockSize / 4);
+    context.Subtrees = &subtrees;
+    BuildNode(context, root, 0, nodes);
+
+    vector<vector<BVHNode>> subtreeNodes(subtrees.size());
+    threadPool.ParallelFor(uint32(subtrees.size()), [&](uint32 subtreeIdx)
+    {
+        BVHBuildContext subtreeContext(primitives);
+        const BVHSubtree& subtree = subtrees[subtreeIdx];
+        BuildNode(subtreeContext, subtree.Range, subtree.Depth, subtreeNodes[subtreeIdx]);
+    });
+
+    for(uint64 subtreeIdx = 0; subtreeIdx < subtrees.size(); ++subtreeIdx)
+    {
+        const uint32 baseNode = uint32(nodes.size());
+        const vector<BVHNode>& subtree = subtreeNodes[subtreeIdx];
+        for(uint64 i = 0; i < subtree.size(); ++i)
+        {
+            BVHNode node = subtree[i];
+            for(uint32 slot = 0; slot < 4; ++slot)
+            {
+                if(node.NumTriangles[slot] == 0 && node.Children[slot] != BVHNode::Empty)
+                    node.Children[slot] += baseNode;
+            }
+            nodes.push_back(node);
+        }
+
+        nodes[subtrees[subtreeIdx].ParentNode].Children[subtrees[subtreeIdx].ParentSlot] = baseNode;
+    }
+
+    // Put the triangles in leaf order
+    triangles.resize(numTriangles);
+    threadPool.ParallelFor(numBlocks, [&](uint32 blockIdx)
+    {
+        const uint32 start = blockIdx * BinBlockSize;
+        const uint32 end = std::min(start + BinBlockSize, numTriangles);
+        for(uint32 i = start; i < end; ++i)
+            triangles[i] = sourceTriangles[primitives[i].TriangleIdx];
+    });
+
+    vector<BVHTriangle>().swap(sourceTriangles);
+}
+
+// == Queries =====================================================================================
+
+struct BVHRayData
+{
+    XMVECTOR OriginX;
+    XMVECTOR OriginY;
+    XMVECTOR OriginZ;
+    XMVECTOR InvDirX;
+    XMVECTOR InvDirY;
+    XMVECTOR InvDirZ;
+};
+
+static float SafeInverse(float x)
+{
+    // Keeps the slab distances finite for rays parallel to an axis
+    const float MinComponent = 1e-20f;
+    if(std::abs(x) < MinComponent)
+        x = x < 0.0f ? -MinComponent : MinComponent;
+    return 1.0f / x;
+}
+
+static BVHRayData PrepareRay(const BVHRay& ray)
+{
+    BVHRayData data;
+    data.OriginX = XMVectorReplicate(ray.Origin.x);
+    data.OriginY = XMVectorReplicate(ray.Origin.y);
+    data.OriginZ = XMVectorReplicate(ray.Origin.z);
+    data.InvDirX = XMVectorReplicate(SafeInverse(ray.Direction.x));
+    data.InvDirY = XMVectorReplicate(SafeInverse(ray.Direction.y));
+    data.InvDirZ = XMVectorReplicate(SafeInverse(ray.Direction.z));
+    return data;
+}
+
+// Slab test against all 4 children at once. Writes where the ray enters each child and
+// returns a bit for each one it hits within [tMin, tMax].
+static uint32 IntersectChildren(const BVHNode& node, const BVHRayData& ray, float tMin, float tMax, float tEnter[4])
+{
+    const XMVECTOR t0X = XMVectorMultiply(XMVectorSubtract(XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(node.MinX)), ray.OriginX), ray.InvDirX);
+    const XMVECTOR t0Y = XMVectorMultiply(XMVectorSubtract(XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(node.MinY)), ray.OriginY), ray.InvDirY);
+    const XMVECTOR t0Z = XMVectorMultiply(XMVectorSubtract(XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(node.MinZ)), ray.OriginZ), ray.InvDirZ);
+    const XMVECTOR t1X = XMVectorMultiply(XMVectorSubtract(XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(node.MaxX)), ray.OriginX), ray.InvDirX);
+    const XMVECTOR t1Y = XMVectorMultiply(XMVectorSubtract(XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(node.MaxY)), ray.OriginY), ray.InvDirY);
+    const XMVECTOR t1Z = XMVectorMultiply(XMVectorSubtract(XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(node.MaxZ)), ray.OriginZ), ray.InvDirZ);
+
+    const XMVECTOR nearT = XMVectorMax(XMVectorMax(XMVectorMin(t0X, t1X), XMVectorMin(t0Y, t1Y)),
+                                       XMVectorMax(XMVectorMin(t0Z, t1Z), XMVectorReplicate(tMin)));
+    const XMVECTOR farT = XMVectorMin(XMVectorMin(XMVectorMax(t0X, t1X), XMVectorMax(t0Y, t1Y)),
+                                      XMVectorMin(XMVectorMax(t0Z, t1Z), XMVectorReplicate(tMax)));
+
+    XMFLOAT4 nearT4;
+    XMFLOAT4 farT4;
+    XMStoreFloat4(&nearT4, nearT);
+    XMStoreFloat4(&farT4, farT);
+    tEnter[0] = nearT4.x;
+    tEnter[1] = nearT4.y;
+    tEnter[2] = nearT4.z;
+    tEnter[3] = nearT4.w;
+    const float exitT[4] = { farT4.x, farT4.y, farT4.z, farT4.w };
+
+    uint32 hitMask = 0;
+    for(uint32 slot = 0; slot < 4; ++slot)
+    {
+        const bool used = node.NumTriangles[slot] > 0 || node.Children[slot] != BVHNode::Empty;
+        if(used && tEnter[slot] <= exitT[slot])
+            hitMask |= 1 << slot;
+    }
+
+    return hitMask;
+}
+
+// Moller-Trumbore, without culling either side
+static bool IntersectTriangle(const BVHTriangle& tri, const BVHRay& ray, float tMin, float tMax,
+                              float& t, float& u, float& v)
+{
+    const Float3 p = Float3::Cross(ray.Direction, tri.Edge2);
+    const float det = Float3::Dot(tri.Edge1, p);
+    if(det == 0.0f)
+        return false;
+
+    const float invDet = 1.0f / det;
+    const Float3 s = ray.Origin - tri.V0;
+    u = Float3::Dot(s, p) * invDet;
+    if(u < 0.0f || u > 1.0f)
+        return false;
+
+    const Float3 q = Float3::Cross(s, tri.Edge1);
+    v = Float3::Dot(ray.Direction, q) * invDet;
+    if(v < 0.0f || u + v > 1.0f)
+        return false;
+
+    t = Float3::Dot(tri.Edge2, q) * invDet;
+    return t >= tMin && t <= tMax;
+}
+
+bool BVH::ClosestHit(const BVHRay& ray, BVHHit& hit) const
+{
+    if(nodes.empty())
+        return false;
+
+    const BVHRayData rayData = PrepareRay(ray);
+    float closestT = ray.TMax;
+    uint32 closestTri = BVHNode::Empty;
+
+    uint32 stack[TraversalStackSize];
+    uint32 stackSize = 0;
+    stack[stackSize++] = 0;
+    while(stackSize > 0)
+    {
+        const BVHNode& node = nodes[stack[--stackSize]];
+
+        float tEnter[4];
+        const uint32 hitMask = IntersectChildren(node, rayData, ray.TMin, closestT, tEnter);
+
+        // Leaves are tested right away, which can rule out some of the nodes
+        uint32 innerSlots[4];
+        uint32 numInner = 0;
+        for(uint32 slot = 0; slot < 4; ++slot)
+        {
+            if((hitMask & (1 << slot)) == 0)
+                continue;
+
+            if(node.NumTriangles[slot] == 0)
+            {
+                innerSlots[numInner++] = slot;
+                continue;
+            }
+
+            for(uint32 i = node.Children[slot]; i < node.Children[slot] + node.NumTriangles[slot]; ++i)
+            {
+                float t, u, v;
+                if(IntersectTriangle(triangles[i], ray, ray.TMin, closestT, t, u, v))
+                {
+                    closestT = t;
+                    closestTri = i;
+                    hit.U = u;
+                    hit.V = v;
+                }
+            }
+        }
+
+        // Push the nodes farthest first, so that the nearest is visited next
+        for(uint32 i = 1; i < numInner; ++i)
+        {
+            const uint32 slot = innerSlots[i];
+            uint32 j = i;
+            for(; j > 0 && tEnter[innerSlots[j - 1]] < tEnter[slot]; --j)
+                innerSlots[j] = innerSlots[j - 1];
+            innerSlots[j] = slot;
+        }
+
+        for(uint32 i = 0; i < numInner; ++i)
+        {
+            if(tEnter[innerSlots[i]] <= closestT)
+            {
+                Assert_(stackSize < TraversalStackSize);
+                stack[stackSize++] = node.Children[innerSlots[i]];
+            }
+        }
+    }
+
+    if(closestTri == BVHNode::Empty)
+        return false;
+
+    const BVHTriangle& tri = triangles[closestTri];
+    hit.T = closestT;
+    hit.MeshIdx = tri.MeshIdx;
+    hit.PartIdx = tri.PartIdx;
+    hit.TriangleIdx = tri.TriangleIdx;
+    return true;
+}
+
+bool BVH::AnyHit(const BVHRay& ray) const
+{
+    if(nodes.empty())
+        return false;
+
+    const BVHRayData rayData = PrepareRay(ray);
+
+    uint32 stack[TraversalStackSize];
+    uint32 stackSize = 0;
+    stack[stackSize++] = 0;
+    while(stackSize > 0)
+    {
+        const BVHNode& node = nodes[stack[--stackSize]];
+
+        float tEnter[4];
+        const uint32 hitMask = IntersectChildren(node, rayData, ray.TMin, ray.TMax, tEnter);
+        for(uint32 slot = 0; slot < 4; ++slot)
+        {
+            if((hitMask & (1 << slot)) == 0)
+                continue;
+
+            if(node.NumTriangles[slot] == 0)
+            {
+                Assert_(stackSize < TraversalStackSize);
+                stack[stackSize++] = node.Children[slot];
+                continue;
+            }
+
+            for(uint32 i = node.Children[slot]; i < node.Children[slot] + node.NumTriangles[slot]; ++i)
+            {
+                float t, u, v;
+                if(IntersectTriangle(triangles[i], ray, ray.TMin, ray.TMax, t, u, v))
+                    return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+// == Model =======================================================================================
+
+static Float3 LoadPosition(const uint8* vertex, DXGI_FORMAT format, const MeshPart& part)
+{
+    if(format == DXGI_FORMAT_R16G16B16A16_UNORM)
+    {
+        const uint16* quantized = reinterpret_cast<const uint16*>(vertex);
+        const Float3 position = Float3(quantized[0] / 65535.0f, quantized[1] / 65535.0f, quantized[2] / 65535.0f);
+        return position * part.PositionScale + part.PositionOffset;
+    }
+
+    return *reinterpret_cast<const Float3*>(vertex);
+}
+
+void BVH::Build(const Model& model)
+{
+    // Every part's triangles go in their own range, so that they can be gathered in parallel
+    struct PartTriangles
+    {
+        uint32 MeshIdx;
+        uint32 PartIdx;
+        uint32 Start;
+    };
+
+    const vector<Mesh>& meshes = model.Meshes();
+    vector<uint32> positionOffsets(meshes.size(), 0);
+    vector<DXGI_FORMAT> positionFormats(meshes.size(), DXGI_FORMAT_UNKNOWN);
+    vector<PartTriangles> parts;
+    uint32 numTriangles = 0;
+    for(uint32 meshIdx = 0; meshIdx < uint32(meshes.size()); ++meshIdx)
+    {
+        const Mesh& mesh = meshes[meshIdx];
+        for(uint32 elemIdx = 0; elemIdx < mesh.NumInputElements(); ++elemIdx)
+        {
+            const D3D11_INPUT_ELEMENT_DESC& elem = mesh.InputElements()[elemIdx];
+            if(std::string(elem.SemanticName) == "POSITION")
+            {
+                positionOffsets[meshIdx] = elem.AlignedByteOffset;
+                positionFormats[meshIdx] = elem.Format;
+            }
+        }
+
+        if(positionFormats[meshIdx] != DXGI_FORMAT_R32G32B32_FLOAT && positionFormats[meshIdx] != DXGI_FORMAT_R16G16B16A16_UNORM)
+            throw Exception(L"Can't build a BVH, mesh doesn't have float or 16-bit UNORM positions");
+
+        const vector<MeshPart>& meshParts = mesh.MeshParts();
+        for(uint32 partIdx = 0; partIdx < uint32(meshParts.size()); ++partIdx)
+        {
+            PartTriangles part;
+            part.MeshIdx = meshIdx;
+            part.PartIdx = partIdx;
+            part.Start = numTriangles;
+            parts.push_back(part);
+            numTriangles += meshParts[partIdx].IndexCount / 3;
+        }
+    }
+
+    vector<BVHTriangle> sourceTriangles(numTriangles);
+    ThreadPool::GlobalPool.ParallelFor(uint32(parts.size()), [&](uint32 i)
+    {
+        const Mesh& mesh = meshes[parts[i].MeshIdx];
+        const MeshPart& part = mesh.MeshParts()[parts[i].PartIdx];
+        const DXGI_FORMAT positionFormat = positionFormats[parts[i].MeshIdx];
+
+        const uint8* vertices = mesh.Vertices() + positionOffsets[parts[i].MeshIdx];
+        const uint8* indices = mesh.Indices();
+        const uint32 indexSize = mesh.IndexSize();
+        const uint32 stride = mesh.VertexStride();
+        for(uint32 tri = 0; tri < part.IndexCount / 3; ++tri)
+        {
+            const uint32 indexStart = part.IndexStart + tri * 3;
+            Float3 positions[3];
+            for(uint32 j = 0; j < 3; ++j)
+            {
+                const uint32 vertexIdx = GetIndex(indices, indexStart + j, indexSize) + part.BaseVertex;
+                positions[j] = LoadPosition(vertices + uint64(vertexIdx) * stride, positionFormat, part);
+            }
+
+            BVHTriangle& bvhTri = sourceTriangles[parts[i].Start + tri];
+            bvhTri.V0 = positions[0];
+            bvhTri.Edge1 = positions[1] - positions[0];
+            bvhTri.Edge2 = positions[2] - positions[0];
+            bvhTri.MeshIdx = parts[i].MeshIdx;
+            bvhTri.PartIdx = parts[i].PartIdx;
+            bvhTri.TriangleIdx = indexStart / 3;
+        }
+    });
+
+    Build(sourceTriangles);
+}
+
+bool BVH::LoadFromMeshData(const wchar* fileName)
+{
+    CookedAssetReader reader;
+    const CookedAssetStatus status = reader.Open(fileName, Model::MeshDataAssetType, Model::MeshDataVersion);
+    if(status != CookedAssetStatus::Valid)
+        throw Exception(L"Can't load a BVH from " + std::wstring(fileName) + L": " + CookedAssetStatusString(status));
+
+    if(reader.FindSection(MeshDataSection) == nullptr)
+        return false;
+
+    MappedReadSerializer serializer = reader.ReadSection(MeshDataSection);
+    Serialize(serializer);
+    return true;
+}
+
+}
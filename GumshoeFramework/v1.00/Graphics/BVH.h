@@ -0,0 +1,117 @@
+//-------------------------------------------------------------------------------
+//
+// Gumshoe Framework v1.00
+//   - Based on MJP's DX11 Sample Framework (http://mynameismjp.wordpress.com/)
+//
+//  All code licensed under the MIT license
+//
+//-------------------------------------------------------------------------------
+
+#pragma once
+
+#include "..\\PCH.h"
+#include "..\\GF_Math.h"
+#include "..\\Serialization.h"
+
+namespace GumshoeFramework10
+{
+
+class Model;
+
+struct BVHRay
+{
+    Float3 Origin;
+    Float3 Direction;               // Doesn't need to be normalized, T is in multiples of it
+    float TMin = 0.0f;
+    float TMax = FLT_MAX;
+};
+
+struct BVHHit
+{
+    float T;
+    float U;                        // Barycentrics of the 2nd and 3rd vertex
+    float V;
+    uint32 MeshIdx;
+    uint32 PartIdx;
+    uint32 TriangleIdx;             // Offset of the triangle in the mesh's index buffer / 3
+};
+
+// Each node holds the bounds of its 4 children as separate arrays of x, y and z, so that a ray
+// can be tested against all of them with one set of SIMD instructions. A node is 2 cache lines.
+struct BVHNode
+{
+    float MinX[4];
+    float MinY[4];
+    float MinZ[4];
+    float MaxX[4];
+    float MaxY[4];
+    float MaxZ[4];
+
+    // A child with triangles is a leaf, and Children is the index of its first triangle.
+    // Otherwise it's the index of a node, or BVHNode::Empty for unused children.
+    uint32 Children[4];
+    uint32 NumTriangles[4];
+
+    static const uint32 Empty = 0xFFFFFFFF;
+};
+
+// Triangles are stored in leaf order, already set up for the intersection test
+struct BVHTriangle
+{
+    Float3 V0;
+    Float3 Edge1;                   // V1 - V0
+    Float3 Edge2;                   // V2 - V0
+    uint32 MeshIdx;
+    uint32 PartIdx;
+    uint32 TriangleIdx;
+};
+
+// A 4-wide bounding volume hierarchy over triangles, for ray queries on the CPU. It's built
+// top-down with a binned surface area heuristic, and each node is made by splitting the
+// largest of its children until it has 4. The upper levels are split with the triangles
+// binned in parallel, then the subtrees below them are built in parallel.
+class BVH
+{
+
+public:
+
+    static const uint32 MaxLeafTriangles = 4;
+    static const uint32 NumBins = 16;
+
+    // FourCC of the section that Model::SaveMeshData() saves it to
+    static const uint32 MeshDataSection = 0x34485642;       // "BVH4"
+
+    // Builds over the full detail parts of every mesh. Quantized positions are decoded.
+    void Build(const Model& model);
+
+    // Builds over the triangles, which are taken and reordered
+    void Build(std::vector<BVHTriangle>& triangles);
+
+    // Finds the closest triangle the ray hits within [TMin, TMax]. Triangles are hit from
+    // either side.
+    bool ClosestHit(const BVHRay& ray, BVHHit& hit) const;
+
+    // Returns as soon as the ray hits anything, for visibility tests
+    bool AnyHit(const BVHRay& ray) const;
+
+    // Loads the BVH saved with a model's mesh data. Returns false if it was saved without one.
+    bool LoadFromMeshData(const wchar* fileName);
+
+    // Accessors
+    const std::vector<BVHNode>& Nodes() const { return nodes; }
+    const std::vector<BVHTriangle>& Triangles() const { return triangles; }
+
+    // Model::MeshDataVersion needs to be bumped if this changes
+    template<typename TSerializer> void Serialize(TSerializer& serializer)
+    {
+        SerializeRawVector(serializer, nodes);
+        SerializeRawVector(serializer, triangles);
+    }
+
+protected:
+
+    std::vector<BVHNode> nodes;
+    std::vector<BVHTriangle> triangles;
+};
+
+}
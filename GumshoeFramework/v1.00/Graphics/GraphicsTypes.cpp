@@ -477,69 +477,49 @@ void StructuredBuffer::WriteToFile(const wchar* path, ID3D11Device* device, ID3D
         hiddenCounter =(uavDesc.Format & D3D11_BUFFER_UAV_FLAG_COUNTER) ? 1 : 0;
     }
 
-    // If the exists, delete it
-    if(FileExists(path))
-        Win32Call(DeleteFile(path));
-
-    // Create the file
-    HANDLE fileHandle = CreateFile(path, GENERIC_WRITE, 0, nullptr, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, nullptr);
-    if(fileHandle == INVALID_HANDLE_VALUE)
-        Win32Call(false);
-
-    // Write the buffer info
-    DWORD bytesWritten = 0;
-    Win32Call(WriteFile(fileHandle, &Size, 4, &bytesWritten, nullptr));
-    Win32Call(WriteFile(fileHandle, &Stride, 4, &bytesWritten, nullptr));
-    Win32Call(WriteFile(fileHandle, &NumElements, 4, &bytesWritten, nullptr));
-    Win32Call(WriteFile(fileHandle, &useAsUAV, 4, &bytesWritten, nullptr));
-    Win32Call(WriteFile(fileHandle, &hiddenCounter, 4, &bytesWritten, nullptr));
-    Win32Call(WriteFile(fileHandle, &appendConsume, 4, &bytesWritten, nullptr));
-
     // Get the buffer data
     StagingBuffer stagingBuffer;
     stagingBuffer.Initialize(device, Size);
     context->CopyResource(stagingBuffer.Buffer, Buffer);
-    const void* bufferData= stagingBuffer.Map(context);
-
-    // Write the data to the file
-    Win32Call(WriteFile(fileHandle, bufferData, Size, &bytesWritten, nullptr));
+    const void* bufferData = stagingBuffer.Map(context);
+
+    // Write the buffer info and data, deflated since buffer dumps tend to be large and repetitive
+    FileWriteSerializer fileSerializer(path);
+    CompressedWriteSerializer<FileWriteSerializer> serializer(fileSerializer);
+    serializer.SerializeItem(Size);
+    serializer.SerializeItem(Stride);
+    serializer.SerializeItem(NumElements);
+    serializer.SerializeItem(useAsUAV);
+    serializer.SerializeItem(hiddenCounter);
+    serializer.SerializeItem(appendConsume);
+    serializer.SerializeData(Size, bufferData);
+    serializer.Finish();
+    fileSerializer.Flush();
 
     // Un-map the staging buffer
     stagingBuffer.Unmap(context);
-
-    // Close the file
-    Win32Call(CloseHandle(fileHandle));
 }
 
 void StructuredBuffer::ReadFromFile(const wchar* path, ID3D11Device* device)
 {
-    // Open the file
-    HANDLE fileHandle = CreateFile(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
-    if(fileHandle == INVALID_HANDLE_VALUE)
-        Win32Call(false);
+    FileReadSerializer fileSerializer(path);
+    CompressedReadSerializer<FileReadSerializer> serializer(fileSerializer);
 
     // Read the buffer info
     bool32 useAsUAV, hiddenCounter, appendConsume;
-    DWORD bytesRead = 0;
-    Win32Call(ReadFile(fileHandle, &Size, 4, &bytesRead, nullptr));
-    Win32Call(ReadFile(fileHandle, &Stride, 4, &bytesRead, nullptr));
-    Win32Call(ReadFile(fileHandle, &NumElements, 4, &bytesRead, nullptr));
-    Win32Call(ReadFile(fileHandle, &useAsUAV, 4, &bytesRead, nullptr));
-    Win32Call(ReadFile(fileHandle, &hiddenCounter, 4, &bytesRead, nullptr));
-    Win32Call(ReadFile(fileHandle, &appendConsume, 4, &bytesRead, nullptr));
+    serializer.SerializeItem(Size);
+    serializer.SerializeItem(Stride);
+    serializer.SerializeItem(NumElements);
+    serializer.SerializeItem(useAsUAV);
+    serializer.SerializeItem(hiddenCounter);
+    serializer.SerializeItem(appendConsume);
 
     // Read the buffer data
-    UINT8* bufferData = new UINT8[Size];
-    Win32Call(ReadFile(fileHandle, bufferData, Size, &bytesRead, nullptr));
-
-    // Close the file
-    Win32Call(CloseHandle(fileHandle));
+    std::vector<uint8> bufferData(Size);
+    serializer.SerializeData(Size, bufferData.data());
 
     // Init
-    Initialize(device, Stride, NumElements, useAsUAV, appendConsume, hiddenCounter, bufferData);
-
-    // Clean up
-    delete [] bufferData;
+    Initialize(device, Stride, NumElements, useAsUAV, appendConsume, hiddenCounter, bufferData.data());
 }
 
 // == StagingBuffer ===============================================================================
@@ -0,0 +1,1309 @@
+//-------------------------------------------------------------------------------
+//
+// Gumshoe Framework v1.00
+//   - Based on MJP's DX11 Sample Framework (http://mynameismjp.wordpress.com/)
+//
+//  All code licensed under the MIT license
+//
+//-------------------------------------------------------------------------------
+
+#include "PCH.h"
+
+#include "MeshOptimizer.h"
+
+#include "..\\ThreadPool.h"
+
+using std::vector;
+
+namespace GumshoeFramework10
+{
+
+// == Vertex cache analysis =======================================================================
+
+VertexCacheStats AnalyzeVertexCache(const uint32* indices, uint64 numIndices, uint32 numVertices, uint32 cacheSize)
+{
+    Assert_(numIndices % 3 == 0);
+
+    VertexCacheStats stats;
+    stats.NumTriangles = numIndices / 3;
+
+    // A vertex is in the FIFO if fewer than cacheSize other vertices were transformed since it was
+    vector<uint64> cacheTimestamps(numVertices, 0);
+    uint64 timestamp = cacheSize + 1;
+    for(uint64 i = 0; i < numIndices; ++i)
+    {
+        const uint32 idx = indices[i];
+        Assert_(idx < numVertices);
+
+        if(cacheTimestamps[idx] == 0)
+            ++stats.NumVertices;
+
+        if(timestamp - cacheTimestamps[idx] > cacheSize)
+        {
+            cacheTimestamps[idx] = timestamp++;
+            ++stats.NumTransforms;
+        }
+    }
+
+    return stats;
+}
+
+// == Vertex cache optimization ===================================================================
+
+// Scoring parameters from the paper. The simulated cache is an LRU that's a bit bigger than
+// the hardware's, so that the scores still favor vertices that are likely to be resident.
+static const uint32 ForsythCacheSize = 32;
+static const uint32 ForsythMaxValence = 32;
+static const float ForsythCacheDecayPower = 1.5f;
+static const float ForsythLastTriScore = 0.75f;
+static const float ForsythValenceBoostScale = 2.0f;
+static const float ForsythValenceBoostPower = 0.5f;
+
+struct ForsythScoreTables
+{
+    float Cache[ForsythCacheSize];
+    float Valence[ForsythMaxValence + 1];
+
+    ForsythScoreTables()
+    {
+        for(uint32 i = 0; i < ForsythCacheSize; ++i)
+        {
+            // The vertices of the last triangle get a fixed score, so that the next triangle
+            // doesn't just pick the same edge again
+            if(i < 3)
+                Cache[i] = ForsythLastTriScore;
+            else
+            {
+                const float scaler = 1.0f / float(ForsythCacheSize - 3);
+                Cache[i] = std::pow(1.0f - float(i - 3) * scaler, ForsythCacheDecayPower);
+            }
+        }
+
+        // Boost vertices with few triangles left, so that they're finished off instead of
+        // leaving lone triangles behind
+        Valence[0] = 0.0f;
+        for(uint32 i = 1; i <= ForsythMaxValence; ++i)
+            Valence[i] = ForsythValenceBoostScale * std::pow(float(i), -ForsythValenceBoostPower);
+    }
+};
+
+static const ForsythScoreTables ForsythScores;
+
+static float ForsythVertexScore(int32 cachePos, uint32 remainingTris)
+{
+    if(remainingTris == 0)
+        return -1.0f;
+
+    float score = cachePos >= 0 ? ForsythScores.Cache[cachePos] : 0.0f;
+    score += ForsythScores.Valence[std::min(remainingTris, ForsythMaxValence)];
+    return score;
+}
+
+void OptimizeVertexCache(uint32* indices, uint64 numIndices, uint32 numVertices)
+{
+    Assert_(numIndices % 3 == 0);
+
+    const uint64 numTriangles = numIndices / 3;
+    if(numTriangles <= 1)
+        return;
+
+    // Build the list of triangles using each vertex
+    vector<uint32> remainingTris(numVertices, 0);
+    for(uint64 i = 0; i < numIndices; ++i)
+    {
+        Assert_(indices[i] < numVertices);
+        ++remainingTris[indices[i]];
+    }
+
+    vector<uint32> vertexTriStart(numVertices + 1, 0);
+    for(uint32 v = 0; v < numVertices; ++v)
+        vertexTriStart[v + 1] = vertexTriStart[v] + remainingTris[v];
+
+    vector<uint32> vertexTris(numIndices);
+    {
+        vector<uint32> fill(vertexTriStart.begin(), vertexTriStart.end() - 1);
+        for(uint64 i = 0; i < numIndices; ++i)
+            vertexTris[fill[indices[i]]++] = uint32(i / 3);
+    }
+
+    vector<int32> cachePos(numVertices, -1);
+    vector<float> vertexScores(numVertices, 0.0f);
+    for(uint32 v = 0; v < numVertices; ++v)
+        vertexScores[v] = ForsythVertexScore(-1, remainingTris[v]);
+
+    vector<uint8> triEmitted(numTriangles, 0);
+    uint32 bestTri = 0;
+    float bestScore = -1.0f;
+    for(uint64 t = 0; t < numTriangles; ++t)
+    {
+        const uint32* tri = indices + t * 3;
+        const float score = vertexScores[tri[0]] + vertexScores[tri[1]] + vertexScores[tri[2]];
+        if(score > bestScore)
+        {
+            bestScore = score;
+            bestTri = uint32(t);
+        }
+    }
+
+    // The extra 3 entries hold the vertices pushed out of the cache by the last triangle,
+    // whose scores need updating too
+    uint32 cache[ForsythCacheSize + 3];
+    uint32 cacheCount = 0;
+
+    vector<uint32> output(numIndices);
+    uint64 numEmitted = 0;
+    uint64 searchCursor = 0;
+
+    while(true)
+    {
+        const uint32* tri = indices + bestTri * 3;
+        uint32* outTri = &output[numEmitted * 3];
+        outTri[0] = tri[0];
+        outTri[1] = tri[1];
+        outTri[2] = tri[2];
+        triEmitted[bestTri] = 1;
+        if(++numEmitted == numTriangles)
+            break;
+
+        // Take the triangle out of its vertices' lists
+        for(uint32 i = 0; i < 3; ++i)
+        {
+            const uint32 v = tri[i];
+            uint32* tris = &vertexTris[vertexTriStart[v]];
+            const uint32 count = remainingTris[v];
+            for(uint32 j = 0; j < count; ++j)
+            {
+                if(tris[j] == bestTri)
+                {
+                    tris[j] = tris[count - 1];
+                    break;
+                }
+            }
+
+            --remainingTris[v];
+        }
+
+        // Move the triangle's vertices to the front of the LRU
+        uint32 newCache[ForsythCacheSize + 3];
+        newCache[0] = tri[0];
+        newCache[1] = tri[1];
+        newCache[2] = tri[2];
+        uint32 newCacheCount = 3;
+        for(uint32 i = 0; i < cacheCount; ++i)
+        {
+            const uint32 v = cache[i];
+            if(v != tri[0] && v != tri[1] && v != tri[2])
+                newCache[newCacheCount++] = v;
+        }
+
+        for(uint32 i = 0; i < newCacheCount; ++i)
+        {
+            const uint32 v = newCache[i];
+            cachePos[v] = i < ForsythCacheSize ? int32(i) : -1;
+            vertexScores[v] = ForsythVertexScore(cachePos[v], remainingTris[v]);
+        }
+
+        // Rescore the triangles touching the cache, and pick the best one for the next round
+        bestScore = -1.0f;
+        bestTri = uint32(-1);
+        for(uint32 i = 0; i < newCacheCount; ++i)
+        {
+            const uint32 v = newCache[i];
+            const uint32* tris = &vertexTris[vertexTriStart[v]];
+            for(uint32 j = 0; j < remainingTris[v]; ++j)
+            {
+                const uint32 t = tris[j];
+                const uint32* adjTri = indices + t * 3;
+                const float score = vertexScores[adjTri[0]] + vertexScores[adjTri[1]] + vertexScores[adjTri[2]];
+                if(score > bestScore)
+                {
+                    bestScore = score;
+                    bestTri = t;
+                }
+            }
+        }
+
+        cacheCount = std::min(newCacheCount, ForsythCacheSize);
+        memcpy(cache, newCache, cacheCount * sizeof(uint32));
+
+        // Nothing left around the cache, so start again from the first triangle that's left. The
+        // paper restarts at the best scoring triangle overall, but that makes it quadratic on
+        // meshes with lots of disconnected pieces.
+        if(bestTri == uint32(-1))
+        {
+            while(triEmitted[searchCursor])
+                ++searchCursor;
+            bestTri = uint32(searchCursor);
+        }
+    }
+
+    memcpy(indices, output.data(), numIndices * sizeof(uint32));
+}
+
+// == Overdraw ====================================================================================
+
+static const float* GetPosition(const uint8* positions, uint32 positionStride, uint32 idx)
+{
+    return reinterpret_cast<const float*>(positions + uint64(idx) * positionStride);
+}
+
+static float EdgeFunction(const float* a, const float* b, float x, float y)
+{
+    return (b[0] - a[0]) * (y - a[1]) - (b[1] - a[1]) * (x - a[0]);
+}
+
+// Rasterizes one triangle in screen space, returns the number of pixels that passed the depth test
+static uint64 RasterizeOverdrawTriangle(const float* v0, const float* v1, const float* v2, float* depthBuffer)
+{
+    const float area = EdgeFunction(v0, v1, v2[0], v2[1]);
+    if(area == 0.0f)
+        return 0;
+
+    // Culling was done in 3D, so just make the winding consistent here
+    if(area < 0.0f)
+        std::swap(v1, v2);
+    const float invArea = 1.0f / std::abs(area);
+
+    const int32 maxCoord = int32(OverdrawViewSize) - 1;
+    const int32 minX = std::max(int32(std::floor(std::min(std::min(v0[0], v1[0]), v2[0]))), 0);
+    const int32 maxX = std::min(int32(std::ceil(std::max(std::max(v0[0], v1[0]), v2[0]))), maxCoord);
+    const int32 minY = std::max(int32(std::floor(std::min(std::min(v0[1], v1[1]), v2[1]))), 0);
+    const int32 maxY = std::min(int32(std::ceil(std::max(std::max(v0[1], v1[1]), v2[1]))), maxCoord);
+
+    uint64 numShaded = 0;
+    for(int32 y = minY; y <= maxY; ++y)
+    {
+        for(int32 x = minX; x <= maxX; ++x)
+        {
+            const float px = x + 0.5f;
+            const float py = y + 0.5f;
+            const float w0 = EdgeFunction(v1, v2, px, py);
+            const float w1 = EdgeFunction(v2, v0, px, py);
+            const float w2 = EdgeFunction(v0, v1, px, py);
+            if(w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+                continue;
+
+            // Strictly less, so that the second triangle along a shared edge doesn't count
+            const float z = (w0 * v0[2] + w1 * v1[2] + w2 * v2[2]) * invArea;
+            float& depth = depthBuffer[y * OverdrawViewSize + x];
+            if(z < depth)
+            {
+                depth = z;
+                ++numShaded;
+            }
+        }
+    }
+
+    return numShaded;
+}
+
+OverdrawStats AnalyzeOverdraw(const uint32* indices, uint64 numIndices, const uint8* positions,
+                              uint32 positionStride, uint32 numVertices)
+{
+    Assert_(numIndices % 3 == 0);
+
+    OverdrawStats stats;
+    if(numIndices == 0)
+        return stats;
+
+    float boundsMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float boundsMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for(uint64 i = 0; i < numIndices; ++i)
+    {
+        Assert_(indices[i] < numVertices);
+        const float* pos = GetPosition(positions, positionStride, indices[i]);
+        for(uint32 c = 0; c < 3; ++c)
+        {
+            boundsMin[c] = std::min(boundsMin[c], pos[c]);
+            boundsMax[c] = std::max(boundsMax[c], pos[c]);
+        }
+    }
+
+    // Same scale for every view, so that they're all weighted by their projected area
+    const float maxExtent = std::max(std::max(boundsMax[0] - boundsMin[0], boundsMax[1] - boundsMin[1]), boundsMax[2] - boundsMin[2]);
+    const float scale = maxExtent > 0.0f ? float(OverdrawViewSize) / maxExtent : 0.0f;
+
+    // Views look down -X, +X, -Y, +Y, -Z and +Z, and are rendered in parallel
+    static const uint32 NumViews = 6;
+    uint64 viewCovered[NumViews] = { };
+    uint64 viewShaded[NumViews] = { };
+
+    ThreadPool::GlobalPool.ParallelFor(NumViews, [&](uint32 viewIdx)
+    {
+        const uint32 axis = viewIdx / 2;
+        const float forward = (viewIdx % 2) == 0 ? -1.0f : 1.0f;
+        const uint32 right = (axis + 1) % 3;
+        const uint32 up = (axis + 2) % 3;
+
+        vector<float> depthBuffer(OverdrawViewSize * OverdrawViewSize, FLT_MAX);
+
+        uint64 numShaded = 0;
+        for(uint64 i = 0; i < numIndices; i += 3)
+        {
+            const float* p0 = GetPosition(positions, positionStride, indices[i + 0]);
+            const float* p1 = GetPosition(positions, positionStride, indices[i + 1]);
+            const float* p2 = GetPosition(positions, positionStride, indices[i + 2]);
+
+            // Front faces are clockwise, so their cross product points back at the viewer
+            const float e1a = p1[right] - p0[right], e1b = p1[up] - p0[up];
+            const float e2a = p2[right] - p0[right], e2b = p2[up] - p0[up];
+            const float normal = e1a * e2b - e1b * e2a;
+            if(normal * forward >= 0.0f)
+                continue;
+
+            float v[3][3];
+            const float* p[3] = { p0, p1, p2 };
+            for(uint32 j = 0; j < 3; ++j)
+            {
+                v[j][0] = (p[j][right] - boundsMin[right]) * scale;
+                v[j][1] = (p[j][up] - boundsMin[up]) * scale;
+                v[j][2] = p[j][axis] * forward;
+            }
+
+            numShaded += RasterizeOverdrawTriangle(v[0], v[1], v[2], depthBuffer.data());
+        }
+
+        uint64 numCovered = 0;
+        for(uint64 i = 0; i < depthBuffer.size(); ++i)
+            numCovered += depthBuffer[i] < FLT_MAX ? 1 : 0;
+
+        viewCovered[viewIdx] = numCovered;
+        viewShaded[viewIdx] = numShaded;
+    });
+
+    for(uint32 i = 0; i < NumViews; ++i)
+    {
+        stats.PixelsCovered += viewCovered[i];
+        stats.PixelsShaded += viewShaded[i];
+    }
+
+    return stats;
+}
+
+// Number of vertices of a triangle that missed a FIFO cache, using the same timestamps as
+// AnalyzeVertexCache(). Advancing the timestamp by more than the cache size flushes it.
+static uint32 SimulateCacheTriangle(const uint32* tri, uint64* cacheTimestamps, uint64& timestamp)
+{
+    uint32 misses = 0;
+    for(uint32 i = 0; i < 3; ++i)
+    {
+        if(timestamp - cacheTimestamps[tri[i]] > VertexCacheSimSize)
+        {
+            cacheTimestamps[tri[i]] = timestamp++;
+            ++misses;
+        }
+    }
+
+    return misses;
+}
+
+void OptimizeOverdraw(uint32* indices, uint64 numIndices, const uint8* positions, uint32 positionStride,
+                      uint32 numVertices, float threshold)
+{
+    Assert_(numIndices % 3 == 0);
+
+    const uint64 numTriangles = numIndices / 3;
+    if(numTriangles <= 1)
+        return;
+
+    vector<uint64> cacheTimestamps(numVertices, 0);
+    uint64 timestamp = VertexCacheSimSize + 1;
+
+    // Hard boundaries are where the cache order ran out of neighbors and started over
+    vector<uint64> hardBoundaries;
+    for(uint64 t = 0; t < numTriangles; ++t)
+    {
+        const uint32 misses = SimulateCacheTriangle(indices + t * 3, cacheTimestamps.data(), timestamp);
+        if(t == 0 || misses == 3)
+            hardBoundaries.push_back(t);
+    }
+    hardBoundaries.push_back(numTriangles);
+
+    // Split those wherever the triangles so far already have an ACMR within the threshold of
+    // the whole cluster's, since ending the cluster there costs little
+    vector<uint64> clusterStarts;
+    for(uint64 h = 0; h + 1 < hardBoundaries.size(); ++h)
+    {
+        const uint64 start = hardBoundaries[h];
+        const uint64 end = hardBoundaries[h + 1];
+
+        timestamp += VertexCacheSimSize + 1;
+        uint64 clusterMisses = 0;
+        for(uint64 t = start; t < end; ++t)
+            clusterMisses += SimulateCacheTriangle(indices + t * 3, cacheTimestamps.data(), timestamp);
+        const double clusterThreshold = threshold * double(clusterMisses) / double(end - start);
+
+        clusterStarts.push_back(start);
+        timestamp += VertexCacheSimSize + 1;
+        uint64 runningMisses = 0;
+        uint64 runningTriangles = 0;
+        for(uint64 t = start; t < end; ++t)
+        {
+            runningMisses += SimulateCacheTriangle(indices + t * 3, cacheTimestamps.data(), timestamp);
+            ++runningTriangles;
+            if(t + 1 < end && double(runningMisses) / double(runningTriangles) <= clusterThreshold)
+            {
+                clusterStarts.push_back(t + 1);
+                timestamp += VertexCacheSimSize + 1;
+                runningMisses = 0;
+                runningTriangles = 0;
+            }
+        }
+    }
+    clusterStarts.push_back(numTriangles);
+
+    // Area weighted centroid and normal of each cluster, and of the whole mesh
+    const uint64 numClusters = clusterStarts.size() - 1;
+    vector<float> clusterCentroids(numClusters * 3, 0.0f);
+    vector<float> clusterNormals(numClusters * 3, 0.0f);
+    double meshCentroid[3] = { 0.0, 0.0, 0.0 };
+    double meshArea = 0.0;
+    for(uint64 c = 0; c < numClusters; ++c)
+    {
+        double centroid[3] = { 0.0, 0.0, 0.0 };
+        double normal[3] = { 0.0, 0.0, 0.0 };
+        double clusterArea = 0.0;
+        for(uint64 t = clusterStarts[c]; t < clusterStarts[c + 1]; ++t)
+        {
+            const float* p0 = GetPosition(positions, positionStride, indices[t * 3 + 0]);
+            const float* p1 = GetPosition(positions, positionStride, indices[t * 3 + 1]);
+            const float* p2 = GetPosition(positions, positionStride, indices[t * 3 + 2]);
+
+            const float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+            const float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+            const float n[3] = { e1[1] * e2[2] - e1[2] * e2[1],
+                                 e1[2] * e2[0] - e1[0] * e2[2],
+                                 e1[0] * e2[1] - e1[1] * e2[0] };
+            const double area = std::sqrt(double(n[0]) * n[0] + double(n[1]) * n[1] + double(n[2]) * n[2]);
+
+            for(uint32 i = 0; i < 3; ++i)
+            {
+                centroid[i] += area * (double(p0[i]) + p1[i] + p2[i]) / 3.0;
+                normal[i] += n[i];
+            }
+            clusterArea += area;
+        }
+
+        for(uint32 i = 0; i < 3; ++i)
+        {
+            meshCentroid[i] += centroid[i];
+            clusterCentroids[c * 3 + i] = clusterArea > 0.0 ? float(centroid[i] / clusterArea) : 0.0f;
+            clusterNormals[c * 3 + i] = float(normal[i]);
+        }
+        meshArea += clusterArea;
+    }
+
+    for(uint32 i = 0; i < 3; ++i)
+        meshCentroid[i] = meshArea > 0.0 ? meshCentroid[i] / meshArea : 0.0;
+
+    // Clusters that face away from the center are the ones most likely to occlude the rest.
+    // Normals point back at the viewer for front faces, so they point out of a closed mesh.
+    vector<float> sortKeys(numClusters, 0.0f);
+    for(uint64 c = 0; c < numClusters; ++c)
+    {
+        const float* n = &clusterNormals[c * 3];
+        const float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if(length == 0.0f)
+            continue;
+
+        float key = 0.0f;
+        for(uint32 i = 0; i < 3; ++i)
+            key += (clusterCentroids[c * 3 + i] - float(meshCentroid[i])) * n[i];
+        sortKeys[c] = key / length;
+    }
+
+    vector<uint64> clusterOrder(numClusters);
+    for(uint64 c = 0; c < numClusters; ++c)
+        clusterOrder[c] = c;
+    std::stable_sort(clusterOrder.begin(), clusterOrder.end(), [&](uint64 a, uint64 b)
+    {
+        return sortKeys[a] > sortKeys[b];
+    });
+
+    vector<uint32> output(numIndices);
+    uint64 outputIdx = 0;
+    for(uint64 i = 0; i < numClusters; ++i)
+    {
+        const uint64 c = clusterOrder[i];
+        const uint64 count = (clusterStarts[c + 1] - clusterStarts[c]) * 3;
+        memcpy(&output[outputIdx], indices + clusterStarts[c] * 3, count * sizeof(uint32));
+        outputIdx += count;
+    }
+
+    memcpy(indices, output.data(), numIndices * sizeof(uint32));
+}
+
+// == Meshlets ====================================================================================
+
+static Float3 LoadPosition(const uint8* positions, uint32 positionStride, uint32 idx)
+{
+    const float* pos = GetPosition(positions, positionStride, idx);
+    return Float3(pos[0], pos[1], pos[2]);
+}
+
+static void ComputeMeshletBounds(const uint32* indices, const uint8* positions, uint32 positionStride,
+                                 Meshlet& meshlet)
+{
+    const uint32* meshletIndices = indices + meshlet.IndexStart;
+    const uint32 numTriangles = meshlet.IndexCount / 3;
+
+    // Sphere around the center of the AABB
+    Float3 boundsMin = Float3(FLT_MAX);
+    Float3 boundsMax = Float3(-FLT_MAX);
+    for(uint32 i = 0; i < meshlet.IndexCount; ++i)
+    {
+        const Float3 pos = LoadPosition(positions, positionStride, meshletIndices[i]);
+        boundsMin = Float3(std::min(boundsMin.x, pos.x), std::min(boundsMin.y, pos.y), std::min(boundsMin.z, pos.z));
+        boundsMax = Float3(std::max(boundsMax.x, pos.x), std::max(boundsMax.y, pos.y), std::max(boundsMax.z, pos.z));
+    }
+
+    meshlet.Center = (boundsMin + boundsMax) * 0.5f;
+    meshlet.Radius = 0.0f;
+    for(uint32 i = 0; i < meshlet.IndexCount; ++i)
+    {
+        const Float3 pos = LoadPosition(positions, positionStride, meshletIndices[i]);
+        meshlet.Radius = std::max(meshlet.Radius, Float3::Length(pos - meshlet.Center));
+    }
+
+    // The cone axis is the average of the triangle normals, and its angle covers all of them
+    Float3 triNormals[MeshletMaxTriangles];
+    Float3 triPositions[MeshletMaxTriangles];
+    uint32 numValid = 0;
+    Float3 axis;
+    for(uint32 t = 0; t < numTriangles; ++t)
+    {
+        const Float3 p0 = LoadPosition(positions, positionStride, meshletIndices[t * 3 + 0]);
+        const Float3 p1 = LoadPosition(positions, positionStride, meshletIndices[t * 3 + 1]);
+        const Float3 p2 = LoadPosition(positions, positionStride, meshletIndices[t * 3 + 2]);
+        const Float3 normal = Float3::Cross(p1 - p0, p2 - p0);
+        const float length = Float3::Length(normal);
+        if(length == 0.0f)
+            continue;
+
+        triNormals[numValid] = normal / length;
+        triPositions[numValid] = p0;
+        axis += triNormals[numValid];
+        ++numValid;
+    }
+
+    meshlet.ConeApex = meshlet.Center;
+    meshlet.ConeAxis = Float3();
+    meshlet.ConeCutoff = 1.0f;
+
+    const float axisLength = Float3::Length(axis);
+    if(numValid == 0 || axisLength == 0.0f)
+        return;
+    axis /= axisLength;
+
+    float minDot = 1.0f;
+    for(uint32 t = 0; t < numValid; ++t)
+        minDot = std::min(minDot, Float3::Dot(axis, triNormals[t]));
+
+    // Past 90 degrees there's no direction that sees only back faces
+    if(minDot <= 0.1f)
+        return;
+
+    // The apex is the point along the axis behind the plane of every triangle, so that a
+    // camera in front of any of them is never on the culled side of the cone
+    float maxT = 0.0f;
+    for(uint32 t = 0; t < numValid; ++t)
+    {
+        const float t0 = Float3::Dot(meshlet.Center - triPositions[t], triNormals[t]) / Float3::Dot(axis, triNormals[t]);
+        maxT = std::max(maxT, t0);
+    }
+
+    meshlet.ConeApex = meshlet.Center - axis * maxT;
+    meshlet.ConeAxis = axis;
+    meshlet.ConeCutoff = std::sqrt(1.0f - minDot * minDot);
+}
+
+void BuildMeshlets(const uint32* indices, uint64 numIndices, const uint8* positions, uint32 positionStride,
+                   uint32 numVertices, vector<Meshlet>& meshlets)
+{
+    Assert_(numIndices % 3 == 0);
+
+    // Marks which vertices the current meshlet already has
+    static const uint32 NotUsed = uint32(-1);
+    vector<uint32> vertexMeshlet(numVertices, NotUsed);
+
+    const uint64 firstMeshlet = meshlets.size();
+    Meshlet meshlet = { };
+    for(uint64 i = 0; i < numIndices; i += 3)
+    {
+        const uint32* tri = indices + i;
+        uint32 meshletIdx = uint32(meshlets.size());
+
+        uint32 newVertices = 0;
+        for(uint32 j = 0; j < 3; ++j)
+        {
+            Assert_(tri[j] < numVertices);
+            const bool repeated = (j > 0 && tri[j] == tri[0]) || (j > 1 && tri[j] == tri[1]);
+            if(vertexMeshlet[tri[j]] != meshletIdx && repeated == false)
+                ++newVertices;
+        }
+
+        // Start a new meshlet if this triangle doesn't fit
+        if(meshlet.VertexCount + newVertices > MeshletMaxVertices || meshlet.IndexCount == MeshletMaxTriangles * 3)
+        {
+            meshlets.push_back(meshlet);
+            meshletIdx = uint32(meshlets.size());
+
+            meshlet = Meshlet();
+            meshlet.IndexStart = uint32(i);
+        }
+
+        for(uint32 j = 0; j < 3; ++j)
+        {
+            if(vertexMeshlet[tri[j]] != meshletIdx)
+            {
+                vertexMeshlet[tri[j]] = meshletIdx;
+                ++meshlet.VertexCount;
+            }
+        }
+        meshlet.IndexCount += 3;
+    }
+
+    if(meshlet.IndexCount > 0)
+        meshlets.push_back(meshlet);
+
+    for(uint64 i = firstMeshlet; i < meshlets.size(); ++i)
+        ComputeMeshletBounds(indices, positions, positionStride, meshlets[i]);
+}
+
+// == Simplification ==============================================================================
+
+// Position, normal and texture coordinate
+static const uint32 SimplifyMaxDimensions = 8;
+
+// Boundary edges get a plane perpendicular to the surface through them, weighted this much
+// more than the surface itself, so that collapses along the boundary don't pull it inwards
+static const float SimplifyBoundaryWeight = 10.0f;
+
+// Only interior vertices can go anywhere. Border vertices can only collapse along the
+// border, onto one of their two neighbors on it.
+enum class SimplifyVertexKind
+{
+    Interior,
+    Border,
+    Locked,
+};
+
+// Generalized quadric: Q(x) = x'Ax + 2b'x + c, over position and attributes. w is the total
+// weight of the planes that were added, so that Q(x) / w is an average squared distance.
+struct SimplifyQuadric
+{
+    float A[SimplifyMaxDimensions][SimplifyMaxDimensions];
+    float b[SimplifyMaxDimensions];
+    float c;
+    float w;
+};
+
+static void AddQuadric(SimplifyQuadric& q, const SimplifyQuadric& other, uint32 dim)
+{
+    for(uint32 i = 0; i < dim; ++i)
+    {
+        for(uint32 j = 0; j < dim; ++j)
+            q.A[i][j] += other.A[i][j];
+        q.b[i] += other.b[i];
+    }
+    q.c += other.c;
+    q.w += other.w;
+}
+
+static float EvaluateQuadric(const SimplifyQuadric& q, const float* x, uint32 dim)
+{
+    double result = q.c;
+    for(uint32 i = 0; i < dim; ++i)
+    {
+        double row = 0.0;
+        for(uint32 j = 0; j < dim; ++j)
+            row += double(q.A[i][j]) * x[j];
+        result += (row + 2.0 * q.b[i]) * x[i];
+    }
+
+    return float(std::max(result, 0.0));
+}
+
+// Squared distance to the plane of the triangle in attribute space: A = I - e1e1' - e2e2',
+// with e1 and e2 an orthonormal basis of the triangle's plane
+static void AddTriangleQuadric(SimplifyQuadric& q, const float* p, const float* p1, const float* p2,
+                               uint32 dim, float weight)
+{
+    double e1[SimplifyMaxDimensions];
+    double e2[SimplifyMaxDimensions];
+    double e1Length = 0.0;
+    for(uint32 i = 0; i < dim; ++i)
+    {
+        e1[i] = double(p1[i]) - p[i];
+        e1Length += e1[i] * e1[i];
+    }
+    if(e1Length == 0.0)
+        return;
+
+    e1Length = std::sqrt(e1Length);
+    double e2DotE1 = 0.0;
+    for(uint32 i = 0; i < dim; ++i)
+    {
+        e1[i] /= e1Length;
+        e2[i] = double(p2[i]) - p[i];
+        e2DotE1 += e2[i] * e1[i];
+    }
+
+    double e2Length = 0.0;
+    for(uint32 i = 0; i < dim; ++i)
+    {
+        e2[i] -= e2DotE1 * e1[i];
+        e2Length += e2[i] * e2[i];
+    }
+    if(e2Length == 0.0)
+        return;
+
+    e2Length = std::sqrt(e2Length);
+    double pDotE1 = 0.0;
+    double pDotE2 = 0.0;
+    double pDotP = 0.0;
+    for(uint32 i = 0; i < dim; ++i)
+    {
+        e2[i] /= e2Length;
+        pDotE1 += p[i] * e1[i];
+        pDotE2 += p[i] * e2[i];
+        pDotP += double(p[i]) * p[i];
+    }
+
+    for(uint32 i = 0; i < dim; ++i)
+    {
+        for(uint32 j = 0; j < dim; ++j)
+            q.A[i][j] += float(weight * ((i == j ? 1.0 : 0.0) - e1[i] * e1[j] - e2[i] * e2[j]));
+        q.b[i] += float(weight * (pDotE1 * e1[i] + pDotE2 * e2[i] - p[i]));
+    }
+    q.c += float(weight * (pDotP - pDotE1 * pDotE1 - pDotE2 * pDotE2));
+    q.w += weight;
+}
+
+// Squared distance to a plane, which only involves the position
+static void AddPlaneQuadric(SimplifyQuadric& q, const Float3& normal, float d, float weight)
+{
+    const float n[3] = { normal.x, normal.y, normal.z };
+    for(uint32 i = 0; i < 3; ++i)
+    {
+        for(uint32 j = 0; j < 3; ++j)
+            q.A[i][j] += weight * n[i] * n[j];
+        q.b[i] += weight * d * n[i];
+    }
+    q.c += weight * d * d;
+    q.w += weight;
+}
+
+struct SimplifyCollapse
+{
+    float Cost;
+    uint32 From;
+    uint32 To;
+    uint32 FromVersion;
+    uint32 ToVersion;
+
+    // Ordered for a min-heap, with ties broken by vertex so that the result is deterministic
+    bool operator<(const SimplifyCollapse& other) const
+    {
+        if(Cost != other.Cost)
+            return Cost > other.Cost;
+        if(From != other.From)
+            return From > other.From;
+        return To > other.To;
+    }
+};
+
+float SimplifyMesh(const uint32* indices, uint64 numIndices, const uint8* vertices, uint32 numVertices,
+                   const SimplifyVertexLayout& layout, uint64 targetIndexCount, float targetError,
+                   vector<uint32>& output)
+{
+    Assert_(numIndices % 3 == 0);
+    static const uint32 None = uint32(-1);
+
+    output.assign(indices, indices + numIndices);
+    const uint64 numTriangles = numIndices / 3;
+    if(numIndices <= targetIndexCount || numTriangles == 0)
+        return 0.0f;
+
+    // Work on the vertices this list uses, renumbered from 0
+    vector<uint32> localVertex(numVertices, None);
+    vector<uint32> globalVertex;
+    vector<uint32> tris(numIndices);
+    for(uint64 i = 0; i < numIndices; ++i)
+    {
+        Assert_(indices[i] < numVertices);
+        uint32& local = localVertex[indices[i]];
+        if(local == None)
+        {
+            local = uint32(globalVertex.size());
+            globalVertex.push_back(indices[i]);
+        }
+        tris[i] = local;
+    }
+    const uint32 numLocal = uint32(globalVertex.size());
+
+    // Positions are scaled to the unit cube, so that the error and the attribute weights
+    // don't depend on the size of the mesh
+    vector<Float3> positions(numLocal);
+    Float3 boundsMin = Float3(FLT_MAX);
+    Float3 boundsMax = Float3(-FLT_MAX);
+    for(uint32 v = 0; v < numLocal; ++v)
+    {
+        const float* pos = reinterpret_cast<const float*>(vertices + uint64(globalVertex[v]) * layout.Stride + layout.PositionOffset);
+        positions[v] = Float3(pos[0], pos[1], pos[2]);
+        boundsMin = Float3(std::min(boundsMin.x, pos[0]), std::min(boundsMin.y, pos[1]), std::min(boundsMin.z, pos[2]));
+        boundsMax = Float3(std::max(boundsMax.x, pos[0]), std::max(boundsMax.y, pos[1]), std::max(boundsMax.z, pos[2]));
+    }
+
+    const Float3 extents = boundsMax - boundsMin;
+    const float extent = std::max(std::max(extents.x, extents.y), extents.z);
+    const float invExtent = extent > 0.0f ? 1.0f / extent : 0.0f;
+
+    const bool hasNormals = layout.NormalOffset != SimplifyNoAttribute;
+    const bool hasTexCoords = layout.TexCoordOffset != SimplifyNoAttribute;
+    const uint32 dim = 3 + (hasNormals ? 3 : 0) + (hasTexCoords ? 2 : 0);
+    vector<float> attributes(uint64(numLocal) * dim);
+    for(uint32 v = 0; v < numLocal; ++v)
+    {
+        const uint8* vtx = vertices + uint64(globalVertex[v]) * layout.Stride;
+        float* attr = &attributes[uint64(v) * dim];
+        positions[v] = (positions[v] - boundsMin) * invExtent;
+        attr[0] = positions[v].x;
+        attr[1] = positions[v].y;
+        attr[2] = positions[v].z;
+
+        uint32 a = 3;
+        if(hasNormals)
+        {
+            const float* normal = reinterpret_cast<const float*>(vtx + layout.NormalOffset);
+            for(uint32 i = 0; i < 3; ++i)
+                attr[a++] = normal[i] * layout.NormalWeight;
+        }
+
+        if(hasTexCoords)
+        {
+            const float* uv = reinterpret_cast<const float*>(vtx + layout.TexCoordOffset);
+            for(uint32 i = 0; i < 2; ++i)
+                attr[a++] = uv[i] * layout.TexCoordWeight;
+        }
+    }
+
+    // Vertices with the same position are welded for the purpose of finding the topology.
+    // Each group is named after its lowest vertex.
+    vector<uint32> group(numLocal);
+    vector<uint32> groupSize(numLocal, 0);
+    {
+        vector<uint32> sorted(numLocal);
+        for(uint32 v = 0; v < numLocal; ++v)
+            sorted[v] = v;
+
+        auto positionLess = [&](uint32 a, uint32 b) -> bool
+        {
+            const Float3& pa = positions[a];
+            const Float3& pb = positions[b];
+            if(pa.x != pb.x)
+                return pa.x < pb.x;
+            if(pa.y != pb.y)
+                return pa.y < pb.y;
+            if(pa.z != pb.z)
+                return pa.z < pb.z;
+            return a < b;
+        };
+        std::sort(sorted.begin(), sorted.end(), positionLess);
+
+        for(uint32 i = 0; i < numLocal; )
+        {
+            uint32 end = i + 1;
+            while(end < numLocal && positions[sorted[end]] == positions[sorted[i]])
+                ++end;
+
+            for(uint32 j = i; j < end; ++j)
+                group[sorted[j]] = sorted[i];
+            groupSize[sorted[i]] = end - i;
+            i = end;
+        }
+    }
+
+    // Find the boundary from how often each directed edge between groups is used. An edge
+    // without its opposite is on the boundary, and one that's used more than once in the same
+    // direction (or more than twice overall) is non-manifold, so its vertices are locked.
+    vector<uint64> directedEdges(numIndices);
+    for(uint64 t = 0; t < numTriangles; ++t)
+    {
+        for(uint32 i = 0; i < 3; ++i)
+        {
+            const uint64 a = group[tris[t * 3 + i]];
+            const uint64 b = group[tris[t * 3 + (i + 1) % 3]];
+            directedEdges[t * 3 + i] = (a << 32) | b;
+        }
+    }
+    std::sort(directedEdges.begin(), directedEdges.end());
+
+    vector<SimplifyVertexKind> kinds(numLocal, SimplifyVertexKind::Interior);
+    vector<vector<uint32>> borderNeighbors(numLocal);
+    for(uint64 i = 0; i < numIndices; ++i)
+    {
+        const uint64 edge = directedEdges[i];
+        const uint32 a = uint32(edge >> 32);
+        const uint32 b = uint32(edge & 0xFFFFFFFF);
+        if(a == b)
+            continue;
+
+        const uint64 reverse = (uint64(b) << 32) | a;
+        const bool duplicate = (i > 0 && directedEdges[i - 1] == edge) || (i + 1 < numIndices && directedEdges[i + 1] == edge);
+        const auto reverseRange = std::equal_range(directedEdges.begin(), directedEdges.end(), reverse);
+        const uint64 reverseCount = reverseRange.second - reverseRange.first;
+        if(duplicate || reverseCount > 1)
+        {
+            kinds[a] = SimplifyVertexKind::Locked;
+            kinds[b] = SimplifyVertexKind::Locked;
+        }
+        else if(reverseCount == 0)
+        {
+            borderNeighbors[a].push_back(b);
+            borderNeighbors[b].push_back(a);
+        }
+    }
+
+    for(uint32 v = 0; v < numLocal; ++v)
+    {
+        if(group[v] != v)
+            continue;
+
+        // Vertices where the attributes are split can't be collapsed without tearing the seam
+        if(groupSize[v] > 1 || (borderNeighbors[v].size() != 0 && borderNeighbors[v].size() != 2))
+            kinds[v] = SimplifyVertexKind::Locked;
+        else if(kinds[v] == SimplifyVertexKind::Interior && borderNeighbors[v].size() == 2)
+            kinds[v] = SimplifyVertexKind::Border;
+    }
+
+    for(uint32 v = 0; v < numLocal; ++v)
+        kinds[v] = kinds[group[v]];
+
+    // Quadrics of the triangles around each vertex, weighted by area, plus the boundary planes.
+    // The attribute quadrics order the collapses, while the position-only quadrics of the same
+    // planes measure how far the surface actually moves, which is what targetError limits.
+    vector<SimplifyQuadric> quadrics(numLocal);
+    memset(quadrics.data(), 0, quadrics.size() * sizeof(SimplifyQuadric));
+    vector<SimplifyQuadric> positionQuadrics(numLocal);
+    memset(positionQuadrics.data(), 0, positionQuadrics.size() * sizeof(SimplifyQuadric));
+    for(uint64 t = 0; t < numTriangles; ++t)
+    {
+        const uint32* tri = &tris[t * 3];
+        const Float3 normal = Float3::Cross(positions[tri[1]] - positions[tri[0]], positions[tri[2]] - positions[tri[0]]);
+        const float area = Float3::Length(normal) * 0.5f;
+
+        SimplifyQuadric q;
+        memset(&q, 0, sizeof(SimplifyQuadric));
+        AddTriangleQuadric(q, &attributes[uint64(tri[0]) * dim], &attributes[uint64(tri[1]) * dim],
+                           &attributes[uint64(tri[2]) * dim], dim, area);
+
+        SimplifyQuadric plane;
+        memset(&plane, 0, sizeof(SimplifyQuadric));
+        if(area > 0.0f)
+        {
+            const Float3 planeNormal = normal / (area * 2.0f);
+            AddPlaneQuadric(plane, planeNormal, -Float3::Dot(planeNormal, positions[tri[0]]), area);
+        }
+
+        for(uint32 i = 0; i < 3; ++i)
+        {
+            const uint32 a = tri[i];
+            const uint32 b = tri[(i + 1) % 3];
+            const uint64 reverse = (uint64(group[b]) << 32) | group[a];
+            if(area == 0.0f || std::binary_search(directedEdges.begin(), directedEdges.end(), reverse))
+                continue;
+
+            const Float3 edge = positions[b] - positions[a];
+            const Float3 planeNormal = Float3::Normalize(Float3::Cross(edge, normal));
+            const float edgeLengthSq = Float3::Dot(edge, edge);
+            if(edgeLengthSq == 0.0f)
+                continue;
+            SimplifyQuadric boundary;
+            memset(&boundary, 0, sizeof(SimplifyQuadric));
+            AddPlaneQuadric(boundary, planeNormal, -Float3::Dot(planeNormal, positions[a]), SimplifyBoundaryWeight * edgeLengthSq);
+            AddQuadric(quadrics[a], boundary, dim);
+            AddQuadric(quadrics[b], boundary, dim);
+
+            SimplifyQuadric boundaryPlane;
+            memset(&boundaryPlane, 0, sizeof(SimplifyQuadric));
+            AddPlaneQuadric(boundaryPlane, planeNormal, -Float3::Dot(planeNormal, positions[a]), edgeLengthSq);
+            AddQuadric(positionQuadrics[a], boundaryPlane, 3);
+            AddQuadric(positionQuadrics[b], boundaryPlane, 3);
+        }
+
+        for(uint32 i = 0; i < 3; ++i)
+        {
+            AddQuadric(quadrics[tri[i]], q, dim);
+            AddQuadric(positionQuadrics[tri[i]], plane, 3);
+        }
+    }
+
+    vector<vector<uint32>> vertexTris(numLocal);
+    for(uint64 t = 0; t < numTriangles; ++t)
+    {
+        for(uint32 i = 0; i < 3; ++i)
+            vertexTris[tris[t * 3 + i]].push_back(uint32(t));
+    }
+
+    vector<uint8> triDead(numTriangles, 0);
+    vector<uint8> vertexDead(numLocal, 0);
+    vector<uint32> versions(numLocal, 0);
+    uint64 liveTriangles = numTriangles;
+
+    auto canCollapse = [&](uint32 from, uint32 to) -> bool
+    {
+        if(group[from] == group[to] || kinds[from] == SimplifyVertexKind::Locked)
+            return false;
+        if(kinds[from] == SimplifyVertexKind::Border)
+        {
+            const vector<uint32>& neighbors = borderNeighbors[group[from]];
+            return neighbors[0] != neighbors[1] && (neighbors[0] == group[to] || neighbors[1] == group[to]);
+        }
+        return true;
+    };
+
+    auto collapseCost = [&](uint32 from, uint32 to) -> float
+    {
+        const float* x = &attributes[uint64(to) * dim];
+        const float weight = quadrics[from].w + quadrics[to].w;
+        const float error = EvaluateQuadric(quadrics[from], x, dim) + EvaluateQuadric(quadrics[to], x, dim);
+        return weight > 0.0f ? error / weight : 0.0f;
+    };
+
+    // Squared distance of the collapsed vertex from the planes it stands for, averaged by area
+    auto collapseDistanceSq = [&](uint32 from, uint32 to) -> float
+    {
+        const float* x = &attributes[uint64(to) * dim];
+        const float weight = positionQuadrics[from].w + positionQuadrics[to].w;
+        const float error = EvaluateQuadric(positionQuadrics[from], x, 3) + EvaluateQuadric(positionQuadrics[to], x, 3);
+        return weight > 0.0f ? error / weight : 0.0f;
+    };
+
+    vector<SimplifyCollapse> heap;
+    auto pushCollapses = [&](uint32 v)
+    {
+        // Drop the dead triangles while going through the list anyway
+        vector<uint32>& vTris = vertexTris[v];
+        uint64 numLive = 0;
+        for(uint64 i = 0; i < vTris.size(); ++i)
+        {
+            if(triDead[vTris[i]])
+                continue;
+            vTris[numLive++] = vTris[i];
+
+            const uint32* tri = &tris[uint64(vTris[i]) * 3];
+            for(uint32 j = 0; j < 3; ++j)
+            {
+                const uint32 w = tri[j];
+                if(w == v)
+                    continue;
+
+                if(canCollapse(v, w))
+                {
+                    const SimplifyCollapse collapse = { collapseCost(v, w), v, w, versions[v], versions[w] };
+                    heap.push_back(collapse);
+                    std::push_heap(heap.begin(), heap.end());
+                }
+
+                if(canCollapse(w, v))
+                {
+                    const SimplifyCollapse collapse = { collapseCost(w, v), w, v, versions[w], versions[v] };
+                    heap.push_back(collapse);
+                    std::push_heap(heap.begin(), heap.end());
+                }
+            }
+        }
+        vTris.resize(numLive);
+    };
+
+    for(uint32 v = 0; v < numLocal; ++v)
+        pushCollapses(v);
+
+    // Groups of the vertices sharing a live triangle with v
+    auto neighborGroups = [&](uint32 v, vector<uint32>& neighbors)
+    {
+        neighbors.clear();
+        const vector<uint32>& vTris = vertexTris[v];
+        for(uint64 i = 0; i < vTris.size(); ++i)
+        {
+            if(triDead[vTris[i]])
+                continue;
+            for(uint32 j = 0; j < 3; ++j)
+            {
+                const uint32 w = tris[uint64(vTris[i]) * 3 + j];
+                if(w != v)
+                    neighbors.push_back(group[w]);
+            }
+        }
+        std::sort(neighbors.begin(), neighbors.end());
+        neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+    };
+
+    const float maxDistanceSq = targetError * targetError * invExtent * invExtent;
+    float maxCollapseDistanceSq = 0.0f;
+    vector<uint32> fromNeighbors;
+    vector<uint32> toNeighbors;
+
+    while(liveTriangles * 3 > targetIndexCount && heap.empty() == false)
+    {
+        std::pop_heap(heap.begin(), heap.end());
+        const SimplifyCollapse collapse = heap.back();
+        heap.pop_back();
+
+        const uint32 from = collapse.From;
+        const uint32 to = collapse.To;
+        if(vertexDead[from] || vertexDead[to] || versions[from] != collapse.FromVersion || versions[to] != collapse.ToVersion)
+            continue;
+
+        // The heap is ordered by the attribute cost, so one collapse moving the surface too far
+        // doesn't mean the ones after it will
+        const float distanceSq = collapseDistanceSq(from, to);
+        if(distanceSq > maxDistanceSq)
+            continue;
+
+        // The vertices have to still share a triangle, and share no neighbors other than the
+        // ones opposite their edge, or the collapse would pinch the surface
+        uint32 sharedTris = 0;
+        const vector<uint32>& fromTris = vertexTris[from];
+        for(uint64 i = 0; i < fromTris.size(); ++i)
+        {
+            const uint32* tri = &tris[uint64(fromTris[i]) * 3];
+            if(triDead[fromTris[i]] == 0 && (group[tri[0]] == group[to] || group[tri[1]] == group[to] || group[tri[2]] == group[to]))
+                ++sharedTris;
+        }
+        if(sharedTris == 0)
+            continue;
+
+        neighborGroups(from, fromNeighbors);
+        neighborGroups(to, toNeighbors);
+        uint32 sharedNeighbors = 0;
+        for(uint64 i = 0, j = 0; i < fromNeighbors.size() && j < toNeighbors.size(); )
+        {
+            if(fromNeighbors[i] < toNeighbors[j])
+                ++i;
+            else if(toNeighbors[j] < fromNeighbors[i])
+                ++j;
+            else
+            {
+                ++sharedNeighbors;
+                ++i;
+                ++j;
+            }
+        }
+        if(sharedNeighbors != sharedTris)
+            continue;
+
+        // Don't let any of the remaining triangles flip over
+        bool flips = false;
+        for(uint64 i = 0; i < fromTris.size() && flips == false; ++i)
+        {
+            if(triDead[fromTris[i]])
+                continue;
+
+            const uint32* tri = &tris[uint64(fromTris[i]) * 3];
+            if(group[tri[0]] == group[to] || group[tri[1]] == group[to] || group[tri[2]] == group[to])
+                continue;
+
+            Float3 p[3];
+            Float3 newP[3];
+            for(uint32 j = 0; j < 3; ++j)
+            {
+                p[j] = positions[tri[j]];
+                newP[j] = tri[j] == from ? positions[to] : p[j];
+            }
+
+            const Float3 oldNormal = Float3::Cross(p[1] - p[0], p[2] - p[0]);
+            const Float3 newNormal = Float3::Cross(newP[1] - newP[0], newP[2] - newP[0]);
+            flips = Float3::Dot(oldNormal, newNormal) <= 0.0f;
+        }
+        if(flips)
+            continue;
+
+        // Move the triangles over, the ones that had both vertices are gone
+        for(uint64 i = 0; i < fromTris.size(); ++i)
+        {
+            const uint32 t = fromTris[i];
+            if(triDead[t])
+                continue;
+
+            uint32* tri = &tris[uint64(t) * 3];
+            if(group[tri[0]] == group[to] || group[tri[1]] == group[to] || group[tri[2]] == group[to])
+            {
+                triDead[t] = 1;
+                --liveTriangles;
+                continue;
+            }
+
+            for(uint32 j = 0; j < 3; ++j)
+            {
+                if(tri[j] == from)
+                    tri[j] = to;
+            }
+            vertexTris[to].push_back(t);
+        }
+
+        if(kinds[from] == SimplifyVertexKind::Border)
+        {
+            // The border now runs straight from the collapsed vertex's other neighbor to 'to'
+            const uint32 fromGroup = group[from];
+            const uint32 toGroup = group[to];
+            vector<uint32>& neighbors = borderNeighbors[fromGroup];
+            const uint32 otherGroup = neighbors[0] == toGroup ? neighbors[1] : neighbors[0];
+            std::replace(borderNeighbors[toGroup].begin(), borderNeighbors[toGroup].end(), fromGroup, otherGroup);
+            std::replace(borderNeighbors[otherGroup].begin(), borderNeighbors[otherGroup].end(), fromGroup, toGroup);
+        }
+
+        AddQuadric(quadrics[to], quadrics[from], dim);
+        AddQuadric(positionQuadrics[to], positionQuadrics[from], 3);
+        vertexDead[from] = 1;
+        vertexTris[from].clear();
+        ++versions[to];
+        maxCollapseDistanceSq = std::max(maxCollapseDistanceSq, distanceSq);
+
+        pushCollapses(to);
+    }
+
+    output.clear();
+    for(uint64 t = 0; t < numTriangles; ++t)
+    {
+        if(triDead[t])
+            continue;
+        for(uint32 i = 0; i < 3; ++i)
+            output.push_back(globalVertex[tris[t * 3 + i]]);
+    }
+
+    return std::sqrt(maxCollapseDistanceSq) * extent;
+}
+
+// == Vertex fetch optimization ===================================================================
+
+uint32 OptimizeVertexFetch(uint32* indices, uint64 numIndices, uint32 numVertices, vector<uint32>& remap)
+{
+    static const uint32 Unused = uint32(-1);
+
+    remap.clear();
+    remap.resize(numVertices, Unused);
+
+    uint32 nextVertex = 0;
+    for(uint64 i = 0; i < numIndices; ++i)
+    {
+        uint32& idx = indices[i];
+        Assert_(idx < numVertices);
+
+        if(remap[idx] == Unused)
+            remap[idx] = nextVertex++;
+        idx = remap[idx];
+    }
+
+    const uint32 numReferenced = nextVertex;
+    for(uint32 v = 0; v < numVertices; ++v)
+    {
+        if(remap[v] == Unused)
+            remap[v] = nextVertex++;
+    }
+
+    return numReferenced;
+}
+
+}
@@ -0,0 +1,203 @@
+//-------------------------------------------------------------------------------
+//
+// Gumshoe Framework v1.00
+//   - Based on MJP's DX11 Sample Framework (http://mynameismjp.wordpress.com/)
+//
+//  All code licensed under the MIT license
+//
+//-------------------------------------------------------------------------------
+
+#pragma once
+
+#include "..\\PCH.h"
+#include "..\\GF_Math.h"
+
+namespace GumshoeFramework10
+{
+
+// Mesh processing that's done once when a mesh is imported, and baked into the cooked data.
+// All of these work on 32-bit triangle lists that index into [0, numVertices).
+
+// Size of the FIFO cache that AnalyzeVertexCache() simulates, roughly what the post-transform
+// cache of current hardware behaves like
+static const uint32 VertexCacheSimSize = 16;
+
+// Post-transform cache efficiency of a triangle list. ACMR is the number of vertices that
+// were transformed per triangle (0.5 is the best a regular grid can do, 3 is no reuse at all),
+// ATVR is the number transformed per unique vertex (1 is optimal).
+struct VertexCacheStats
+{
+    uint64 NumTriangles = 0;
+    uint64 NumVertices = 0;
+    uint64 NumTransforms = 0;
+
+    float ACMR() const { return NumTriangles > 0 ? float(double(NumTransforms) / double(NumTriangles)) : 0.0f; }
+    float ATVR() const { return NumVertices > 0 ? float(double(NumTransforms) / double(NumVertices)) : 0.0f; }
+
+    void Add(const VertexCacheStats& other)
+    {
+        NumTriangles += other.NumTriangles;
+        NumVertices += other.NumVertices;
+        NumTransforms += other.NumTransforms;
+    }
+};
+
+// Pixel overdraw of a triangle list, estimated by rasterizing it in order with back face
+// culling and a depth test. Overdraw is the number of pixels shaded per pixel covered, so 1
+// means every pixel was only shaded once.
+struct OverdrawStats
+{
+    uint64 PixelsCovered = 0;
+    uint64 PixelsShaded = 0;
+
+    float Overdraw() const { return PixelsCovered > 0 ? float(double(PixelsShaded) / double(PixelsCovered)) : 0.0f; }
+
+    void Add(const OverdrawStats& other)
+    {
+        PixelsCovered += other.PixelsCovered;
+        PixelsShaded += other.PixelsShaded;
+    }
+};
+
+struct MeshLODSettings
+{
+    // Number of LODs to generate after the full detail mesh. Each one aims for Reduction times
+    // the triangles of the one before it, without going over MaxError (a fraction of the
+    // mesh's size). The chain ends early once a LOD doesn't remove any triangles.
+    uint32 NumLODs = 0;
+    float Reduction = 0.5f;
+    float MaxError = 0.05f;
+    float NormalWeight = 0.5f;
+    float TexCoordWeight = 1.0f;
+};
+
+struct MeshOptimizationSettings
+{
+    // Sorts clusters of triangles so that the ones on the outside of the mesh are drawn
+    // first, after the vertex cache pass. Clusters are made smaller than the cache pass left
+    // them until the ACMR is OverdrawThreshold times worse, so 1.0 keeps the cache order and
+    // higher values give up cache reuse for less overdraw.
+    bool OptimizeOverdraw = false;
+    float OverdrawThreshold = 1.05f;
+
+    MeshLODSettings LODs;
+
+    // Packs the vertices once everything else has been built from them: octahedral normals and
+    // tangents with the bitangent reduced to a sign, and half precision texture coordinates.
+    // QuantizePositions also stores positions as 16-bit UNORM within the bounds of their part,
+    // see MeshPart::PositionScale.
+    bool CompressVertices = false;
+    bool QuantizePositions = false;
+};
+
+struct MeshOptimizationStats
+{
+    VertexCacheStats Before;
+    VertexCacheStats After;
+
+    // Only measured when the overdraw pass runs
+    OverdrawStats OverdrawBefore;
+    OverdrawStats OverdrawAfter;
+
+    uint64 VertexBytesBefore = 0;
+    uint64 VertexBytesAfter = 0;
+
+    void Add(const MeshOptimizationStats& other)
+    {
+        Before.Add(other.Before);
+        After.Add(other.After);
+        OverdrawBefore.Add(other.OverdrawBefore);
+        OverdrawAfter.Add(other.OverdrawAfter);
+        VertexBytesBefore += other.VertexBytesBefore;
+        VertexBytesAfter += other.VertexBytesAfter;
+    }
+};
+
+VertexCacheStats AnalyzeVertexCache(const uint32* indices, uint64 numIndices, uint32 numVertices,
+                                    uint32 cacheSize = VertexCacheSimSize);
+
+// Reorders the triangles for post-transform cache reuse, using Tom Forsyth's "Linear-Speed
+// Vertex Cache Optimisation". Triangle winding is preserved.
+void OptimizeVertexCache(uint32* indices, uint64 numIndices, uint32 numVertices);
+
+// Rasterizes the mesh from each of the 6 axis directions into an OverdrawViewSize^2 grid
+// fitted to its bounds. Positions are 3 floats at the start of every positionStride bytes.
+static const uint32 OverdrawViewSize = 256;
+
+OverdrawStats AnalyzeOverdraw(const uint32* indices, uint64 numIndices, const uint8* positions,
+                              uint32 positionStride, uint32 numVertices);
+
+// Reorders triangles that are already in vertex cache order to reduce overdraw, following
+// "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw" by Sander, Nehab and
+// Barczak. The list is split into clusters wherever the cache order starts over, and further
+// wherever a cluster's ACMR so far is within threshold of the whole cluster's. The clusters
+// are then sorted by how far out of the mesh they face, so that the occluders go first.
+void OptimizeOverdraw(uint32* indices, uint64 numIndices, const uint8* positions, uint32 positionStride,
+                      uint32 numVertices, float threshold);
+
+// Meshlets are small runs of consecutive triangles in a part's index range, with bounds that
+// let them be culled on their own. They're built from the triangles in their final order, so
+// that drawing a meshlet is just a DrawIndexed() call over its range.
+static const uint32 MeshletMaxVertices = 64;
+static const uint32 MeshletMaxTriangles = 124;
+
+struct Meshlet
+{
+    uint32 IndexStart;
+    uint32 IndexCount;
+    uint32 VertexCount;             // Unique vertices referenced
+
+    Float3 Center;                  // Bounding sphere
+    float Radius;
+
+    // The meshlet faces away from the camera if dot(normalize(ConeApex - cameraPos), ConeAxis)
+    // is at least ConeCutoff. Meshlets whose normals are too spread out to ever pass that test
+    // have a zero axis and a cutoff of 1.
+    Float3 ConeApex;
+    Float3 ConeAxis;
+    float ConeCutoff;
+};
+
+// Splits a triangle list into meshlets of at most MeshletMaxVertices vertices and
+// MeshletMaxTriangles triangles, and appends them to meshlets. IndexStart is relative to
+// the start of indices.
+void BuildMeshlets(const uint32* indices, uint64 numIndices, const uint8* positions, uint32 positionStride,
+                   uint32 numVertices, std::vector<Meshlet>& meshlets);
+
+// Where the attributes used by SimplifyMesh() are in each vertex. Positions and normals are
+// float3 and texture coordinates are float2, an offset of SimplifyNoAttribute means the
+// vertex doesn't have that attribute. The weights scale how much a change in the attribute
+// costs compared to moving the surface, which is measured relative to the mesh's size.
+static const uint32 SimplifyNoAttribute = 0xFFFFFFFF;
+
+struct SimplifyVertexLayout
+{
+    uint32 Stride = 0;
+    uint32 PositionOffset = 0;
+    uint32 NormalOffset = SimplifyNoAttribute;
+    uint32 TexCoordOffset = SimplifyNoAttribute;
+    float NormalWeight = 0.5f;
+    float TexCoordWeight = 1.0f;
+};
+
+// Reduces a triangle list towards targetIndexCount indices by collapsing edges in the order
+// given by their quadric error ("Surface Simplification Using Quadric Error Metrics" by
+// Garland and Heckbert, with the attribute quadrics from their follow-up paper). Vertices
+// are collapsed onto one of their neighbors rather than moved, so the result indexes the
+// same vertices. The boundaries of the list are only simplified along themselves, and
+// vertices where attributes are split (UV seams, hard edges) are left alone. The attributes
+// only affect the order of the collapses, while the error is the distance the surface moves,
+// estimated from the quadrics of the position alone. Collapses that would exceed targetError,
+// in the units of the positions, are skipped. The surviving triangles keep their order.
+// Returns the largest error of any collapse that was done.
+float SimplifyMesh(const uint32* indices, uint64 numIndices, const uint8* vertices, uint32 numVertices,
+                   const SimplifyVertexLayout& layout, uint64 targetIndexCount, float targetError,
+                   std::vector<uint32>& output);
+
+// Renumbers the vertices in the order the index buffer first uses them, so that the vertex
+// fetches of consecutive triangles hit the same cache lines. Fills remap with the new index
+// of every old vertex and rewrites the indices to match. Vertices that aren't referenced are
+// moved after the ones that are. Returns the number of referenced vertices.
+uint32 OptimizeVertexFetch(uint32* indices, uint64 numIndices, uint32 numVertices, std::vector<uint32>& remap);
+
+}
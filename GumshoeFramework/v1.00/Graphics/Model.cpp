@@ -17,7 +17,11 @@
 #include "GraphicsTypes.h"
 #include "..\\Serialization.h"
 #include "..\\FileIO.h"
+#include "..\\ThreadPool.h"
+#include "..\\ContentArchive.h"
 #include "Textures.h"
+#include "Camera.h"
+#include "BVH.h"
 
 using std::string;
 using std::wstring;
@@ -115,7 +119,8 @@ void Mesh::InitFromSDKMesh(ID3D11Device* device, SDKMesh& sdkMesh, uint32 meshId
     }
 }
 
-void Mesh::InitFromAssimpMesh(ID3D11Device* device, const aiMesh& assimpMesh)
+void Mesh::InitFromAssimpMesh(ID3D11Device* device, const aiMesh& assimpMesh,
+                              const MeshOptimizationSettings& optimizationSettings, MeshOptimizationStats* optimizationStats)
 {
     numVertices = assimpMesh.mNumVertices;
     numIndices = assimpMesh.mNumFaces * 3;
@@ -228,8 +233,6 @@ void Mesh::InitFromAssimpMesh(ID3D11Device* device, const aiMesh& assimpMesh)
         }
     }
 
-    CreateVertexAndIndexBuffers(device);
-
     const uint32 numSubsets = 1;
     meshParts.resize(numSubsets);
     for(uint32 i = 0; i < numSubsets; ++i)
@@ -241,6 +244,19 @@ void Mesh::InitFromAssimpMesh(ID3D11Device* device, const aiMesh& assimpMesh)
         part.VertexCount = numVertices;
         part.MaterialIdx = assimpMesh.mMaterialIndex;
     }
+
+    MeshOptimizationStats stats;
+    Optimize(optimizationSettings, stats);
+
+    stats.VertexBytesBefore = vertices.size();
+    if(optimizationSettings.CompressVertices)
+        CompressVertices(optimizationSettings.QuantizePositions);
+    stats.VertexBytesAfter = vertices.size();
+
+    if(optimizationStats != nullptr)
+        optimizationStats->Add(stats);
+
+    CreateVertexAndIndexBuffers(device);
 }
 
 // Initializes the mesh as a box
@@ -839,6 +855,81 @@ void Mesh::InitSphere(ID3D11Device* device, const float& diameter, const Float3&
 }
 
 
+// Triangles and vertices are handed out to the thread pool in blocks of this many
+static const uint32 TangentFrameBlockSize = 16 * 1024;
+
+// Gram-Schmidt orthogonalizes the summed tangent against the normal for 4 vertices at a
+// time, with each register holding one component of 4 vertices. The results replace the
+// summed tangents and bitangents. Lanes whose tangent was degenerate get 0 in valid[] and
+// are left for the scalar path, with the unnormalized tangent in place of the result.
+static void OrthogonalizeTangentFrames(const float* nx, const float* ny, const float* nz,
+                                       float* tx, float* ty, float* tz,
+                                       float* bx, float* by, float* bz,
+                                       float* valid, uint32 count)
+{
+    const XMVECTOR zero = XMVectorZero();
+    const XMVECTOR one = XMVectorReplicate(1.0f);
+    const XMVECTOR negOne = XMVectorReplicate(-1.0f);
+    const XMVECTOR epsilon = XMVectorReplicate(0.00001f);
+
+    Assert_(count % 4 == 0);
+    for(uint32 i = 0; i < count; i += 4)
+    {
+        const XMVECTOR nX = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(nx + i));
+        const XMVECTOR nY = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(ny + i));
+        const XMVECTOR nZ = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(nz + i));
+        const XMVECTOR tX = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(tx + i));
+        const XMVECTOR tY = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(ty + i));
+        const XMVECTOR tZ = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(tz + i));
+        const XMVECTOR bX = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(bx + i));
+        const XMVECTOR bY = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(by + i));
+        const XMVECTOR bZ = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(bz + i));
+
+        // tangent = normalize(t - n * dot(n, t))
+        const XMVECTOR nDotT = XMVectorAdd(XMVectorAdd(XMVectorMultiply(nX, tX), XMVectorMultiply(nY, tY)),
+                                           XMVectorMultiply(nZ, tZ));
+        const XMVECTOR gX = XMVectorSubtract(tX, XMVectorMultiply(nX, nDotT));
+        const XMVECTOR gY = XMVectorSubtract(tY, XMVectorMultiply(nY, nDotT));
+        const XMVECTOR gZ = XMVectorSubtract(tZ, XMVectorMultiply(nZ, nDotT));
+        const XMVECTOR gLength = XMVectorSqrt(XMVectorAdd(XMVectorAdd(XMVectorMultiply(gX, gX), XMVectorMultiply(gY, gY)),
+                                                          XMVectorMultiply(gZ, gZ)));
+        const XMVECTOR isValid = XMVectorGreater(gLength, epsilon);
+        const XMVECTOR gScale = XMVectorSelect(one, XMVectorDivide(one, gLength), isValid);
+        const XMVECTOR tanX = XMVectorMultiply(gX, gScale);
+        const XMVECTOR tanY = XMVectorMultiply(gY, gScale);
+        const XMVECTOR tanZ = XMVectorMultiply(gZ, gScale);
+
+        // The handedness comes from the summed bitangent
+        const XMVECTOR cX = XMVectorSubtract(XMVectorMultiply(nY, tZ), XMVectorMultiply(nZ, tY));
+        const XMVECTOR cY = XMVectorSubtract(XMVectorMultiply(nZ, tX), XMVectorMultiply(nX, tZ));
+        const XMVECTOR cZ = XMVectorSubtract(XMVectorMultiply(nX, tY), XMVectorMultiply(nY, tX));
+        const XMVECTOR cDotB = XMVectorAdd(XMVectorAdd(XMVectorMultiply(cX, bX), XMVectorMultiply(cY, bY)),
+                                           XMVectorMultiply(cZ, bZ));
+        const XMVECTOR sign = XMVectorSelect(one, negOne, XMVectorLess(cDotB, zero));
+
+        // bitangent = normalize(cross(n, tangent)) * sign
+        const XMVECTOR btX = XMVectorSubtract(XMVectorMultiply(nY, tanZ), XMVectorMultiply(nZ, tanY));
+        const XMVECTOR btY = XMVectorSubtract(XMVectorMultiply(nZ, tanX), XMVectorMultiply(nX, tanZ));
+        const XMVECTOR btZ = XMVectorSubtract(XMVectorMultiply(nX, tanY), XMVectorMultiply(nY, tanX));
+        const XMVECTOR btLength = XMVectorSqrt(XMVectorAdd(XMVectorAdd(XMVectorMultiply(btX, btX), XMVectorMultiply(btY, btY)),
+                                                           XMVectorMultiply(btZ, btZ)));
+        const XMVECTOR btScale = XMVectorSelect(zero, XMVectorDivide(sign, btLength), XMVectorGreater(btLength, zero));
+
+        XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(tx + i), tanX);
+        XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(ty + i), tanY);
+        XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(tz + i), tanZ);
+        XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(bx + i), XMVectorMultiply(btX, btScale));
+        XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(by + i), XMVectorMultiply(btY, btScale));
+        XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(bz + i), XMVectorMultiply(btZ, btScale));
+        XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(valid + i), XMVectorSelect(zero, one, isValid));
+    }
+}
+
+// Computes the tangent frame for each vertex. This is based on "Computing Tangent Space Basis
+// Vectors for an Arbitrary Mesh", by Eric Lengyel (http://www.terathon.com/code/tangent.html).
+// The per-triangle directions are computed in parallel, and then each vertex gathers the
+// directions of its triangles in triangle order. The sums come out the same no matter how
+// the work is split up, so the results don't depend on the number of threads.
 void Mesh::GenerateTangentFrame()
 {
     // Make sure that we have a position + texture coordinate + normal
@@ -860,107 +951,844 @@ void Mesh::GenerateTangentFrame()
     if(posOffset == 0xFFFFFFFF || nmlOffset == 0xFFFFFFFF || tcOffset == 0xFFFFFFFF)
         throw Exception(L"Can't generate a tangent frame, mesh doesn't have positions, normals, and texcoords");
 
-    // Clone the mesh
-    std::vector<Vertex> newVertices(numVertices);
-
     const uint8* vtxData = vertices.data();
+    const uint8* idxData = indices.data();
+    const uint32 indexSize = indexType == IndexType::Index16Bit ? 2 : 4;
+    const uint32 numTriangles = numIndices / 3;
+    const uint32 srcStride = vertexStride;
+
+    ThreadPool& threadPool = ThreadPool::GlobalPool;
+
+    // Tangent and bitangent directions for each triangle
+    std::vector<Float3> triTangents(numTriangles);
+    std::vector<Float3> triBitangents(numTriangles);
+
+    const uint32 numTriangleBlocks = (numTriangles + TangentFrameBlockSize - 1) / TangentFrameBlockSize;
+    threadPool.ParallelFor(numTriangleBlocks, [&](uint32 blockIdx)
+    {
+        const uint32 triStart = blockIdx * TangentFrameBlockSize;
+        const uint32 triEnd = std::min(triStart + TangentFrameBlockSize, numTriangles);
+        for(uint32 tri = triStart; tri < triEnd; ++tri)
+        {
+            const uint32 i1 = GetIndex(idxData, tri * 3 + 0, indexSize);
+            const uint32 i2 = GetIndex(idxData, tri * 3 + 1, indexSize);
+            const uint32 i3 = GetIndex(idxData, tri * 3 + 2, indexSize);
+
+            const Float3& v1 = *reinterpret_cast<const Float3*>(vtxData + i1 * srcStride + posOffset);
+            const Float3& v2 = *reinterpret_cast<const Float3*>(vtxData + i2 * srcStride + posOffset);
+            const Float3& v3 = *reinterpret_cast<const Float3*>(vtxData + i3 * srcStride + posOffset);
+
+            const Float2& w1 = *reinterpret_cast<const Float2*>(vtxData + i1 * srcStride + tcOffset);
+            const Float2& w2 = *reinterpret_cast<const Float2*>(vtxData + i2 * srcStride + tcOffset);
+            const Float2& w3 = *reinterpret_cast<const Float2*>(vtxData + i3 * srcStride + tcOffset);
+
+            float x1 = v2.x - v1.x;
+            float x2 = v3.x - v1.x;
+            float y1 = v2.y - v1.y;
+            float y2 = v3.y - v1.y;
+            float z1 = v2.z - v1.z;
+            float z2 = v3.z - v1.z;
+
+            float s1 = w2.x - w1.x;
+            float s2 = w3.x - w1.x;
+            float t1 = w2.y - w1.y;
+            float t2 = w3.y - w1.y;
+
+            float r = 1.0f / (s1 * t2 - s2 * t1);
+            triTangents[tri] = Float3((t2 * x1 - t1 * x2) * r, (t2 * y1 - t1 * y2) * r, (t2 * z1 - t1 * z2) * r);
+            triBitangents[tri] = Float3((s1 * x2 - s2 * x1) * r, (s1 * y2 - s2 * y1) * r, (s1 * z2 - s2 * z1) * r);
+        }
+    });
+
+    // List the triangles using each vertex, in triangle order
+    std::vector<uint32> vertexTriStart(numVertices + 1, 0);
+    for(uint32 i = 0; i < numTriangles * 3; ++i)
+    {
+        const uint32 idx = GetIndex(idxData, i, indexSize);
+        Assert_(idx < numVertices);
+        ++vertexTriStart[idx + 1];
+    }
+
     for(uint32 i = 0; i < numVertices; ++i)
+        vertexTriStart[i + 1] += vertexTriStart[i];
+
+    std::vector<uint32> vertexTris(numTriangles * 3);
     {
-        newVertices[i].Position = *reinterpret_cast<const Float3*>(vtxData + posOffset);
-        newVertices[i].Normal = *reinterpret_cast<const Float3*>(vtxData + nmlOffset);
-        newVertices[i].TexCoord = *reinterpret_cast<const Float2*>(vtxData + tcOffset);
-        vtxData += vertexStride;
+        std::vector<uint32> nextSlot(vertexTriStart.begin(), vertexTriStart.end() - 1);
+        for(uint32 i = 0; i < numTriangles * 3; ++i)
+            vertexTris[nextSlot[GetIndex(idxData, i, indexSize)]++] = i / 3;
     }
 
-    // Compute the tangent frame for each vertex. The following code is based on
-    // "Computing Tangent Space Basis Vectors for an Arbitrary Mesh", by Eric Lengyel
-    // http://www.terathon.com/code/tangent.html
+    // Sum up the directions for each vertex, orthogonalize, and write out the new vertices
+    std::vector<uint8> newVertices(numVertices * sizeof(Vertex));
 
-    // Make temporary arrays for the tangent and the bitangent
-    std::vector<Float3> tangents(numVertices);
-    std::vector<Float3> bitangents(numVertices);
+    const uint32 numVertexBlocks = (numVertices + TangentFrameBlockSize - 1) / TangentFrameBlockSize;
+    threadPool.ParallelFor(numVertexBlocks, [&](uint32 blockIdx)
+    {
+        const uint32 vtxStart = blockIdx * TangentFrameBlockSize;
+        const uint32 blockSize = std::min(TangentFrameBlockSize, numVertices - vtxStart);
+        const uint32 paddedSize = (blockSize + 3) & ~3;
+
+        std::vector<float> soa(paddedSize * 10, 0.0f);
+        float* nx = &soa[paddedSize * 0];
+        float* ny = &soa[paddedSize * 1];
+        float* nz = &soa[paddedSize * 2];
+        float* tx = &soa[paddedSize * 3];
+        float* ty = &soa[paddedSize * 4];
+        float* tz = &soa[paddedSize * 5];
+        float* bx = &soa[paddedSize * 6];
+        float* by = &soa[paddedSize * 7];
+        float* bz = &soa[paddedSize * 8];
+        float* valid = &soa[paddedSize * 9];
+
+        for(uint32 i = 0; i < blockSize; ++i)
+        {
+            const uint32 v = vtxStart + i;
+
+            Float3 tangent;
+            Float3 bitangent;
+            for(uint32 j = vertexTriStart[v]; j < vertexTriStart[v + 1]; ++j)
+            {
+                tangent += triTangents[vertexTris[j]];
+                bitangent += triBitangents[vertexTris[j]];
+            }
+
+            const Float3& n = *reinterpret_cast<const Float3*>(vtxData + v * srcStride + nmlOffset);
+            nx[i] = n.x;
+            ny[i] = n.y;
+            nz[i] = n.z;
+            tx[i] = tangent.x;
+            ty[i] = tangent.y;
+            tz[i] = tangent.z;
+            bx[i] = bitangent.x;
+            by[i] = bitangent.y;
+            bz[i] = bitangent.z;
+        }
 
-    // Loop through each triangle
-    const uint32 indexSize = indexType == IndexType::Index16Bit ? 2 : 4;
-    for (uint32 i = 0; i < numIndices; i += 3)
+        OrthogonalizeTangentFrames(nx, ny, nz, tx, ty, tz, bx, by, bz, valid, paddedSize);
+
+        for(uint32 i = 0; i < blockSize; ++i)
+        {
+            const uint32 v = vtxStart + i;
+            const uint8* src = vtxData + v * srcStride;
+
+            Vertex vertex;
+            vertex.Position = *reinterpret_cast<const Float3*>(src + posOffset);
+            vertex.Normal = *reinterpret_cast<const Float3*>(src + nmlOffset);
+            vertex.TexCoord = *reinterpret_cast<const Float2*>(src + tcOffset);
+
+            if(valid[i] != 0.0f)
+            {
+                vertex.Tangent = Float3(tx[i], ty[i], tz[i]);
+                vertex.Bitangent = Float3(bx[i], by[i], bz[i]);
+            }
+            else
+            {
+                // The triangles didn't give a usable direction, so pick any tangent
+                // perpendicular to the normal
+                const Float3& n = vertex.Normal;
+                const Float3 tangent = n.Length() > 0.00001f ? Float3::Perpendicular(n) : Float3(tx[i], ty[i], tz[i]);
+                vertex.Tangent = Float3::Normalize(tangent);
+                vertex.Bitangent = Float3::Normalize(Float3::Cross(n, tangent));
+            }
+
+            memcpy(newVertices.data() + v * sizeof(Vertex), &vertex, sizeof(Vertex));
+        }
+    });
+
+    inputElements.clear();
+    inputElements.resize(sizeof(VertexInputs) / sizeof(D3D11_INPUT_ELEMENT_DESC));
+    memcpy(inputElements.data(), VertexInputs, sizeof(VertexInputs));
+
+    vertexStride = sizeof(Vertex);
+    vertices.swap(newVertices);
+}
+
+// Vertices used by more than one part can't all be contiguous, so each part covers the range
+// spanned by the vertices it references
+static void UpdatePartVertexRange(MeshPart& part, const vector<uint32>& indices32)
+{
+    if(part.IndexCount == 0)
+        return;
+
+    uint32 minVertex = 0xFFFFFFFF;
+    uint32 maxVertex = 0;
+    for(uint32 i = part.IndexStart; i < part.IndexStart + part.IndexCount; ++i)
     {
-        uint32 i1 = GetIndex(indices.data(), i + 0, indexSize);
-        uint32 i2 = GetIndex(indices.data(), i + 1, indexSize);
-        uint32 i3 = GetIndex(indices.data(), i + 2, indexSize);
-
-        const Float3& v1 = newVertices[i1].Position;
-        const Float3& v2 = newVertices[i2].Position;
-        const Float3& v3 = newVertices[i3].Position;
-
-        const Float2& w1 = newVertices[i1].TexCoord;
-        const Float2& w2 = newVertices[i2].TexCoord;
-        const Float2& w3 = newVertices[i3].TexCoord;
-
-        float x1 = v2.x - v1.x;
-        float x2 = v3.x - v1.x;
-        float y1 = v2.y - v1.y;
-        float y2 = v3.y - v1.y;
-        float z1 = v2.z - v1.z;
-        float z2 = v3.z - v1.z;
-
-        float s1 = w2.x - w1.x;
-        float s2 = w3.x - w1.x;
-        float t1 = w2.y - w1.y;
-        float t2 = w3.y - w1.y;
-
-        float r = 1.0f / (s1 * t2 - s2 * t1);
-        Float3 sDir((t2 * x1 - t1 * x2) * r, (t2 * y1 - t1 * y2) * r, (t2 * z1 - t1 * z2) * r);
-        Float3 tDir((s1 * x2 - s2 * x1) * r, (s1 * y2 - s2 * y1) * r, (s1 * z2 - s2 * z1) * r);
-
-        tangents[i1] += sDir;
-        tangents[i2] += sDir;
-        tangents[i3] += sDir;
-
-        bitangents[i1] += tDir;
-        bitangents[i2] += tDir;
-        bitangents[i3] += tDir;
+        minVertex = std::min(minVertex, indices32[i]);
+        maxVertex = std::max(maxVertex, indices32[i]);
     }
 
-    for (uint32 i = 0; i < numVertices; ++i)
+    part.VertexStart = minVertex;
+    part.VertexCount = maxVertex - minVertex + 1;
+}
+
+// 16-bit indices can address this many vertices past a part's BaseVertex
+static const uint32 MaxPartVertices16Bit = 0xFFFF;
+
+// Splits parts whose vertices span more than MaxPartVertices16Bit into runs of consecutive
+// triangles that don't, so that every part can use 16-bit indices relative to its own first
+// vertex. After OptimizeVertexFetch() the vertices are numbered in the order the triangles use
+// them, so the runs are close to as long as they can be. Returns false and leaves the parts
+// alone if a single triangle spans too many vertices.
+static bool SplitPartsFor16BitIndices(vector<MeshPart>& meshParts, const vector<uint32>& indices32)
+{
+    vector<MeshPart> newParts;
+    for(uint64 partIdx = 0; partIdx < meshParts.size(); ++partIdx)
     {
-        Float3& n = newVertices[i].Normal;
-        Float3& t = tangents[i];
-
-        // Gram-Schmidt orthogonalize
-        Float3 tangent = (t - n * Float3::Dot(n, t));
-        bool zeroTangent = false;
-        if(tangent.Length() > 0.00001f)
-            Float3::Normalize(tangent);
-        else if(n.Length() > 0.00001f)
+        const MeshPart& part = meshParts[partIdx];
+        if(part.VertexCount <= MaxPartVertices16Bit)
+        {
+            newParts.push_back(part);
+            continue;
+        }
+
+        const uint32 indexEnd = part.IndexStart + part.IndexCount;
+        uint32 runStart = part.IndexStart;
+        while(runStart < indexEnd)
         {
-            tangent = Float3::Perpendicular(n);
-            zeroTangent = true;
+            uint32 minVertex = 0xFFFFFFFF;
+            uint32 maxVertex = 0;
+            uint32 runEnd = runStart;
+            for(; runEnd < indexEnd; runEnd += 3)
+            {
+                uint32 triMin = minVertex;
+                uint32 triMax = maxVertex;
+                for(uint32 i = runEnd; i < runEnd + 3; ++i)
+                {
+                    triMin = std::min(triMin, indices32[i]);
+                    triMax = std::max(triMax, indices32[i]);
+                }
+
+                if(triMax - triMin >= MaxPartVertices16Bit)
+                    break;
+
+                minVertex = triMin;
+                maxVertex = triMax;
+            }
+
+            if(runEnd == runStart)
+                return false;
+
+            MeshPart run = part;
+            run.IndexStart = runStart;
+            run.IndexCount = runEnd - runStart;
+            run.VertexStart = minVertex;
+            run.VertexCount = maxVertex - minVertex + 1;
+            newParts.push_back(run);
+
+            runStart = runEnd;
         }
+    }
+
+    meshParts.swap(newParts);
+    return true;
+}
 
-        float sign = 1.0f;
+// Reorders the triangles of each part for the post-transform cache and optionally for
+// overdraw, then renumbers the vertices in the order the reordered indices first use them.
+// LODs and meshlets are then built from the final order. This works on the CPU copy of the
+// data, so it has to happen before the buffers are created.
+void Mesh::Optimize(const MeshOptimizationSettings& settings, MeshOptimizationStats& stats)
+{
+    Assert_(vertices.size() == uint64(numVertices) * vertexStride);
+    Assert_(indices.size() == uint64(numIndices) * IndexSize());
+
+    const uint32 indexSize = IndexSize();
+    vector<uint32> indices32(numIndices);
+    for(uint32 i = 0; i < numIndices; ++i)
+        indices32[i] = GetIndex(indices.data(), i, indexSize);
+
+    // The overdraw pass and the meshlet bounds need float3 positions
+    uint32 positionOffset = 0xFFFFFFFF;
+    for(uint64 elemIdx = 0; elemIdx < inputElements.size(); ++elemIdx)
+    {
+        const D3D11_INPUT_ELEMENT_DESC& elem = inputElements[elemIdx];
+        if(string(elem.SemanticName) == "POSITION" && elem.Format == DXGI_FORMAT_R32G32B32_FLOAT)
+            positionOffset = elem.AlignedByteOffset;
+    }
 
-        if(!zeroTangent)
+    const bool hasPositions = positionOffset != 0xFFFFFFFF;
+    const bool optimizeOverdraw = settings.OptimizeOverdraw && hasPositions;
+    const uint8* positions = hasPositions ? vertices.data() + positionOffset : nullptr;
+    if(optimizeOverdraw)
+        stats.OverdrawBefore.Add(AnalyzeOverdraw(indices32.data(), numIndices, positions, vertexStride, numVertices));
+
+    for(uint64 partIdx = 0; partIdx < meshParts.size(); ++partIdx)
+    {
+        const MeshPart& part = meshParts[partIdx];
+        uint32* partIndices = indices32.data() + part.IndexStart;
+
+        stats.Before.Add(AnalyzeVertexCache(partIndices, part.IndexCount, numVertices));
+        OptimizeVertexCache(partIndices, part.IndexCount, numVertices);
+        if(optimizeOverdraw)
+            OptimizeOverdraw(partIndices, part.IndexCount, positions, vertexStride, numVertices, settings.OverdrawThreshold);
+        stats.After.Add(AnalyzeVertexCache(partIndices, part.IndexCount, numVertices));
+    }
+
+    if(optimizeOverdraw)
+        stats.OverdrawAfter.Add(AnalyzeOverdraw(indices32.data(), numIndices, positions, vertexStride, numVertices));
+
+    vector<uint32> remap;
+    OptimizeVertexFetch(indices32.data(), numIndices, numVertices, remap);
+
+    vector<uint8> newVertices(vertices.size());
+    for(uint32 v = 0; v < numVertices; ++v)
+        memcpy(&newVertices[uint64(remap[v]) * vertexStride], &vertices[uint64(v) * vertexStride], vertexStride);
+    vertices.swap(newVertices);
+
+    for(uint64 partIdx = 0; partIdx < meshParts.size(); ++partIdx)
+        UpdatePartVertexRange(meshParts[partIdx], indices32);
+
+    // 16-bit indices only have to reach across a part rather than the whole mesh, so a mesh with
+    // too many vertices for them can still use them if its parts are split up small enough. This
+    // has to happen before anything else is built per part.
+    const bool narrowIndices = indexSize == 4 && SplitPartsFor16BitIndices(meshParts, indices32);
+
+    // LODs and meshlets are built last, so that they're in terms of the final vertices
+    meshlets.clear();
+    lods.clear();
+    lodParts.clear();
+    if(hasPositions)
+    {
+        GenerateLODs(settings.LODs, indices32);
+
+        positions = vertices.data() + positionOffset;
+        for(uint64 partIdx = 0; partIdx < meshParts.size(); ++partIdx)
         {
-            Float3 b;
-            b = Float3::Cross(n, t);
-            sign = (Float3::Dot(b, bitangents[i]) < 0.0f) ? -1.0f : 1.0f;
+            MeshPart& part = meshParts[partIdx];
+            part.MeshletStart = uint32(meshlets.size());
+            BuildMeshlets(indices32.data() + part.IndexStart, part.IndexCount, positions, vertexStride, numVertices, meshlets);
+            part.MeshletCount = uint32(meshlets.size()) - part.MeshletStart;
+
+            for(uint32 i = part.MeshletStart; i < part.MeshletStart + part.MeshletCount; ++i)
+                meshlets[i].IndexStart += part.IndexStart;
         }
+    }
 
-        // Store the tangent + bitangent
-        newVertices[i].Tangent = Float3::Normalize(tangent);
+    StoreIndices(indices32, narrowIndices);
+}
 
-        newVertices[i].Bitangent = Float3::Normalize(Float3::Cross(n, tangent));
-        newVertices[i].Bitangent *= sign;
+// Replaces the CPU copy of the indices with indices32. With partRelative every part's indices
+// are stored relative to its first vertex, which becomes its BaseVertex, and they're always
+// 16-bit.
+void Mesh::StoreIndices(vector<uint32>& indices32, bool partRelative)
+{
+    numIndices = uint32(indices32.size());
+
+    if(partRelative)
+    {
+        // LOD parts can share the index range of the LOD before them, so this reads from the
+        // absolute indices rather than rebasing them in place
+        vector<uint32> partIndices(numIndices);
+        auto rebaseParts = [&](vector<MeshPart>& parts)
+        {
+            for(uint64 partIdx = 0; partIdx < parts.size(); ++partIdx)
+            {
+                MeshPart& part = parts[partIdx];
+                part.BaseVertex = part.VertexStart;
+                for(uint32 i = part.IndexStart; i < part.IndexStart + part.IndexCount; ++i)
+                {
+                    Assert_(indices32[i] - part.BaseVertex < MaxPartVertices16Bit);
+                    partIndices[i] = indices32[i] - part.BaseVertex;
+                }
+            }
+        };
+
+        rebaseParts(meshParts);
+        rebaseParts(lodParts);
+        indices32.swap(partIndices);
+
+        indexType = IndexType::Index16Bit;
     }
 
-    inputElements.clear();
-    inputElements.resize(sizeof(VertexInputs) / sizeof(D3D11_INPUT_ELEMENT_DESC));
-    memcpy(inputElements.data(), VertexInputs, sizeof(VertexInputs));
+    const uint32 indexSize = IndexSize();
+    indices.resize(uint64(numIndices) * indexSize);
+    for(uint32 i = 0; i < numIndices; ++i)
+    {
+        if(indexSize == 2)
+            reinterpret_cast<uint16*>(indices.data())[i] = uint16(indices32[i]);
+        else
+            reinterpret_cast<uint32*>(indices.data())[i] = indices32[i];
+    }
+}
 
-    vertexStride = sizeof(Vertex);
-    vertices.clear();
-    vertices.resize(numVertices * vertexStride);
-    memcpy(vertices.data(), newVertices.data(), numVertices * vertexStride);
+// Builds a chain of simplified versions of every part, each one simplified from the one
+// before it. Parts are independent, so they're simplified in parallel. The new index
+// ranges are appended to indices32.
+void Mesh::GenerateLODs(const MeshLODSettings& settings, vector<uint32>& indices32)
+{
+    if(settings.NumLODs == 0)
+        return;
+
+    SimplifyVertexLayout layout;
+    layout.Stride = vertexStride;
+    layout.PositionOffset = SimplifyNoAttribute;
+    layout.NormalWeight = settings.NormalWeight;
+    layout.TexCoordWeight = settings.TexCoordWeight;
+    for(uint64 elemIdx = 0; elemIdx < inputElements.size(); ++elemIdx)
+    {
+        const D3D11_INPUT_ELEMENT_DESC& elem = inputElements[elemIdx];
+        const string semantic = elem.SemanticName;
+        if(semantic == "POSITION" && elem.Format == DXGI_FORMAT_R32G32B32_FLOAT)
+            layout.PositionOffset = elem.AlignedByteOffset;
+        else if(semantic == "NORMAL" && elem.Format == DXGI_FORMAT_R32G32B32_FLOAT)
+            layout.NormalOffset = elem.AlignedByteOffset;
+        else if(semantic == "TEXCOORD" && elem.SemanticIndex == 0 && elem.Format == DXGI_FORMAT_R32G32_FLOAT)
+            layout.TexCoordOffset = elem.AlignedByteOffset;
+    }
+    Assert_(layout.PositionOffset != SimplifyNoAttribute);
+
+    // The error limit is relative to the size of the whole mesh, so that parts of the same
+    // mesh are held to the same standard
+    Float3 boundsMin = Float3(FLT_MAX);
+    Float3 boundsMax = Float3(-FLT_MAX);
+    for(uint32 v = 0; v < numVertices; ++v)
+    {
+        const Float3& pos = *reinterpret_cast<const Float3*>(&vertices[uint64(v) * vertexStride + layout.PositionOffset]);
+        boundsMin = Float3(std::min(boundsMin.x, pos.x), std::min(boundsMin.y, pos.y), std::min(boundsMin.z, pos.z));
+        boundsMax = Float3(std::max(boundsMax.x, pos.x), std::max(boundsMax.y, pos.y), std::max(boundsMax.z, pos.z));
+    }
+    const Float3 extents = boundsMax - boundsMin;
+    const float maxError = settings.MaxError * std::max(std::max(extents.x, extents.y), extents.z);
+
+    struct PartLODs
+    {
+        vector<vector<uint32>> Indices;
+        vector<float> Errors;
+    };
+
+    const uint32 numParts = uint32(meshParts.size());
+    vector<PartLODs> partLODs(numParts);
+    ThreadPool::GlobalPool.ParallelFor(numParts, [&](uint32 partIdx)
+    {
+        const MeshPart& part = meshParts[partIdx];
+        PartLODs& chain = partLODs[partIdx];
+
+        vector<uint32> current(indices32.begin() + part.IndexStart, indices32.begin() + part.IndexStart + part.IndexCount);
+        float error = 0.0f;
+        for(uint32 lod = 0; lod < settings.NumLODs; ++lod)
+        {
+            const uint64 targetIndexCount = uint64(double(current.size() / 3) * settings.Reduction) * 3;
+
+            // Each LOD is simplified from the last, so their errors add up
+            vector<uint32> simplified;
+            error += SimplifyMesh(current.data(), current.size(), vertices.data(), numVertices, layout,
+                                  targetIndexCount, maxError - error, simplified);
+            if(simplified.size() == current.size())
+                break;
+
+            OptimizeVertexCache(simplified.data(), simplified.size(), numVertices);
+            chain.Indices.push_back(simplified);
+            chain.Errors.push_back(error);
+            current.swap(simplified);
+        }
+    });
+
+    uint32 numLODs = 0;
+    for(uint32 partIdx = 0; partIdx < numParts; ++partIdx)
+        numLODs = std::max(numLODs, uint32(partLODs[partIdx].Indices.size()));
+
+    // Parts whose chain ended early keep using their last LOD
+    lods.resize(numLODs);
+    lodParts.resize(uint64(numLODs) * numParts);
+    for(uint32 lod = 0; lod < numLODs; ++lod)
+    {
+        MeshLOD& meshLOD = lods[lod];
+        meshLOD.Error = 0.0f;
+        meshLOD.NumTriangles = 0;
+
+        for(uint32 partIdx = 0; partIdx < numParts; ++partIdx)
+        {
+            const PartLODs& chain = partLODs[partIdx];
+            MeshPart& lodPart = lodParts[uint64(lod) * numParts + partIdx];
+            if(lod < chain.Indices.size())
+            {
+                const vector<uint32>& lodIndices = chain.Indices[lod];
+                lodPart = meshParts[partIdx];
+                lodPart.IndexStart = uint32(indices32.size());
+                lodPart.IndexCount = uint32(lodIndices.size());
+                lodPart.MeshletStart = 0;
+                lodPart.MeshletCount = 0;
+                indices32.insert(indices32.end(), lodIndices.begin(), lodIndices.end());
+                UpdatePartVertexRange(lodPart, indices32);
+            }
+            else
+                lodPart = LODPart(lod, partIdx);
+
+            const uint32 lastLOD = std::min(lod + 1, uint32(chain.Errors.size()));
+            if(lastLOD > 0)
+                meshLOD.Error = std::max(meshLOD.Error, chain.Errors[lastLOD - 1]);
+            meshLOD.NumTriangles += lodPart.IndexCount / 3;
+        }
+    }
+}
+
+const MeshPart& Mesh::LODPart(uint32 lod, uint32 partIdx) const
+{
+    Assert_(lod < NumLODs());
+    Assert_(partIdx < meshParts.size());
+    return lod == 0 ? meshParts[partIdx] : lodParts[uint64(lod - 1) * meshParts.size() + partIdx];
+}
+
+uint32 Mesh::SelectLOD(float maxError) const
+{
+    uint32 lod = 0;
+    while(lod + 1 < NumLODs() && LODError(lod + 1) <= maxError)
+        ++lod;
+    return lod;
+}
+
+bool Mesh::HasSameVertexLayout(const Mesh& other) const
+{
+    if(vertexStride != other.vertexStride || inputElements.size() != other.inputElements.size())
+        return false;
+
+    for(uint64 i = 0; i < inputElements.size(); ++i)
+    {
+        const D3D11_INPUT_ELEMENT_DESC& a = inputElements[i];
+        const D3D11_INPUT_ELEMENT_DESC& b = other.inputElements[i];
+        if(string(a.SemanticName) != b.SemanticName || a.SemanticIndex != b.SemanticIndex ||
+           a.Format != b.Format || a.AlignedByteOffset != b.AlignedByteOffset)
+            return false;
+    }
+
+    return true;
+}
+
+// The semantic names of copied input elements still point at the strings of the mesh they
+// were copied from, so this gives the mesh its own copy while that one is still around
+void Mesh::OwnInputElementNames()
+{
+    inputElementStrings.resize(inputElements.size());
+    for(uint64 i = 0; i < inputElements.size(); ++i)
+        inputElementStrings[i] = inputElements[i].SemanticName;
+    for(uint64 i = 0; i < inputElements.size(); ++i)
+        inputElements[i].SemanticName = inputElementStrings[i].c_str();
+}
+
+void Mesh::InitFromBatch(ID3D11Device* device, const vector<Mesh>& sourceMeshes, const vector<uint32>& meshIndices,
+                         vector<BatchedPartSource>& sources)
+{
+    Assert_(meshIndices.size() > 0);
+
+    const Mesh& firstMesh = sourceMeshes[meshIndices[0]];
+    inputElements = firstMesh.inputElements;
+    OwnInputElementNames();
+    vertexStride = firstMesh.vertexStride;
+
+    // Gather the parts by material, keeping the order of the meshes within each material
+    vector<BatchedPartSource> batchParts;
+    for(uint64 i = 0; i < meshIndices.size(); ++i)
+    {
+        const Mesh& mesh = sourceMeshes[meshIndices[i]];
+        Assert_(mesh.HasSameVertexLayout(firstMesh));
+        for(uint32 partIdx = 0; partIdx < uint32(mesh.meshParts.size()); ++partIdx)
+        {
+            BatchedPartSource source;
+            source.MeshIdx = meshIndices[i];
+            source.PartIdx = partIdx;
+            source.IndexStart = 0;
+            source.IndexCount = 0;
+            batchParts.push_back(source);
+        }
+    }
+
+    std::stable_sort(batchParts.begin(), batchParts.end(), [&](const BatchedPartSource& a, const BatchedPartSource& b)
+    {
+        return sourceMeshes[a.MeshIdx].meshParts[a.PartIdx].MaterialIdx < sourceMeshes[b.MeshIdx].meshParts[b.PartIdx].MaterialIdx;
+    });
+
+    // Copy each part's vertices in the order its triangles use them, so that the batch keeps
+    // the vertex fetch order of the source meshes
+    const uint32 NoVertex = 0xFFFFFFFF;
+    vector<uint8> batchVertices;
+    vector<uint32> indices32;
+    vector<uint32> remap;
+    vector<uint32> remapSources;
+    meshParts.clear();
+    for(uint64 i = 0; i < batchParts.size(); ++i)
+    {
+        BatchedPartSource& source = batchParts[i];
+        const Mesh& mesh = sourceMeshes[source.MeshIdx];
+        const MeshPart& sourcePart = mesh.meshParts[source.PartIdx];
+        const uint8* sourceVertices = mesh.Vertices();
+        const uint8* sourceIndices = mesh.Indices();
+        const uint32 sourceIndexSize = mesh.IndexSize();
+
+        const bool newPart = meshParts.empty() || meshParts.back().MaterialIdx != sourcePart.MaterialIdx;
+        if(newPart)
+        {
+            MeshPart part;
+            part.IndexStart = uint32(indices32.size());
+            part.MaterialIdx = sourcePart.MaterialIdx;
+            meshParts.push_back(part);
+        }
+
+        // Parts of the same mesh that end up in the same batched part share their vertices,
+        // otherwise only the vertices that were used since the last reset need resetting
+        if(i == 0 || batchParts[i - 1].MeshIdx != source.MeshIdx)
+        {
+            remap.assign(mesh.numVertices, NoVertex);
+            remapSources.clear();
+        }
+        else if(newPart)
+        {
+            for(uint64 v = 0; v < remapSources.size(); ++v)
+                remap[remapSources[v]] = NoVertex;
+            remapSources.clear();
+        }
+
+        source.IndexStart = uint32(indices32.size());
+        source.IndexCount = sourcePart.IndexCount;
+        for(uint32 idx = sourcePart.IndexStart; idx < sourcePart.IndexStart + sourcePart.IndexCount; ++idx)
+        {
+            const uint32 vertex = GetIndex(sourceIndices, idx, sourceIndexSize) + sourcePart.BaseVertex;
+            if(remap[vertex] == NoVertex)
+            {
+                remap[vertex] = uint32(batchVertices.size() / vertexStride);
+                remapSources.push_back(vertex);
+                batchVertices.insert(batchVertices.end(), sourceVertices + uint64(vertex) * vertexStride,
+                                     sourceVertices + uint64(vertex + 1) * vertexStride);
+            }
+
+            indices32.push_back(remap[vertex]);
+        }
+
+        meshParts.back().IndexCount += sourcePart.IndexCount;
+        sources.push_back(source);
+    }
+
+    vertices.swap(batchVertices);
+    numVertices = uint32(vertices.size() / vertexStride);
+    meshlets.clear();
+    lods.clear();
+    lodParts.clear();
+
+    for(uint64 partIdx = 0; partIdx < meshParts.size(); ++partIdx)
+        UpdatePartVertexRange(meshParts[partIdx], indices32);
+
+    indexType = numVertices > 0xFFFF ? IndexType::Index32Bit : IndexType::Index16Bit;
+    const bool narrowIndices = numVertices > 0xFFFF && SplitPartsFor16BitIndices(meshParts, indices32);
+    StoreIndices(indices32, narrowIndices);
+
+    CreateVertexAndIndexBuffers(device);
+}
+
+// Maps a direction onto the octahedron |x| + |y| + |z| = 1, then folds the lower half over
+// the upper one so that it fits in 2 components in [-1, 1]
+static Float2 EncodeOctahedral(const Float3& dir)
+{
+    const float sum = std::abs(dir.x) + std::abs(dir.y) + std::abs(dir.z);
+    if(sum == 0.0f)
+        return Float2(1.0f, 0.0f);
+
+    Float2 oct = Float2(dir.x / sum, dir.y / sum);
+    if(dir.z < 0.0f)
+        oct = Float2((1.0f - std::abs(oct.y)) * (oct.x >= 0.0f ? 1.0f : -1.0f),
+                     (1.0f - std::abs(oct.x)) * (oct.y >= 0.0f ? 1.0f : -1.0f));
+    return oct;
+}
+
+// Rewrites the vertices in a smaller layout, see MeshOptimizationSettings::CompressVertices.
+// Elements that there's no compressed format for are copied as-is. Everything that reads the
+// vertices on the CPU has to be done before this.
+void Mesh::CompressVertices(bool quantizePositions)
+{
+    const uint32 NoElement = 0xFFFFFFFF;
+    uint32 posElem = NoElement;
+    uint32 nmlElem = NoElement;
+    uint32 tangentElem = NoElement;
+    uint32 bitangentElem = NoElement;
+    for(uint32 i = 0; i < uint32(inputElements.size()); ++i)
+    {
+        const std::string semantic = inputElements[i].SemanticName;
+        if(inputElements[i].Format != DXGI_FORMAT_R32G32B32_FLOAT)
+            continue;
+        if(semantic == "POSITION")
+            posElem = i;
+        else if(semantic == "NORMAL")
+            nmlElem = i;
+        else if(semantic == "TANGENT")
+            tangentElem = i;
+        else if(semantic == "BITANGENT")
+            bitangentElem = i;
+    }
+
+    // The tangent is stored as its own octahedral direction. The normal is only needed because
+    // the bitangent is kept as a sign and rebuilt as cross(normal, tangent) * sign, like
+    // DecodeTangentFrame does.
+    if(nmlElem == NoElement)
+        tangentElem = NoElement;
+    if(tangentElem == NoElement)
+        bitangentElem = NoElement;
+    if(posElem == NoElement)
+        quantizePositions = false;
+
+    // Lay out the new elements in the same order as the old ones
+    const uint32 numElements = uint32(inputElements.size());
+    vector<D3D11_INPUT_ELEMENT_DESC> newElements;
+    vector<uint32> srcSizes(numElements);
+    vector<uint32> dstOffsets(numElements, NoElement);
+    vector<DXGI_FORMAT> dstFormats(numElements, DXGI_FORMAT_UNKNOWN);
+    uint32 newStride = 0;
+    for(uint32 i = 0; i < numElements; ++i)
+    {
+        const D3D11_INPUT_ELEMENT_DESC& elem = inputElements[i];
+        srcSizes[i] = (i == numElements - 1 ? vertexStride : inputElements[i + 1].AlignedByteOffset) - elem.AlignedByteOffset;
+        if(i == bitangentElem)
+            continue;
+
+        D3D11_INPUT_ELEMENT_DESC newElem = elem;
+        uint32 size = srcSizes[i];
+        if(i == posElem && quantizePositions)
+        {
+            newElem.Format = DXGI_FORMAT_R16G16B16A16_UNORM;
+            size = 8;
+        }
+        else if(i == nmlElem)
+        {
+            newElem.Format = DXGI_FORMAT_R16G16_SNORM;
+            size = 4;
+        }
+        else if(i == tangentElem)
+        {
+            newElem.Format = DXGI_FORMAT_R10G10B10A2_UNORM;
+            size = 4;
+        }
+        else if(std::string(elem.SemanticName) == "TEXCOORD" && elem.Format == DXGI_FORMAT_R32G32_FLOAT)
+        {
+            newElem.Format = DXGI_FORMAT_R16G16_FLOAT;
+            size = 4;
+        }
+
+        newElem.AlignedByteOffset = newStride;
+        dstOffsets[i] = newStride;
+        dstFormats[i] = newElem.Format;
+        newElements.push_back(newElem);
+        newStride += size;
+    }
+
+    // Parts can share vertices, so the vertex ranges of parts that overlap are merged and each
+    // merged range is quantized to its own bounds
+    const uint32 numParts = uint32(meshParts.size());
+    vector<Float3> vertexScale(numVertices, Float3(0.0f));
+    vector<Float3> vertexOffset(numVertices, Float3(0.0f));
+    if(quantizePositions)
+    {
+        vector<uint32> partOrder(numParts);
+        for(uint32 i = 0; i < numParts; ++i)
+            partOrder[i] = i;
+        std::sort(partOrder.begin(), partOrder.end(), [&](uint32 a, uint32 b)
+        {
+            return meshParts[a].VertexStart < meshParts[b].VertexStart;
+        });
+
+        const uint32 posOffset = inputElements[posElem].AlignedByteOffset;
+        uint32 groupStart = 0;
+        while(groupStart < numParts)
+        {
+            uint32 groupEnd = groupStart + 1;
+            uint32 vertexStart = meshParts[partOrder[groupStart]].VertexStart;
+            uint32 vertexEnd = vertexStart + meshParts[partOrder[groupStart]].VertexCount;
+            while(groupEnd < numParts && meshParts[partOrder[groupEnd]].VertexStart < vertexEnd)
+            {
+                const MeshPart& part = meshParts[partOrder[groupEnd]];
+                vertexEnd = std::max(vertexEnd, part.VertexStart + part.VertexCount);
+                ++groupEnd;
+            }
+
+            Float3 boundsMin = Float3(FLT_MAX);
+            Float3 boundsMax = Float3(-FLT_MAX);
+            for(uint32 v = vertexStart; v < vertexEnd; ++v)
+            {
+                const Float3& pos = *reinterpret_cast<const Float3*>(&vertices[uint64(v) * vertexStride + posOffset]);
+                boundsMin = Float3(std::min(boundsMin.x, pos.x), std::min(boundsMin.y, pos.y), std::min(boundsMin.z, pos.z));
+                boundsMax = Float3(std::max(boundsMax.x, pos.x), std::max(boundsMax.y, pos.y), std::max(boundsMax.z, pos.z));
+            }
+
+            const Float3 scale = vertexEnd > vertexStart ? boundsMax - boundsMin : Float3(0.0f);
+            const Float3 offset = vertexEnd > vertexStart ? boundsMin : Float3(0.0f);
+            for(uint32 i = groupStart; i < groupEnd; ++i)
+            {
+                meshParts[partOrder[i]].PositionScale = scale;
+                meshParts[partOrder[i]].PositionOffset = offset;
+            }
+
+            for(uint32 v = vertexStart; v < vertexEnd; ++v)
+            {
+                vertexScale[v] = scale;
+                vertexOffset[v] = offset;
+            }
+
+            groupStart = groupEnd;
+        }
+
+        // A LOD part only uses vertices of the part it was simplified from
+        for(uint64 i = 0; i < lodParts.size(); ++i)
+        {
+            lodParts[i].PositionScale = meshParts[i % numParts].PositionScale;
+            lodParts[i].PositionOffset = meshParts[i % numParts].PositionOffset;
+        }
+    }
+
+    vector<uint8> newVertices(uint64(numVertices) * newStride, 0);
+    for(uint32 v = 0; v < numVertices; ++v)
+    {
+        const uint8* src = &vertices[uint64(v) * vertexStride];
+        uint8* dst = &newVertices[uint64(v) * newStride];
+        for(uint32 i = 0; i < numElements; ++i)
+        {
+            if(dstOffsets[i] == NoElement)
+                continue;
+
+            const uint8* srcElem = src + inputElements[i].AlignedByteOffset;
+            uint8* dstElem = dst + dstOffsets[i];
+            if(dstFormats[i] == inputElements[i].Format)
+            {
+                memcpy(dstElem, srcElem, srcSizes[i]);
+            }
+            else if(i == posElem)
+            {
+                // Unused vertices have a scale of 0, and just end up at the bottom of the range
+                const Float3& pos = *reinterpret_cast<const Float3*>(srcElem);
+                const Float3& scale = vertexScale[v];
+                const Float3& offset = vertexOffset[v];
+                const float x = scale.x > 0.0f ? (pos.x - offset.x) / scale.x : 0.0f;
+                const float y = scale.y > 0.0f ? (pos.y - offset.y) / scale.y : 0.0f;
+                const float z = scale.z > 0.0f ? (pos.z - offset.z) / scale.z : 0.0f;
+                XMStoreUShortN4(reinterpret_cast<XMUSHORTN4*>(dstElem), XMVectorSet(x, y, z, 1.0f));
+            }
+            else if(i == nmlElem)
+            {
+                const Float2 oct = EncodeOctahedral(*reinterpret_cast<const Float3*>(srcElem));
+                XMStoreShortN2(reinterpret_cast<XMSHORTN2*>(dstElem), XMVectorSet(oct.x, oct.y, 0.0f, 0.0f));
+            }
+            else if(i == tangentElem)
+            {
+                // The bitangent is rebuilt as cross(normal, tangent) * sign
+                const Float3& normal = *reinterpret_cast<const Float3*>(src + inputElements[nmlElem].AlignedByteOffset);
+                const Float3& tangent = *reinterpret_cast<const Float3*>(srcElem);
+                float sign = 1.0f;
+                if(bitangentElem != NoElement)
+                {
+                    const Float3& bitangent = *reinterpret_cast<const Float3*>(src + inputElements[bitangentElem].AlignedByteOffset);
+                    sign = Float3::Dot(Float3::Cross(normal, tangent), bitangent) >= 0.0f ? 1.0f : 0.0f;
+                }
+
+                const Float2 oct = EncodeOctahedral(tangent);
+                XMStoreUDecN4(reinterpret_cast<XMUDECN4*>(dstElem), XMVectorSet(oct.x * 0.5f + 0.5f, oct.y * 0.5f + 0.5f, 0.0f, sign));
+            }
+            else
+            {
+                *reinterpret_cast<Half2*>(dstElem) = Half2(*reinterpret_cast<const Float2*>(srcElem));
+            }
+        }
+    }
+
+    vertices.swap(newVertices);
+    vertexStride = newStride;
+    inputElements = newElements;
 }
 
 void Mesh::CreateInputElements(const D3DVERTEXELEMENT9* declaration)
@@ -1027,7 +1855,7 @@ void Mesh::CreateVertexAndIndexBuffers(ID3D11Device* device)
     bufferDesc.StructureByteStride = 0;
 
     D3D11_SUBRESOURCE_DATA initData;
-    initData.pSysMem = vertices.data();
+    initData.pSysMem = Vertices();
     initData.SysMemPitch = 0;
     initData.SysMemSlicePitch = 0;
     DXCall(device->CreateBuffer(&bufferDesc, &initData, &vertexBuffer));
@@ -1037,12 +1865,11 @@ void Mesh::CreateVertexAndIndexBuffers(ID3D11Device* device)
     bufferDesc.MiscFlags = 0;
     bufferDesc.StructureByteStride = 0;
 
-    initData.pSysMem = indices.data();
+    initData.pSysMem = Indices();
     DXCall(device->CreateBuffer(&bufferDesc, &initData, &indexBuffer));
 }
 
-// Does a basic draw of all parts
-void Mesh::Render(ID3D11DeviceContext* context)
+void Mesh::SetInputAssemblerState(ID3D11DeviceContext* context)
 {
     // Set the vertices and indices
     ID3D11Buffer* vertexBuffers[1] = { vertexBuffer };
@@ -1051,12 +1878,118 @@ void Mesh::Render(ID3D11DeviceContext* context)
     context->IASetVertexBuffers(0, 1, vertexBuffers, vertexStrides, offsets);
     context->IASetIndexBuffer(indexBuffer, IndexBufferFormat(), 0);
     context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+}
+
+// Does a basic draw of all parts
+void Mesh::Render(ID3D11DeviceContext* context)
+{
+    SetInputAssemblerState(context);
 
     // Draw each MeshPart
     for(size_t i = 0; i < meshParts.size(); ++i)
     {
         MeshPart& meshPart = meshParts[i];
-        context->DrawIndexed(meshPart.IndexCount, meshPart.IndexStart, 0);
+        context->DrawIndexed(meshPart.IndexCount, meshPart.IndexStart, meshPart.BaseVertex);
+    }
+}
+
+void Mesh::Render(ID3D11DeviceContext* context, uint32 lod)
+{
+    SetInputAssemblerState(context);
+
+    for(uint32 partIdx = 0; partIdx < uint32(meshParts.size()); ++partIdx)
+    {
+        const MeshPart& part = LODPart(lod, partIdx);
+        context->DrawIndexed(part.IndexCount, part.IndexStart, part.BaseVertex);
+    }
+}
+
+// Frustum planes in world space, pointing inwards
+static void ExtractFrustumPlanes(const Float4x4& viewProjection, Float4 planes[6])
+{
+    const Float4x4& m = viewProjection;
+    planes[0] = Float4(m._14 + m._11, m._24 + m._21, m._34 + m._31, m._44 + m._41);     // Left
+    planes[1] = Float4(m._14 - m._11, m._24 - m._21, m._34 - m._31, m._44 - m._41);     // Right
+    planes[2] = Float4(m._14 + m._12, m._24 + m._22, m._34 + m._32, m._44 + m._42);     // Bottom
+    planes[3] = Float4(m._14 - m._12, m._24 - m._22, m._34 - m._32, m._44 - m._42);     // Top
+    planes[4] = Float4(m._13, m._23, m._33, m._43);                                     // Near
+    planes[5] = Float4(m._14 - m._13, m._24 - m._23, m._34 - m._33, m._44 - m._43);     // Far
+
+    for(uint32 i = 0; i < 6; ++i)
+    {
+        const float length = Float3::Length(Float3(planes[i].x, planes[i].y, planes[i].z));
+        planes[i] /= Float4(length);
+    }
+}
+
+void Mesh::CullMeshlets(uint32 partIdx, const Camera& camera, const Float4x4& world,
+                        vector<uint32>& visibleMeshlets) const
+{
+    Assert_(partIdx < meshParts.size());
+    const MeshPart& part = meshParts[partIdx];
+
+    Float4 planes[6];
+    ExtractFrustumPlanes(camera.ViewProjectionMatrix(), planes);
+
+    const float scale = std::max(std::max(Float3::Length(world.Right()), Float3::Length(world.Up())),
+                                 Float3::Length(world.Forward()));
+    const Float3 cameraPos = camera.Position();
+
+    for(uint32 meshletIdx = part.MeshletStart; meshletIdx < part.MeshletStart + part.MeshletCount; ++meshletIdx)
+    {
+        const Meshlet& meshlet = meshlets[meshletIdx];
+
+        const Float3 center = Float3::Transform(meshlet.Center, world);
+        const float radius = meshlet.Radius * scale;
+
+        bool visible = true;
+        for(uint32 i = 0; i < 6 && visible; ++i)
+        {
+            const float distance = planes[i].x * center.x + planes[i].y * center.y + planes[i].z * center.z + planes[i].w;
+            visible = distance >= -radius;
+        }
+
+        if(visible && meshlet.ConeCutoff < 1.0f)
+        {
+            const Float3 apex = Float3::Transform(meshlet.ConeApex, world);
+            const Float3 axis = Float3::Normalize(Float3::TransformDirection(meshlet.ConeAxis, world));
+            visible = Float3::Dot(Float3::Normalize(apex - cameraPos), axis) < meshlet.ConeCutoff;
+        }
+
+        if(visible)
+            visibleMeshlets.push_back(meshletIdx);
+    }
+}
+
+void Mesh::Render(ID3D11DeviceContext* context, const Camera& camera, const Float4x4& world)
+{
+    SetInputAssemblerState(context);
+
+    vector<uint32> visibleMeshlets;
+    for(uint32 partIdx = 0; partIdx < uint32(meshParts.size()); ++partIdx)
+    {
+        const MeshPart& part = meshParts[partIdx];
+        if(part.MeshletCount == 0)
+        {
+            context->DrawIndexed(part.IndexCount, part.IndexStart, part.BaseVertex);
+            continue;
+        }
+
+        visibleMeshlets.clear();
+        CullMeshlets(partIdx, camera, world, visibleMeshlets);
+
+        // Meshlets are contiguous in the index buffer, so runs of visible ones are one draw
+        for(uint64 i = 0; i < visibleMeshlets.size(); )
+        {
+            const uint32 indexStart = meshlets[visibleMeshlets[i]].IndexStart;
+            uint32 indexCount = 0;
+            uint64 next = i;
+            while(next < visibleMeshlets.size() && visibleMeshlets[next] == visibleMeshlets[i] + (next - i))
+                indexCount += meshlets[visibleMeshlets[next++]].IndexCount;
+
+            context->DrawIndexed(indexCount, indexStart, part.BaseVertex);
+            i = next;
+        }
     }
 }
 
@@ -1108,23 +2041,96 @@ void Model::CreateFromSDKMeshFile(ID3D11Device* device, LPCWSTR fileName, const
         meshes[meshIdx].InitFromSDKMesh(device, sdkMesh, meshIdx, generateTangentFrame);
 }
 
-void Model::CreateWithAssimp(ID3D11Device* device, const wchar* fileName, bool forceSRGB)
+// == Import cache ================================================================================
+
+static const wstring importCacheDir = L"ModelCache\\";
+
+// Bump this when the way an imported scene is turned into meshes changes, so that models
+// imported by the old code get imported again
+static const uint32 ImportCacheVersion = 3;
+
+static const uint32 AssimpImportFlags = aiProcess_CalcTangentSpace |
+                                        aiProcess_Triangulate |
+                                        aiProcess_JoinIdenticalVertices |
+                                        aiProcess_MakeLeftHanded |
+                                        aiProcess_PreTransformVertices |
+                                        aiProcess_RemoveRedundantMaterials |
+                                        aiProcess_OptimizeMeshes |
+                                        aiProcess_FlipUVs |
+                                        aiProcess_FlipWindingOrder;
+
+struct ImportCacheKey
+{
+    Hash SourceContents;
+    uint32 ImportFlags;
+    uint32 CacheVersion;
+    uint32 OptimizeOverdraw;
+    float OverdrawThreshold;
+    MeshLODSettings LODs;
+    uint32 CompressVertices;
+    uint32 QuantizePositions;
+    uint32 Padding;             // Rounds the fields up to the alignment of Hash, always 0
+};
+
+// One cache file per source file, named after its full path
+static wstring MakeImportCacheName(const wchar* fileName)
+{
+    const wstring fullPath = NormalizeContentPath(fileName);
+    const Hash pathHash = GenerateHash(fullPath.c_str(), int(fullPath.length() * sizeof(wchar)));
+    return importCacheDir + GetFileNameWithoutExtension(fileName) + L"_" + pathHash.ToString() + L".meshdata";
+}
+
+// The cached mesh data is only valid for the exact bytes and settings it was imported with
+static Hash MakeImportCacheKey(const wchar* fileName, const MeshOptimizationSettings& optimizationSettings)
+{
+    // Assimp always reads the loose file when there is one, so hash the same bytes it imports
+    // instead of a mounted archive's copy
+    MappedFile sourceFile(fileName, FileAccessPattern::Sequential, FileExistsOnDisk(fileName));
+    sourceFile.PrefetchAll();
+
+    // Zeroed first so that the padding between the fields doesn't end up in the hash
+    ImportCacheKey key;
+    memset(&key, 0, sizeof(ImportCacheKey));
+    key.SourceContents = ChecksumData(sourceFile.Data(), sourceFile.Size());
+    key.ImportFlags = AssimpImportFlags;
+    key.CacheVersion = ImportCacheVersion;
+    key.OptimizeOverdraw = optimizationSettings.OptimizeOverdraw ? 1 : 0;
+    key.OverdrawThreshold = optimizationSettings.OptimizeOverdraw ? optimizationSettings.OverdrawThreshold : 0.0f;
+    if(optimizationSettings.LODs.NumLODs > 0)
+        key.LODs = optimizationSettings.LODs;
+    key.CompressVertices = optimizationSettings.CompressVertices ? 1 : 0;
+    key.QuantizePositions = optimizationSettings.CompressVertices && optimizationSettings.QuantizePositions ? 1 : 0;
+    return GenerateHash(&key, int(sizeof(ImportCacheKey)));
+}
+
+void Model::CreateWithAssimp(ID3D11Device* device, const wchar* fileName, bool forceSRGB,
+                             const MeshOptimizationSettings& optimizationSettings)
 {
     Assert_(FileExists(fileName));
 
+    const wstring cacheName = MakeImportCacheName(fileName);
+    const Hash cacheKey = MakeImportCacheKey(fileName, optimizationSettings);
+    if(ValidateMeshData(cacheName.c_str(), &cacheKey) == CookedAssetStatus::Valid)
+    {
+        try
+        {
+            CreateFromMeshData(device, cacheName.c_str(), forceSRGB);
+            return;
+        }
+        catch(Exception&)
+        {
+            // A section failed its checksum, so fall back to importing it again
+            meshes.clear();
+            meshMaterials.clear();
+        }
+    }
+
+    std::printf("Importing model %s\n", WStringToAnsi(GetFileName(fileName).c_str()).c_str());
+
     std::string fileNameAnsi = WStringToAnsi(fileName);
 
     Assimp::Importer importer;
-    uint32 flags = aiProcess_CalcTangentSpace |
-                   aiProcess_Triangulate |
-                   aiProcess_JoinIdenticalVertices |
-                   aiProcess_MakeLeftHanded |
-                   aiProcess_PreTransformVertices |
-                   aiProcess_RemoveRedundantMaterials |
-                   aiProcess_OptimizeMeshes |
-                   aiProcess_FlipUVs |
-                   aiProcess_FlipWindingOrder ;
-    const aiScene* scene = importer.ReadFile(fileNameAnsi, flags);
+    const aiScene* scene = importer.ReadFile(fileNameAnsi, AssimpImportFlags);
 
     if(scene == nullptr)
         throw Exception(L"Failed to load scene " + std::wstring(fileName) +
@@ -1162,16 +2168,80 @@ void Model::CreateWithAssimp(ID3D11Device* device, const wchar* fileName, bool f
     // Initialize the meshes
     const uint64 numMeshes = scene->mNumMeshes;
     meshes.resize(numMeshes);
+    MeshOptimizationStats optimizationStats;
     for(uint64 i = 0; i < numMeshes; ++i)
-        meshes[i].InitFromAssimpMesh(device, *scene->mMeshes[i]);
+        meshes[i].InitFromAssimpMesh(device, *scene->mMeshes[i], optimizationSettings, &optimizationStats);
+
+    std::printf("  Vertex cache: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+                optimizationStats.Before.ACMR(), optimizationStats.After.ACMR(),
+                optimizationStats.Before.ATVR(), optimizationStats.After.ATVR());
+    if(optimizationSettings.OptimizeOverdraw)
+        std::printf("  Overdraw: %.3f -> %.3f\n", optimizationStats.OverdrawBefore.Overdraw(),
+                    optimizationStats.OverdrawAfter.Overdraw());
+    for(uint32 lod = 1; lod <= optimizationSettings.LODs.NumLODs; ++lod)
+    {
+        uint64 numTriangles = 0;
+        float error = 0.0f;
+        for(uint64 i = 0; i < numMeshes; ++i)
+        {
+            const Mesh& mesh = meshes[i];
+            const uint32 meshLOD = std::min(lod, mesh.NumLODs() - 1);
+            for(uint32 partIdx = 0; partIdx < uint32(mesh.MeshParts().size()); ++partIdx)
+                numTriangles += mesh.LODPart(meshLOD, partIdx).IndexCount / 3;
+            error = std::max(error, mesh.LODError(meshLOD));
+        }
+        std::printf("  LOD %u: %llu triangles, error %.4f\n", lod, numTriangles, error);
+    }
+    if(optimizationSettings.CompressVertices)
+        std::printf("  Vertex data: %.2f MB -> %.2f MB\n", optimizationStats.VertexBytesBefore / (1024.0 * 1024.0),
+                    optimizationStats.VertexBytesAfter / (1024.0 * 1024.0));
+
+    // The cache is only there to skip the import next time, so failing to write it isn't fatal
+    try
+    {
+        if(DirectoryExists(importCacheDir.c_str()) == false)
+            CreateDirectory(importCacheDir.c_str(), nullptr);
+        SaveMeshData(cacheName.c_str(), cacheKey);
+    }
+    catch(Exception&)
+    {
+    }
 }
 
+// Section holding the serialized model
+static const uint32 MeshDataSection = 0x4853454D;       // "MESH"
+
 void Model::CreateFromMeshData(ID3D11Device* device, const wchar* fileName, bool forceSRGB)
 {
-    FileReadSerializer serializer(fileName);
+    CookedAssetReader reader;
+    const CookedAssetStatus status = reader.Open(fileName, MeshDataAssetType, MeshDataVersion);
+    if(status != CookedAssetStatus::Valid)
+        throw Exception(L"Can't load mesh data from " + std::wstring(fileName) + L": " + CookedAssetStatusString(status));
+
+    MappedReadSerializer serializer = reader.ReadSection(MeshDataSection);
     Serialize(serializer, device, forceSRGB);
 }
 
+void Model::SaveMeshData(const wchar* fileName, const Hash& sourceHash, BVH* bvh)
+{
+    CookedAssetWriter writer(MeshDataAssetType, MeshDataVersion, sourceHash);
+    MemoryWriteSerializer serializer(writer.AddSection(MeshDataSection));
+    Serialize(serializer, nullptr);
+
+    if(bvh != nullptr)
+    {
+        MemoryWriteSerializer bvhSerializer(writer.AddSection(BVH::MeshDataSection));
+        bvh->Serialize(bvhSerializer);
+    }
+
+    writer.Write(fileName);
+}
+
+CookedAssetStatus Model::ValidateMeshData(const wchar* fileName, const Hash* sourceHash)
+{
+    return ValidateCookedAsset(fileName, MeshDataAssetType, MeshDataVersion, sourceHash);
+}
+
 void Model::GenerateBoxScene(ID3D11Device* device, const Float3& dimensions, const Float3& position,
                              const Quaternion& orientation, const wchar* colorMap,
                              const wchar* normalMap)
@@ -1274,4 +2344,107 @@ void Model::LoadMaterialResources(MeshMaterial& material, const wstring& directo
     }
 }
 
+// == Static batching =============================================================================
+
+static bool CanBatchMesh(const Mesh& mesh)
+{
+    if(mesh.NumLODs() > 1)
+        return false;
+
+    const vector<MeshPart>& parts = mesh.MeshParts();
+    for(uint64 partIdx = 0; partIdx < parts.size(); ++partIdx)
+    {
+        if(parts[partIdx].PositionScale != Float3(1.0f) || parts[partIdx].PositionOffset != Float3(0.0f))
+            return false;
+    }
+
+    return true;
+}
+
+void Model::BuildStaticBatches(ID3D11Device* device)
+{
+    // Meshes aren't moved once they're in batchedMeshes, see Mesh::OwnInputElementNames()
+    const uint32 numMeshes = uint32(meshes.size());
+    vector<Mesh> batchedMeshes;
+    batchedMeshes.reserve(numMeshes);
+    batchSources.clear();
+
+    uint64 numDrawsBefore = 0;
+    vector<bool> handled(numMeshes, false);
+    for(uint32 meshIdx = 0; meshIdx < numMeshes; ++meshIdx)
+    {
+        numDrawsBefore += meshes[meshIdx].MeshParts().size();
+        if(handled[meshIdx])
+            continue;
+
+        handled[meshIdx] = true;
+        vector<BatchedPartSource> sources;
+        if(CanBatchMesh(meshes[meshIdx]))
+        {
+            vector<uint32> meshIndices(1, meshIdx);
+            for(uint32 otherIdx = meshIdx + 1; otherIdx < numMeshes; ++otherIdx)
+            {
+                if(handled[otherIdx] == false && CanBatchMesh(meshes[otherIdx]) &&
+                   meshes[otherIdx].HasSameVertexLayout(meshes[meshIdx]))
+                {
+                    meshIndices.push_back(otherIdx);
+                    handled[otherIdx] = true;
+                }
+            }
+
+            batchedMeshes.push_back(Mesh());
+            batchedMeshes.back().InitFromBatch(device, meshes, meshIndices, sources);
+        }
+        else
+        {
+            const vector<MeshPart>& parts = meshes[meshIdx].MeshParts();
+            for(uint32 partIdx = 0; partIdx < uint32(parts.size()); ++partIdx)
+            {
+                BatchedPartSource source;
+                source.MeshIdx = meshIdx;
+                source.PartIdx = partIdx;
+                source.IndexStart = parts[partIdx].IndexStart;
+                source.IndexCount = parts[partIdx].IndexCount;
+                sources.push_back(source);
+            }
+
+            batchedMeshes.push_back(meshes[meshIdx]);
+            batchedMeshes.back().OwnInputElementNames();
+        }
+
+        std::sort(sources.begin(), sources.end(), [](const BatchedPartSource& a, const BatchedPartSource& b)
+        {
+            return a.IndexStart < b.IndexStart;
+        });
+        batchSources.push_back(sources);
+    }
+
+    meshes.swap(batchedMeshes);
+
+    uint64 numDrawsAfter = 0;
+    for(uint64 meshIdx = 0; meshIdx < meshes.size(); ++meshIdx)
+        numDrawsAfter += meshes[meshIdx].MeshParts().size();
+    std::printf("Batched %u meshes into %u, %llu draws -> %llu\n", numMeshes, uint32(meshes.size()),
+                numDrawsBefore, numDrawsAfter);
+}
+
+const BatchedPartSource* Model::FindBatchSource(uint32 meshIdx, uint32 triangleIdx) const
+{
+    if(meshIdx >= batchSources.size())
+        return nullptr;
+
+    // Find the last range that starts at or before the triangle
+    const vector<BatchedPartSource>& sources = batchSources[meshIdx];
+    const uint32 index = triangleIdx * 3;
+    auto it = std::upper_bound(sources.begin(), sources.end(), index, [](uint32 idx, const BatchedPartSource& source)
+    {
+        return idx < source.IndexStart;
+    });
+
+    if(it == sources.begin())
+        return nullptr;
+    --it;
+    return index < it->IndexStart + it->IndexCount ? &(*it) : nullptr;
+}
+
 }
\ No newline at end of file
@@ -14,6 +14,8 @@
 #include "..\\InterfacePointers.h"
 #include "..\\GF_Math.h"
 #include "..\\Serialization.h"
+#include "..\\CookedAsset.h"
+#include "MeshOptimizer.h"
 
 struct aiMesh;
 
@@ -21,6 +23,8 @@ namespace GumshoeFramework10
 {
 
 class SDKMesh;
+class Camera;
+class BVH;
 
 struct MeshMaterial
 {
@@ -55,12 +59,39 @@ struct MeshPart
     uint32 IndexStart;
     uint32 IndexCount;
     uint32 MaterialIdx;
+    uint32 MeshletStart;
+    uint32 MeshletCount;
+    uint32 BaseVertex;              // Added to every index when drawing
 
-    MeshPart() : VertexStart(0), VertexCount(0), IndexStart(0), IndexCount(0), MaterialIdx(0)
+    // Positions are stored as position * PositionScale + PositionOffset, which is only something
+    // other than the identity for meshes that were cooked with quantized positions
+    Float3 PositionScale;
+    Float3 PositionOffset;
+
+    MeshPart() : VertexStart(0), VertexCount(0), IndexStart(0), IndexCount(0), MaterialIdx(0),
+                 MeshletStart(0), MeshletCount(0), BaseVertex(0), PositionScale(1.0f), PositionOffset(0.0f)
     {
     }
 };
 
+// One level of detail after the full detail mesh. The LOD has one MeshPart for each of the
+// mesh's parts, indexing the same vertices.
+struct MeshLOD
+{
+    float Error;                // Estimated distance from the full detail mesh, in object space
+    uint32 NumTriangles;
+};
+
+// A range of a batched mesh's triangles, and the mesh and part they came from before
+// Model::BuildStaticBatches() merged them
+struct BatchedPartSource
+{
+    uint32 MeshIdx;
+    uint32 PartIdx;
+    uint32 IndexStart;
+    uint32 IndexCount;
+};
+
 enum class IndexType
 {
     Index16Bit = 0,
@@ -73,9 +104,17 @@ class Mesh
 
 public:
 
-    // Init from loaded files
+    // Init from loaded files. Assimp meshes are optimized for the vertex cache before their
+    // buffers are created, and the before/after numbers are added to optimizationStats.
     void InitFromSDKMesh(ID3D11Device* device, SDKMesh& sdkmesh, uint32 meshIdx, bool generateTangents);
-    void InitFromAssimpMesh(ID3D11Device* device, const aiMesh& assimpMesh);
+    void InitFromAssimpMesh(ID3D11Device* device, const aiMesh& assimpMesh,
+                            const MeshOptimizationSettings& optimizationSettings = MeshOptimizationSettings(),
+                            MeshOptimizationStats* optimizationStats = nullptr);
+
+    // Merges the given meshes into one with a part for each material they use. The meshes
+    // must share a vertex layout. Appends where each of the merged parts ended up to sources.
+    void InitFromBatch(ID3D11Device* device, const std::vector<Mesh>& sourceMeshes,
+                       const std::vector<uint32>& meshIndices, std::vector<BatchedPartSource>& sources);
 
     // Procedural generation
     void InitBox(ID3D11Device* device, const Float3& dimensions, const Float3& position,
@@ -92,6 +131,18 @@ public:
     // Rendering
     void Render(ID3D11DeviceContext* context);
 
+    // Draws every part at a level of detail
+    void Render(ID3D11DeviceContext* context, uint32 lod);
+
+    // Only draws the meshlets that CullMeshlets() keeps, parts without meshlets are drawn whole
+    void Render(ID3D11DeviceContext* context, const Camera& camera, const Float4x4& world);
+
+    // Appends the indices of the part's meshlets that are inside the camera's frustum and
+    // aren't facing away from it. The world matrix can only rotate, translate and scale
+    // uniformly, since the meshlet cones don't survive a non-uniform scale.
+    void CullMeshlets(uint32 partIdx, const Camera& camera, const Float4x4& world,
+                      std::vector<uint32>& visibleMeshlets) const;
+
     // Accessors
     ID3D11Buffer* VertexBuffer() const { return vertexBuffer; }
     ID3D11Buffer* IndexBuffer() const { return indexBuffer; }
@@ -99,9 +150,23 @@ public:
     std::vector<MeshPart>& MeshParts() { return meshParts; }
     const std::vector<MeshPart>& MeshParts() const { return meshParts; }
 
+    const std::vector<Meshlet>& Meshlets() const { return meshlets; }
+
+    // LOD 0 is the full detail mesh, the rest are only there for imported meshes that had
+    // LODs enabled in their MeshOptimizationSettings
+    uint32 NumLODs() const { return uint32(lods.size()) + 1; }
+    float LODError(uint32 lod) const { Assert_(lod < NumLODs()); return lod == 0 ? 0.0f : lods[lod - 1].Error; }
+    const MeshPart& LODPart(uint32 lod, uint32 partIdx) const;
+
+    // Returns the coarsest LOD whose error is at most maxError, in object space
+    uint32 SelectLOD(float maxError) const;
+
     const D3D11_INPUT_ELEMENT_DESC* InputElements() const { return &inputElements[0]; }
     uint32 NumInputElements() const { return static_cast<uint32>(inputElements.size()); }
 
+    // Same stride and input elements, so the vertices can share a buffer
+    bool HasSameVertexLayout(const Mesh& other) const;
+
     uint32 VertexStride() const { return vertexStride; }
     uint32 NumVertices() const { return numVertices; }
     uint32 NumIndices() const { return numIndices; }
@@ -110,12 +175,16 @@ public:
     DXGI_FORMAT IndexBufferFormat() const { return indexType == IndexType::Index32Bit ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT; }
     uint32 IndexSize() const { return indexType == IndexType::Index32Bit ? 4 : 2; }
 
-    const uint8* Vertices() const { return vertices.data(); }
-    const uint8* Indices() const { return indices.data(); }
+    // Either the mesh's own copy of the data, or a view into the file it was loaded from
+    const uint8* Vertices() const { return vertices.empty() ? mappedVertices.Data() : vertices.data(); }
+    const uint8* Indices() const { return indices.empty() ? mappedIndices.Data() : indices.data(); }
 
     template<typename TSerializer> void Serialize(TSerializer& serializer)
     {
         SerializeRawVector(serializer, meshParts);
+        SerializeRawVector(serializer, meshlets);
+        SerializeRawVector(serializer, lods);
+        SerializeRawVector(serializer, lodParts);
 
         inputElementStrings.resize(inputElements.size());
         for(uint64 i = 0; i < inputElements.size(); ++i)
@@ -133,13 +202,19 @@ public:
         uint32 idxType = uint32(indexType);
         SerializeItem(serializer, idxType);
         indexType = IndexType(idxType);
-        SerializeRawVector(serializer, vertices);
-        SerializeRawVector(serializer, indices);
+        SerializeRawVector(serializer, vertices, mappedVertices);
+        SerializeRawVector(serializer, indices, mappedIndices);
     }
 
 protected:
 
     void GenerateTangentFrame();
+    void Optimize(const MeshOptimizationSettings& settings, MeshOptimizationStats& stats);
+    void GenerateLODs(const MeshLODSettings& settings, std::vector<uint32>& indices32);
+    void CompressVertices(bool quantizePositions);
+    void StoreIndices(std::vector<uint32>& indices32, bool partRelative);
+    void OwnInputElementNames();
+    void SetInputAssemblerState(ID3D11DeviceContext* context);
     void CreateInputElements(const D3DVERTEXELEMENT9* declaration);
     void CreateVertexAndIndexBuffers(ID3D11Device* device);
 
@@ -147,6 +222,9 @@ protected:
     ID3D11BufferPtr indexBuffer;
 
     std::vector<MeshPart> meshParts;
+    std::vector<Meshlet> meshlets;
+    std::vector<MeshLOD> lods;
+    std::vector<MeshPart> lodParts;         // lods.size() x meshParts.size()
     std::vector<D3D11_INPUT_ELEMENT_DESC> inputElements;
     std::vector<std::string> inputElementStrings;
 
@@ -158,6 +236,11 @@ protected:
 
     std::vector<uint8> vertices;
     std::vector<uint8> indices;
+
+    // Immutable vertex and index data aliasing a mapped file, used instead of the vectors
+    // above when the mesh was loaded with a MappedReadSerializer
+    DataView<uint8> mappedVertices;
+    DataView<uint8> mappedIndices;
 };
 
 class Model
@@ -171,10 +254,21 @@ public:
                                 bool overrideNormalMaps = false,
                                 bool forceSRGB = false);
 
-    void CreateWithAssimp(ID3D11Device* device, const wchar* fileName, bool forceSRGB = false);
+    void CreateWithAssimp(ID3D11Device* device, const wchar* fileName, bool forceSRGB = false,
+                          const MeshOptimizationSettings& optimizationSettings = MeshOptimizationSettings());
 
     void CreateFromMeshData(ID3D11Device* device, const wchar* fileName, bool forceSRGB = false);
 
+    // Cooked mesh data is a CookedAsset container holding the output of Serialize().
+    // MeshDataVersion needs to be bumped whenever the serialized layout of a Model, Mesh or
+    // MeshMaterial changes, so that old files are rejected instead of misread.
+    static const uint32 MeshDataAssetType = 0x4C444F4D;     // "MODL"
+    static const uint32 MeshDataVersion = 5;
+
+    // The BVH is optional, and is saved in its own section for BVH::LoadFromMeshData()
+    void SaveMeshData(const wchar* fileName, const Hash& sourceHash = Hash(), BVH* bvh = nullptr);
+    static CookedAssetStatus ValidateMeshData(const wchar* fileName, const Hash* sourceHash = nullptr);
+
     // Procedural generation
     void GenerateBoxScene(ID3D11Device* device,
                           const Float3& dimensions = Float3(1.0f, 1.0f, 1.0f),
@@ -194,6 +288,18 @@ public:
                             const wchar* normalMap = L"");
     void GenerateCorneaScene(ID3D11Device* device);
 
+    // Merges the parts of every mesh that share a material into one part, so that a scene
+    // made of many small meshes is drawn with one draw per material. Meshes are merged when
+    // their vertices have the same layout, and they're already in model space so the merged
+    // vertices need no transform. Meshes with quantized positions or LODs are left as they
+    // are, since those are per part, and batched parts are drawn whole without meshlets. The
+    // mapping back to the original meshes isn't saved with the mesh data.
+    void BuildStaticBatches(ID3D11Device* device);
+
+    // Returns which mesh and part a triangle of a mesh came from before BuildStaticBatches(),
+    // for picking. Meshes that weren't batched map to themselves.
+    const BatchedPartSource* FindBatchSource(uint32 meshIdx, uint32 triangleIdx) const;
+
     // Accessors
     std::vector<MeshMaterial>& Materials() { return meshMaterials; };
     const std::vector<MeshMaterial>& Materials() const { return meshMaterials; };
@@ -226,6 +332,9 @@ protected:
     std::vector<Mesh> meshes;
     std::vector<MeshMaterial> meshMaterials;
     std::wstring fileDirectory;
+
+    // One list per mesh, sorted by IndexStart, only filled in by BuildStaticBatches()
+    std::vector<std::vector<BatchedPartSource>> batchSources;
 };
 
 }
\ No newline at end of file
@@ -33,41 +33,26 @@ HRESULT SDKMesh::CreateFromFile( LPCWSTR szFileName,
 {
     HRESULT hr = S_OK;
 
-    // Open the file
-    m_hFile = CreateFile( szFileName, FILE_READ_DATA, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN,
-                          NULL );
-    if( INVALID_HANDLE_VALUE == m_hFile )
-        return E_FAIL;
-
-    // Get the file size
-    LARGE_INTEGER FileSize;
-    GetFileSizeEx( m_hFile, &FileSize );
-    UINT cBytes = FileSize.LowPart;
-
-    // Allocate memory
-    m_pStaticMeshData = new BYTE[ cBytes ];
-    if( !m_pStaticMeshData )
+    // Map the file instead of reading it into a heap buffer. Only the header and the
+    // non-buffer data are copied out, since they get patched with pointers, while the
+    // vertex and index data are read straight from the mapping.
+    m_MappedFile.Open( szFileName, FileAccessPattern::Sequential );
+    UINT cBytes = UINT( m_MappedFile.Size() );
+    if( cBytes < sizeof( SDKMESH_HEADER ) )
     {
-        CloseHandle( m_hFile );
-        return E_OUTOFMEMORY;
+        m_MappedFile.Close();
+        return E_FAIL;
     }
 
-    // Read in the file
-    DWORD dwBytesRead;
-    if( !ReadFile( m_hFile, m_pStaticMeshData, cBytes, &dwBytesRead, NULL ) )
-        hr = E_FAIL;
+    // All of the buffer data gets copied into meshes right after loading
+    m_MappedFile.PrefetchAll();
 
-    CloseHandle( m_hFile );
-
-    if( SUCCEEDED( hr ) )
-    {
-        hr = CreateFromMemory( m_pStaticMeshData,
-                               cBytes,
-                               bCreateAdjacencyIndices,
-                               false);
-        if( FAILED( hr ) )
-            delete []m_pStaticMeshData;
-    }
+    hr = CreateFromMemory( const_cast<BYTE*>( m_MappedFile.Data() ),
+                           cBytes,
+                           bCreateAdjacencyIndices,
+                           true );
+    if( FAILED( hr ) )
+        m_MappedFile.Close();
 
     return hr;
 }
@@ -221,6 +206,8 @@ void SDKMesh::Destroy()
     SAFE_DELETE_ARRAY( m_ppVertices );
     SAFE_DELETE_ARRAY( m_ppIndices );
 
+    m_MappedFile.Close();
+
     m_pMeshHeader = NULL;
     m_pVertexBufferArray = NULL;
     m_pIndexBufferArray = NULL;
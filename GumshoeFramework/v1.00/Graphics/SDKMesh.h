@@ -14,6 +14,7 @@
 #define _SDKMESH_
 
 #include "..\\GF_Math.h"
+#include "..\\FileIO.h"
 
 namespace GumshoeFramework10
 {
@@ -272,6 +273,7 @@ private:
     HANDLE m_hFile;
     HANDLE m_hFileMappingObject;
     std::vector<BYTE*> m_MappedPointers;
+    MappedFile m_MappedFile;
 
 protected:
     //These are the pointers to the two chunks of data loaded in from the mesh file
@@ -41,8 +41,12 @@ ID3D11ShaderResourceViewPtr LoadTexture(ID3D11Device* device, const wchar* fileP
     }
     else
     {
-        DXCall(DirectX:: CreateWICTextureFromFileEx(device, context, filePath, 0, D3D11_USAGE_DEFAULT,
-                                                    D3D11_BIND_SHADER_RESOURCE, 0, 0, forceSRGB, &resource, &srv));
+        // Decode from a mapping so that the file can also come from a content archive
+        MappedFile file(filePath, FileAccessPattern::Sequential);
+        file.PrefetchAll();
+        DXCall(DirectX::CreateWICTextureFromMemoryEx(device, context, file.Data(), size_t(file.Size()), 0,
+                                                     D3D11_USAGE_DEFAULT, D3D11_BIND_SHADER_RESOURCE, 0, 0,
+                                                     forceSRGB, &resource, &srv));
 
         return srv;
     }
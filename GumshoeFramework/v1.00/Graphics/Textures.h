@@ -49,6 +49,18 @@ template<typename T> struct TextureData
     }
 };
 
+// Dumps texture data to a file and reads it back. The texels are deflated, since these dumps
+// are large and often have big flat areas.
+template<typename T> void SaveTextureData(const wchar* filePath, const TextureData<T>& textureData)
+{
+    SerializeToCompressedFile(filePath, textureData);
+}
+
+template<typename T> void LoadTextureData(const wchar* filePath, TextureData<T>& textureData)
+{
+    SerializeFromCompressedFile(filePath, textureData);
+}
+
 // Decode a texture and copies it to the CPU
 void GetTextureData(ID3D11Device* device, ID3D11ShaderResourceView* textureSRV,
                     TextureData<UByte4N>& textureData);
@@ -23,10 +23,15 @@ struct Hash
 
     std::wstring ToString() const;
 
-    bool operator==(const Hash& other)
+    bool operator==(const Hash& other) const
     {
         return A == other.A && B == other.B;
     }
+
+    bool operator!=(const Hash& other) const
+    {
+        return A != other.A || B != other.B;
+    }
 };
 
 Hash GenerateHash(const void* key, int len, uint32 seed = 0);
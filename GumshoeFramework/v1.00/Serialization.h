@@ -12,66 +12,579 @@
 
 #include "Exceptions.h"
 #include "FileIO.h"
+#include "ThreadPool.h"
+#include "TinyEXR.h"
 
 namespace GumshoeFramework10
 {
 
+// Default size of the staging buffer used by the file serializers
+static const uint64 DefaultSerializerBufferSize = 1024 * 1024;
+
+// Reads through a staging buffer that's refilled one large chunk at a time, so that
+// small items don't each cost a call to ReadFile. Reads that are at least as big as
+// the buffer skip it and go straight to the file.
 class FileReadSerializer
 {
 
 private:
 
     File file;
+    std::vector<uint8> buffer;
+    uint64 bufferPos = 0;
+    uint64 bufferEnd = 0;
+    uint64 fileRemaining = 0;
+
+    void FillBuffer()
+    {
+        Assert_(bufferPos == bufferEnd);
+        const uint64 readSize = std::min<uint64>(buffer.size(), fileRemaining);
+        if(readSize == 0)
+            throw Exception(L"Attempted to read past the end of a serialized file");
+
+        file.Read(readSize, buffer.data());
+        fileRemaining -= readSize;
+        bufferPos = 0;
+        bufferEnd = readSize;
+    }
 
 public:
 
-    explicit FileReadSerializer(const wchar* path)
+    explicit FileReadSerializer(const wchar* path, uint64 bufferSize = DefaultSerializerBufferSize)
     {
+        Assert_(bufferSize > 0);
         file.Open(path, FileOpenMode::Read);
+        fileRemaining = file.Size();
+        buffer.resize(size_t(std::min<uint64>(bufferSize, fileRemaining)));
     }
 
     template<typename T> void SerializeItem(T& data)
     {
-        file.Read(data);
+        SerializeData(sizeof(T), &data);
     }
 
     void SerializeData(uint64 size, void* data)
     {
-        file.Read(size, data);
+        uint8* dst = reinterpret_cast<uint8*>(data);
+
+        // Use up whatever is left in the buffer first
+        const uint64 buffered = std::min<uint64>(size, bufferEnd - bufferPos);
+        memcpy(dst, buffer.data() + bufferPos, size_t(buffered));
+        bufferPos += buffered;
+        dst += buffered;
+        size -= buffered;
+        if(size == 0)
+            return;
+
+        if(size >= buffer.size())
+        {
+            if(size > fileRemaining)
+                throw Exception(L"Attempted to read past the end of a serialized file");
+
+            file.Read(size, dst);
+            fileRemaining -= size;
+            return;
+        }
+
+        FillBuffer();
+        if(size > bufferEnd)
+            throw Exception(L"Attempted to read past the end of a serialized file");
+
+        memcpy(dst, buffer.data(), size_t(size));
+        bufferPos = size;
     }
 
     static bool IsReadSerializer() { return true; }
     static bool IsWriteSerializer() { return false; }
 };
 
+// Collects writes in a staging buffer and hands them to WriteFile in large chunks.
+// Writes that are at least as big as the buffer skip it and go straight to the file.
+// Flush() has to be called to write out anything still buffered. The destructor never writes,
+// so a serializer abandoned by an exception doesn't leave half-finished data in the file.
 class FileWriteSerializer
 {
 
 private:
 
     File file;
+    std::vector<uint8> buffer;
+    uint64 bufferPos = 0;
 
 public:
 
-    explicit FileWriteSerializer(const wchar* path)
+    explicit FileWriteSerializer(const wchar* path, uint64 bufferSize = DefaultSerializerBufferSize)
     {
+        Assert_(bufferSize > 0);
         file.Open(path, FileOpenMode::Write);
+        buffer.resize(size_t(bufferSize));
+    }
+
+    ~FileWriteSerializer()
+    {
+        Assert_(bufferPos == 0 || std::uncaught_exception());
+    }
+
+    template<typename T> void SerializeItem(const T& data)
+    {
+        SerializeData(sizeof(T), &data);
+    }
+
+    void SerializeData(uint64 size, const void* data)
+    {
+        if(bufferPos + size > buffer.size())
+            Flush();
+
+        if(size >= buffer.size())
+        {
+            file.Write(size, data);
+            return;
+        }
+
+        memcpy(buffer.data() + bufferPos, data, size_t(size));
+        bufferPos += size;
+    }
+
+    void Flush()
+    {
+        if(bufferPos == 0)
+            return;
+
+        file.Write(bufferPos, buffer.data());
+        bufferPos = 0;
+    }
+
+    static bool IsReadSerializer() { return false; }
+    static bool IsWriteSerializer() { return true; }
+};
+
+// Read-only view of an array that lives in memory owned by something else, such as a
+// mapped file. The view holds a reference to its owner, so it stays valid when copied.
+template<typename T> class DataView
+{
+
+private:
+
+    const T* data = nullptr;
+    uint64 count = 0;
+    std::shared_ptr<const void> owner;
+
+public:
+
+    DataView()
+    {
+    }
+
+    DataView(const T* data_, uint64 count_, const std::shared_ptr<const void>& owner_) : data(data_),
+                                                                                         count(count_),
+                                                                                         owner(owner_)
+    {
+    }
+
+    void Reset()
+    {
+        data = nullptr;
+        count = 0;
+        owner.reset();
+    }
+
+    const T* Data() const { return data; }
+    uint64 Count() const { return count; }
+    bool Empty() const { return count == 0; }
+
+    const T& operator[](uint64 idx) const
+    {
+        Assert_(idx < count);
+        return data[idx];
+    }
+};
+
+// Reads from a memory-mapped file, or a range of one. Items are copied out of the mapping,
+// but raw vectors serialized with a DataView alias it instead of being copied into a heap
+// allocation. The mapping stays alive for as long as any view into it does.
+class MappedReadSerializer
+{
+
+private:
+
+    std::shared_ptr<MappedFile> file;
+    uint64 pos = 0;
+    uint64 end = 0;
+
+    const uint8* Advance(uint64 size)
+    {
+        if(size > end - pos)
+            throw Exception(L"Attempted to read past the end of a serialized file");
+
+        const uint8* data = file->Data() + pos;
+        pos += size;
+        return data;
+    }
+
+public:
+
+    explicit MappedReadSerializer(const wchar* path)
+        : file(std::make_shared<MappedFile>(path, FileAccessPattern::Sequential))
+    {
+        end = file->Size();
+
+        // Everything is going to be read front to back right away
+        file->PrefetchAll();
+    }
+
+    // Reads [offset, offset + size) of a file that's already mapped
+    MappedReadSerializer(const std::shared_ptr<MappedFile>& file_, uint64 offset, uint64 size)
+        : file(file_), pos(offset), end(offset + size)
+    {
+        Assert_(offset <= file->Size() && size <= file->Size() - offset);
+        file->Prefetch(offset, size);
+    }
+
+    template<typename T> void SerializeItem(T& data)
+    {
+        SerializeData(sizeof(T), &data);
+    }
+
+    void SerializeData(uint64 size, void* data)
+    {
+        memcpy(data, Advance(size), size_t(size));
+    }
+
+    // Returns a pointer to the next size bytes of the file and skips past them
+    const void* MapData(uint64 size)
+    {
+        return Advance(size);
+    }
+
+    const std::shared_ptr<MappedFile>& Mapping() const { return file; }
+
+    static bool IsReadSerializer() { return true; }
+    static bool IsWriteSerializer() { return false; }
+};
+
+// Reads from a block of memory owned by someone else
+class MemoryReadSerializer
+{
+
+private:
+
+    const uint8* data = nullptr;
+    uint64 size = 0;
+    uint64 pos = 0;
+
+public:
+
+    MemoryReadSerializer(const void* data_, uint64 size_) : data(reinterpret_cast<const uint8*>(data_)), size(size_)
+    {
+    }
+
+    template<typename T> void SerializeItem(T& item)
+    {
+        SerializeData(sizeof(T), &item);
+    }
+
+    void SerializeData(uint64 numBytes, void* dst)
+    {
+        if(numBytes > size - pos)
+            throw Exception(L"Attempted to read past the end of serialized data");
+
+        memcpy(dst, data + pos, size_t(numBytes));
+        pos += numBytes;
+    }
+
+    static bool IsReadSerializer() { return true; }
+    static bool IsWriteSerializer() { return false; }
+};
+
+// Appends to a vector of bytes
+class MemoryWriteSerializer
+{
+
+private:
+
+    std::vector<uint8>& output;
+
+public:
+
+    explicit MemoryWriteSerializer(std::vector<uint8>& output_) : output(output_)
+    {
+    }
+
+    template<typename T> void SerializeItem(const T& item)
+    {
+        SerializeData(sizeof(T), &item);
+    }
+
+    void SerializeData(uint64 numBytes, const void* src)
+    {
+        const uint8* bytes = reinterpret_cast<const uint8*>(src);
+        output.insert(output.end(), bytes, bytes + numBytes);
+    }
+
+    static bool IsReadSerializer() { return false; }
+    static bool IsWriteSerializer() { return true; }
+};
+
+// Default amount of uncompressed data in each block of a compressed stream
+static const uint32 DefaultCompressionBlockSize = 256 * 1024;
+
+// Compressed streams are a series of blocks, each starting with its uncompressed and stored
+// sizes. A block whose stored size equals its uncompressed size didn't shrink and is stored
+// as-is. A block with an uncompressed size of 0 ends the stream.
+struct CompressedBlockHeader
+{
+    uint32 RawSize;
+    uint32 StoredSize;
+};
+
+// Deflates everything serialized through it and passes the result on to another write
+// serializer. Data is cut into independent blocks, and a batch of full blocks is compressed
+// in parallel on the thread pool before being written out in order. Finish() has to be called
+// to write out the last blocks and end the stream. The destructor never writes, so a stream
+// abandoned by an exception is left without an end and can't be mistaken for a complete one.
+template<typename TSerializer> class CompressedWriteSerializer
+{
+
+private:
+
+    TSerializer& output;
+    ThreadPool& threadPool;
+    uint32 blockSize = 0;
+    int32 level = 0;
+    std::vector<std::vector<uint8>> rawBlocks;
+    std::vector<std::vector<uint8>> storedBlocks;
+    std::vector<uint32> storedSizes;
+    uint32 numBlocks = 0;
+    uint32 blockPos = 0;
+    bool finished = false;
+
+    void WriteBlocks()
+    {
+        if(blockPos > 0)
+        {
+            rawBlocks[numBlocks].resize(blockPos);
+            ++numBlocks;
+            blockPos = 0;
+        }
+
+        threadPool.ParallelFor(numBlocks, [this](uint32 blockIdx)
+        {
+            const std::vector<uint8>& rawBlock = rawBlocks[blockIdx];
+            std::vector<uint8>& storedBlock = storedBlocks[blockIdx];
+            const unsigned long rawSize = static_cast<unsigned long>(rawBlock.size());
+
+            storedBlock.resize(EXRCompressBound(rawSize));
+            unsigned long storedSize = static_cast<unsigned long>(storedBlock.size());
+            if(EXRCompress(storedBlock.data(), &storedSize, rawBlock.data(), rawSize, level) != 0 || storedSize >= rawSize)
+                storedSize = rawSize;
+            storedSizes[blockIdx] = storedSize;
+        });
+
+        for(uint32 i = 0; i < numBlocks; ++i)
+        {
+            CompressedBlockHeader header;
+            header.RawSize = uint32(rawBlocks[i].size());
+            header.StoredSize = storedSizes[i];
+            output.SerializeItem(header);
+
+            const std::vector<uint8>& block = header.StoredSize == header.RawSize ? rawBlocks[i] : storedBlocks[i];
+            output.SerializeData(header.StoredSize, block.data());
+            rawBlocks[i].resize(blockSize);
+        }
+
+        numBlocks = 0;
+    }
+
+public:
+
+    explicit CompressedWriteSerializer(TSerializer& output_, uint32 blockSize_ = DefaultCompressionBlockSize,
+                                       int32 level_ = 6, ThreadPool& threadPool_ = ThreadPool::GlobalPool)
+        : output(output_), threadPool(threadPool_), blockSize(blockSize_), level(level_)
+    {
+        Assert_(blockSize > 0);
+        Assert_(TSerializer::IsWriteSerializer());
+
+        // Enough blocks in a batch to keep every thread busy
+        const uint32 batchSize = (threadPool.NumWorkers() + 1) * 2;
+        rawBlocks.resize(batchSize);
+        for(uint32 i = 0; i < batchSize; ++i)
+            rawBlocks[i].resize(blockSize);
+        storedBlocks.resize(batchSize);
+        storedSizes.resize(batchSize);
+    }
+
+    ~CompressedWriteSerializer()
+    {
+        Assert_(finished || std::uncaught_exception());
     }
 
     template<typename T> void SerializeItem(const T& data)
     {
-        file.Write(data);
+        SerializeData(sizeof(T), &data);
     }
 
     void SerializeData(uint64 size, const void* data)
     {
-        file.Write(size, data);
+        Assert_(finished == false);
+        const uint8* src = reinterpret_cast<const uint8*>(data);
+        while(size > 0)
+        {
+            const uint32 copySize = uint32(std::min<uint64>(size, blockSize - blockPos));
+            memcpy(rawBlocks[numBlocks].data() + blockPos, src, copySize);
+            blockPos += copySize;
+            src += copySize;
+            size -= copySize;
+
+            if(blockPos == blockSize)
+            {
+                ++numBlocks;
+                blockPos = 0;
+                if(numBlocks == rawBlocks.size())
+                    WriteBlocks();
+            }
+        }
+    }
+
+    // Writes out any buffered data and the end of the stream
+    void Finish()
+    {
+        if(finished)
+            return;
+
+        WriteBlocks();
+
+        CompressedBlockHeader header;
+        header.RawSize = 0;
+        header.StoredSize = 0;
+        output.SerializeItem(header);
+        finished = true;
     }
 
     static bool IsReadSerializer() { return false; }
     static bool IsWriteSerializer() { return true; }
 };
 
+// Reads a stream written by CompressedWriteSerializer from another read serializer. A batch
+// of blocks is read at a time and inflated in parallel on the thread pool. The end of the
+// stream is read along with its last block (or on construction for an empty stream), so once
+// everything in it has been read, anything serialized after it can be read from the inner
+// serializer.
+template<typename TSerializer> class CompressedReadSerializer
+{
+
+private:
+
+    TSerializer& input;
+    ThreadPool& threadPool;
+    uint32 batchSize = 0;
+    std::vector<std::vector<uint8>> storedBlocks;
+    std::vector<std::vector<uint8>> rawBlocks;
+    std::vector<uint32> blockErrors;
+    uint32 numBlocks = 0;
+    uint32 blockIdx = 0;
+    uint32 blockPos = 0;
+    CompressedBlockHeader nextHeader;
+    bool endOfStream = false;
+
+    void ReadHeader()
+    {
+        input.SerializeItem(nextHeader);
+        if(nextHeader.RawSize == 0)
+            endOfStream = true;
+        else if(nextHeader.StoredSize > nextHeader.RawSize)
+            throw Exception(L"Invalid block in compressed stream");
+    }
+
+    void ReadBlocks()
+    {
+        numBlocks = 0;
+        blockIdx = 0;
+        blockPos = 0;
+        while(numBlocks < batchSize && endOfStream == false)
+        {
+            rawBlocks[numBlocks].resize(nextHeader.RawSize);
+            storedBlocks[numBlocks].resize(nextHeader.StoredSize);
+            input.SerializeData(nextHeader.StoredSize, storedBlocks[numBlocks].data());
+            ++numBlocks;
+
+            // The header after a block is read along with it, so the end of the stream is
+            // consumed with the last block no matter where the batch boundaries fall
+            ReadHeader();
+        }
+
+        threadPool.ParallelFor(numBlocks, [this](uint32 idx)
+        {
+            std::vector<uint8>& rawBlock = rawBlocks[idx];
+            const std::vector<uint8>& storedBlock = storedBlocks[idx];
+            blockErrors[idx] = 0;
+            if(storedBlock.size() == rawBlock.size())
+            {
+                memcpy(rawBlock.data(), storedBlock.data(), rawBlock.size());
+                return;
+            }
+
+            unsigned long rawSize = static_cast<unsigned long>(rawBlock.size());
+            if(EXRUncompress(rawBlock.data(), &rawSize, storedBlock.data(),
+                             static_cast<unsigned long>(storedBlock.size())) != 0 || rawSize != rawBlock.size())
+                blockErrors[idx] = 1;
+        });
+
+        for(uint32 i = 0; i < numBlocks; ++i)
+            if(blockErrors[i] != 0)
+                throw Exception(L"Failed to decompress a block of a compressed stream");
+    }
+
+public:
+
+    explicit CompressedReadSerializer(TSerializer& input_, ThreadPool& threadPool_ = ThreadPool::GlobalPool)
+        : input(input_), threadPool(threadPool_)
+    {
+        Assert_(TSerializer::IsReadSerializer());
+
+        batchSize = (threadPool.NumWorkers() + 1) * 2;
+        storedBlocks.resize(batchSize);
+        rawBlocks.resize(batchSize);
+        blockErrors.resize(batchSize);
+        ReadHeader();
+    }
+
+    template<typename T> void SerializeItem(T& data)
+    {
+        SerializeData(sizeof(T), &data);
+    }
+
+    void SerializeData(uint64 size, void* data)
+    {
+        uint8* dst = reinterpret_cast<uint8*>(data);
+        while(size > 0)
+        {
+            if(blockIdx == numBlocks)
+            {
+                if(endOfStream)
+                    throw Exception(L"Attempted to read past the end of a compressed stream");
+                ReadBlocks();
+                continue;
+            }
+
+            const std::vector<uint8>& block = rawBlocks[blockIdx];
+            const uint32 copySize = uint32(std::min<uint64>(size, block.size() - blockPos));
+            memcpy(dst, block.data() + blockPos, copySize);
+            blockPos += copySize;
+            dst += copySize;
+            size -= copySize;
+
+            if(blockPos == block.size())
+            {
+                ++blockIdx;
+                blockPos = 0;
+            }
+        }
+    }
+
+    static bool IsReadSerializer() { return true; }
+    static bool IsWriteSerializer() { return false; }
+};
+
 class ComputeSizeSerializer
 {
 
@@ -226,6 +739,37 @@ void SerializeRawVector(TSerializer& serializer, std::vector<TVector>& vec)
     SerializeRawArray(serializer, vec.data(), numElements);
 }
 
+// Serializes a raw vector whose contents may instead be held by a view. Writing uses the
+// view when the vector is empty. Reading fills in the vector and clears the view, except with a
+// MappedReadSerializer, which points the view into the mapping and leaves the vector empty.
+template<typename TSerializer, typename TVector>
+void SerializeRawVector(TSerializer& serializer, std::vector<TVector>& vec, DataView<TVector>& view)
+{
+    if(TSerializer::IsWriteSerializer() && vec.empty() && view.Data() != nullptr)
+    {
+        uint64 numElements = view.Count();
+        SerializeItem(serializer, numElements);
+        SerializeRawArray(serializer, const_cast<TVector*>(view.Data()), numElements);
+        return;
+    }
+
+    if(TSerializer::IsReadSerializer())
+        view.Reset();
+
+    SerializeRawVector(serializer, vec);
+}
+
+template<typename TVector>
+void SerializeRawVector(MappedReadSerializer& serializer, std::vector<TVector>& vec, DataView<TVector>& view)
+{
+    uint64 numElements = 0;
+    SerializeItem(serializer, numElements);
+    std::vector<TVector>().swap(vec);
+
+    const void* data = serializer.MapData(sizeof(TVector) * numElements);
+    view = DataView<TVector>(reinterpret_cast<const TVector*>(data), numElements, serializer.Mapping());
+}
+
 template<typename TSerializer, typename TString>
 void SerializeItem(TSerializer& serializer, std::basic_string<TString>& str)
 {
@@ -253,6 +797,25 @@ void SerializeToFile(const wchar* filePath, const T& item)
 {
     FileWriteSerializer serializer(filePath);
     SerializeItem(serializer, item);
+    serializer.Flush();
+}
+
+template<typename T>
+void SerializeFromCompressedFile(const wchar* filePath, T& item)
+{
+    FileReadSerializer fileSerializer(filePath);
+    CompressedReadSerializer<FileReadSerializer> serializer(fileSerializer);
+    SerializeItem(serializer, item);
+}
+
+template<typename T>
+void SerializeToCompressedFile(const wchar* filePath, const T& item)
+{
+    FileWriteSerializer fileSerializer(filePath);
+    CompressedWriteSerializer<FileWriteSerializer> serializer(fileSerializer);
+    SerializeItem(serializer, const_cast<T&>(item));
+    serializer.Finish();
+    fileSerializer.Flush();
 }
 
 }
\ No newline at end of file
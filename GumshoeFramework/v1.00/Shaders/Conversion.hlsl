@@ -67,4 +67,31 @@ float2 HalfToFloat2(in uint val)
 	result.y = f16tof32(val >> 16);
 
 	return result;
+}
+
+//=================================================================================================
+// Compressed vertex decoding, see Mesh::CompressVertices()
+//=================================================================================================
+float3 DecodeOctahedral(in float2 oct)
+{
+	float3 dir = float3(oct, 1.0f - abs(oct.x) - abs(oct.y));
+	if(dir.z < 0.0f)
+		dir.xy = (1.0f - abs(dir.yx)) * (dir.xy >= 0.0f ? 1.0f : -1.0f);
+
+	return normalize(dir);
+}
+
+// packedNormal is the R16G16_SNORM NORMAL element, packedTangent the R10G10B10A2_UNORM TANGENT
+void DecodeTangentFrame(in float2 packedNormal, in float4 packedTangent, out float3 normal,
+						out float3 tangent, out float3 bitangent)
+{
+	normal = DecodeOctahedral(packedNormal);
+	tangent = DecodeOctahedral(packedTangent.xy * 2.0f - 1.0f);
+	bitangent = cross(normal, tangent) * (packedTangent.w * 2.0f - 1.0f);
+}
+
+// scale and offset are the MeshPart's PositionScale and PositionOffset
+float3 DequantizePosition(in float3 position, in float3 scale, in float3 offset)
+{
+	return position * scale + offset;
 }
\ No newline at end of file
@@ -0,0 +1,177 @@
+//-------------------------------------------------------------------------------
+// Gumshoe Framework v1.00
+//   - Based on MJP's DX11 Sample Framework (http://mynameismjp.wordpress.com/)
+//
+//  All code licensed under the MIT license
+//
+//-------------------------------------------------------------------------------
+
+#include "PCH.h"
+
+#include "ThreadPool.h"
+
+namespace GumshoeFramework10
+{
+
+ThreadPool ThreadPool::GlobalPool;
+
+// Shared between the caller of ParallelFor and the helper jobs it queues. Helpers can
+// start after the loop has already finished, so this outlives the ParallelFor call.
+// Func is only called for tasks that haven't been counted in TasksDone yet, so helpers that
+// start late never touch it after the caller has returned.
+struct ParallelForState
+{
+    const ThreadPool::TaskFunc* Func;
+    uint32 NumTasks;
+    std::atomic<uint32> NextTask;
+    std::atomic<uint32> TasksDone;
+    std::atomic<bool> Failed;
+    std::exception_ptr FirstException;      // Set under DoneMutex
+    std::mutex DoneMutex;
+    std::condition_variable DoneCV;
+};
+
+static void RunParallelForTasks(ParallelForState& state)
+{
+    uint32 numDone = 0;
+    while(true)
+    {
+        const uint32 taskIdx = state.NextTask++;
+        if(taskIdx >= state.NumTasks)
+            break;
+
+        // Once a task has thrown the rest are just counted off, so that the caller can stop
+        // waiting and rethrow on its own thread
+        if(state.Failed == false)
+        {
+            try
+            {
+                (*state.Func)(taskIdx);
+            }
+            catch(...)
+            {
+                std::lock_guard<std::mutex> lock(state.DoneMutex);
+                if(state.Failed == false)
+                {
+                    state.FirstException = std::current_exception();
+                    state.Failed = true;
+                }
+            }
+        }
+        ++numDone;
+    }
+
+    if(numDone > 0 && (state.TasksDone += numDone) == state.NumTasks)
+    {
+        std::lock_guard<std::mutex> lock(state.DoneMutex);
+        state.DoneCV.notify_all();
+    }
+}
+
+ThreadPool::ThreadPool() : shuttingDown(false)
+{
+}
+
+ThreadPool::~ThreadPool()
+{
+    Shutdown();
+}
+
+void ThreadPool::Initialize(uint32 numWorkers)
+{
+    Assert_(workers.size() == 0);
+
+    if(numWorkers == 0)
+    {
+        const uint32 numHWThreads = std::thread::hardware_concurrency();
+        numWorkers = numHWThreads > 1 ? numHWThreads - 1 : 0;
+    }
+
+    shuttingDown = false;
+    for(uint32 i = 0; i < numWorkers; ++i)
+        workers.push_back(std::thread(&ThreadPool::WorkerLoop, this));
+}
+
+void ThreadPool::Shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        shuttingDown = true;
+    }
+    jobCV.notify_all();
+
+    for(uint64 i = 0; i < workers.size(); ++i)
+        workers[i].join();
+    workers.clear();
+}
+
+void ThreadPool::Enqueue(const Job& job)
+{
+    if(workers.size() == 0)
+    {
+        job();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        jobs.push_back(job);
+    }
+    jobCV.notify_one();
+}
+
+void ThreadPool::ParallelFor(uint32 numTasks, const TaskFunc& func)
+{
+    if(numTasks == 0)
+        return;
+
+    const uint32 numHelpers = std::min(NumWorkers(), numTasks - 1);
+    if(numHelpers == 0)
+    {
+        for(uint32 i = 0; i < numTasks; ++i)
+            func(i);
+        return;
+    }
+
+    std::shared_ptr<ParallelForState> state(new ParallelForState());
+    state->Func = &func;
+    state->NumTasks = numTasks;
+    state->NextTask = 0;
+    state->TasksDone = 0;
+    state->Failed = false;
+
+    for(uint32 i = 0; i < numHelpers; ++i)
+        Enqueue([state]() { RunParallelForTasks(*state); });
+
+    // The calling thread works through the tasks too, so this can't stall even if
+    // all of the workers are busy (or are themselves inside a ParallelFor)
+    RunParallelForTasks(*state);
+
+    std::unique_lock<std::mutex> lock(state->DoneMutex);
+    state->DoneCV.wait(lock, [&state]() { return state->TasksDone == state->NumTasks; });
+
+    if(state->Failed)
+        std::rethrow_exception(state->FirstException);
+}
+
+void ThreadPool::WorkerLoop()
+{
+    while(true)
+    {
+        Job job;
+
+        {
+            std::unique_lock<std::mutex> lock(jobMutex);
+            jobCV.wait(lock, [this]() { return shuttingDown || jobs.size() > 0; });
+            if(jobs.size() == 0)
+                return;
+
+            job = jobs.front();
+            jobs.pop_front();
+        }
+
+        job();
+    }
+}
+
+}
@@ -0,0 +1,65 @@
+//-------------------------------------------------------------------------------
+// Gumshoe Framework v1.00
+//   - Based on MJP's DX11 Sample Framework (http://mynameismjp.wordpress.com/)
+//
+//  All code licensed under the MIT license
+//
+//-------------------------------------------------------------------------------
+
+#pragma once
+
+#include "PCH.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <exception>
+
+namespace GumshoeFramework10
+{
+
+// A fixed set of worker threads servicing a FIFO job queue. A pool that hasn't been
+// initialized (or was initialized with zero workers) runs everything on the calling thread.
+class ThreadPool
+{
+
+public:
+
+    typedef std::function<void()> Job;
+    typedef std::function<void(uint32 taskIdx)> TaskFunc;
+
+    static ThreadPool GlobalPool;
+
+    ThreadPool();
+    ~ThreadPool();
+
+    // Passing 0 creates one worker per hardware thread, minus one for the calling thread
+    void Initialize(uint32 numWorkers = 0);
+    void Shutdown();
+
+    // Queues a job to run on a worker thread
+    void Enqueue(const Job& job);
+
+    // Runs func(taskIdx) for every taskIdx in [0, numTasks) on the workers and the calling
+    // thread, and returns once all of them have finished. If a task throws, the tasks that
+    // haven't started yet are skipped, and the first exception is rethrown here once the ones
+    // already running have finished.
+    void ParallelFor(uint32 numTasks, const TaskFunc& func);
+
+    // Accessors
+    uint32 NumWorkers() const { return static_cast<uint32>(workers.size()); }
+
+protected:
+
+    void WorkerLoop();
+
+    std::vector<std::thread> workers;
+    std::deque<Job> jobs;
+    std::mutex jobMutex;
+    std::condition_variable jobCV;
+    bool shuttingDown;
+};
+
+}
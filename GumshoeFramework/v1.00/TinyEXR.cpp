@@ -6974,6 +6974,24 @@ void DecompressZip(unsigned char *dst, unsigned long &uncompressedSize,
 
 } // namespace
 
+// == SF11 Changes START ==========================================================================
+unsigned long EXRCompressBound(unsigned long srcSize) {
+  return miniz::mz_compressBound(srcSize);
+}
+
+int EXRCompress(unsigned char *dst, unsigned long *dstSize,
+                const unsigned char *src, unsigned long srcSize, int level) {
+  int ret = miniz::mz_compress2(dst, dstSize, src, srcSize, level);
+  return ret == miniz::MZ_OK ? 0 : -1;
+}
+
+int EXRUncompress(unsigned char *dst, unsigned long *dstSize,
+                  const unsigned char *src, unsigned long srcSize) {
+  int ret = miniz::mz_uncompress(dst, dstSize, src, srcSize);
+  return ret == miniz::MZ_OK ? 0 : -1;
+}
+// == SF11 Changes END ==========================================================================
+
 int LoadEXR(float **out_rgba, int *width, int *height, const char *filename,
             const char **err) {
 
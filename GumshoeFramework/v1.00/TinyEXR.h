@@ -98,6 +98,17 @@ extern int LoadDeepEXR(DeepImage *out_image, const char *filename,
 // char *filename,
 //                       const char **err);
 
+// == SF11 Changes START ==========================================================================
+// Raw access to the embedded miniz deflate/inflate, for compressing data that isn't an image.
+// Both return 0 on success, and update the size pointed to by dstSize to the number of bytes
+// written.
+extern unsigned long EXRCompressBound(unsigned long srcSize);
+extern int EXRCompress(unsigned char *dst, unsigned long *dstSize,
+                       const unsigned char *src, unsigned long srcSize, int level);
+extern int EXRUncompress(unsigned char *dst, unsigned long *dstSize,
+                         const unsigned char *src, unsigned long srcSize);
+// == SF11 Changes END ==========================================================================
+
 #ifdef __cplusplus
 }
 #endif
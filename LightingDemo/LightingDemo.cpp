@@ -187,6 +187,7 @@ void LightingDemo::Initialize()
 
     // Initialize the waves model
     mWaves.Init(160, 160, 1.0f, 0.03f, 3.25f, 0.4f);
+    mWaves.SetRegionTracking(true);
 
     // Build the terrain scene
     BuildLandGeometryBuffers(device);
@@ -306,36 +307,56 @@ void LightingDemo::Update(const Timer& timer)
 
     if( AppSettings::CurrentScene == uint64(Scenes::Terrain) )
     {
-        // Every quarter second, generate a random wave.
+        // Every quarter second, generate a random wave.  Waves are
+        // handed to the simulation as one batch per frame.
         static float tBase = 0.0f;
+        mWavesImpulses.clear();
         if( (timer.ElapsedMillisecondsF() - tBase) >= 4.00f )
         {
             tBase += 4.00f;
-     
-            DWORD i = 5 + rand() % (mWaves.RowCount()-10);
-            DWORD j = 5 + rand() % (mWaves.ColumnCount()-10);
 
-            float r = RandFloat(0.0f, 1.0f);
-
-            mWaves.Disturb(i, j, r);
+            WaveImpulse impulse;
+            impulse.Row       = 5 + rand() % (mWaves.RowCount()-10);
+            impulse.Col       = 5 + rand() % (mWaves.ColumnCount()-10);
+            impulse.Magnitude = RandFloat(0.0f, 1.0f);
+            impulse.Radius    = 1;
+            mWavesImpulses.push_back(impulse);
         }
 
+        if(mWavesImpulses.size() > 0)
+            mWaves.DisturbMany(&mWavesImpulses[0], UINT(mWavesImpulses.size()));
+
         mWaves.Update(timer.DeltaSecondsF());
 
-        // Update the wave vertex buffer with the new solution
+        // Update the wave vertex buffer with the new solution.  Only the rows
+        // that the simulation touched since the last upload are copied.
         ID3D11DeviceContextPtr context = deviceManager.ImmediateContext();
 
-        D3D11_MAPPED_SUBRESOURCE mappedData;
-        DXCall(context->Map(meshMap[uint64(Scenes::Terrain)].back().vertexBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedData));
-
-        SimpleVertex* v = reinterpret_cast<SimpleVertex*>(mappedData.pData);
-        for(UINT i = 0; i < mWaves.VertexCount(); ++i)
+        const std::vector<WaveRowRange>& dirtyRows = mWaves.DirtyRows();
+        const UINT numCols = mWaves.ColumnCount();
+        for(uint64 r = 0; r < dirtyRows.size(); ++r)
         {
-            v[i].Pos    = mWaves[i];
-            v[i].Normal = mWaves.Normal(i);
+            const UINT first = dirtyRows[r].Begin * numCols;
+            const UINT last  = dirtyRows[r].End * numCols;
+
+            mWavesVertices.resize(last - first);
+            for(UINT i = first; i < last; ++i)
+            {
+                mWavesVertices[i - first].Pos    = mWaves[i];
+                mWavesVertices[i - first].Normal = mWaves.Normal(i);
+            }
+
+            D3D11_BOX box;
+            box.left   = UINT(first * sizeof(SimpleVertex));
+            box.right  = UINT(last * sizeof(SimpleVertex));
+            box.top    = 0;
+            box.bottom = 1;
+            box.front  = 0;
+            box.back   = 1;
+            context->UpdateSubresource(meshMap[uint64(Scenes::Terrain)].back().vertexBuffer, 0, &box, &mWavesVertices[0], 0, 0);
         }
 
-        context->Unmap(meshMap[uint64(Scenes::Terrain)].back().vertexBuffer, 0);
+        mWaves.ClearDirtyRows();
 
         // Animate the point light.
         if (AppSettings::EnablePointLightAnim)
@@ -567,11 +588,13 @@ void LightingDemo::BuildWaveGeometryBuffers(ID3D11Device* device)
 
     // Create the vertex buffer.  Note that we allocate space only, as
     // we will be updating the data every time step of the simulation.
+    // The buffer is updated a few rows at a time, so it can't be a
+    // dynamic buffer (those can only be mapped with WRITE_DISCARD).
     D3D11_BUFFER_DESC vbd;
-    vbd.Usage = D3D11_USAGE_DYNAMIC;
+    vbd.Usage = D3D11_USAGE_DEFAULT;
     vbd.ByteWidth = sizeof(SimpleVertex) * mWaves.VertexCount();
     vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-    vbd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+    vbd.CPUAccessFlags = 0;
     vbd.MiscFlags = 0;
     DXCall(device->CreateBuffer(&vbd, 0, &wavesRenderObject.vertexBuffer));
 
@@ -49,6 +49,8 @@ protected:
 
     // Wave simulation object
     Waves mWaves;
+    std::vector<SimpleVertex> mWavesVertices;
+    std::vector<WaveImpulse> mWavesImpulses;
 
     // Directional light objects
     DirectionalLight mDirLights[3];
@@ -0,0 +1,622 @@
+//-------------------------------------------------------------------------------
+//
+// Gumshoe Framework v1.00
+//   - Based on MJP's DX11 Sample Framework (http://mynameismjp.wordpress.com/)
+//
+//  All code licensed under the MIT license
+//
+//-------------------------------------------------------------------------------
+
+#include "OceanWaves.h"
+#include <algorithm>
+#include <vector>
+#include <random>
+#include <cassert>
+#include <emmintrin.h>
+
+static const float Gravity = 9.81f;
+static const float Pi      = 3.14159265f;
+
+// Grids are allocated on a 16-byte boundary so that the FFT passes can use aligned SSE loads.
+static const size_t FieldAlignment = 16;
+
+// Transposes are done in square blocks that fit in L1.
+static const UINT TransposeBlock = 16;
+
+static float* AllocFloats(UINT count)
+{
+	float* data = reinterpret_cast<float*>(_aligned_malloc(sizeof(float)*count, FieldAlignment));
+	memset(data, 0, sizeof(float)*count);
+	return data;
+}
+
+//
+// In-place inverse complex FFT of one power-of-two size, on split real/imaginary arrays.
+// The input is bit-reversed and then run through radix-4 passes, each of which does the
+// work of two radix-2 decimation-in-time stages while touching memory once.  If the size
+// is an odd power of two a single radix-2 pass goes first.  Passes with at least four
+// butterflies per group run four of them at a time with SSE.  The transform isn't
+// normalized, so out[x] = sum_k in[k]*e^(2*pi*i*k*x/N).
+//
+class InverseFFT
+{
+public:
+	explicit InverseFFT(UINT size);
+
+	void Transform(float* re, float* im)const;
+
+private:
+	void Radix4Scalar(float* re, float* im, UINT half, const float* tw)const;
+	void Radix4SSE(float* re, float* im, UINT half, const float* tw)const;
+
+	UINT mSize;
+	bool mOddPower;
+	std::vector<UINT> mBitReverse;
+
+	// Per radix-4 pass: the group half size, and an offset into mTwiddles where four arrays
+	// of 'half' floats hold the real and imaginary parts of w1 = e^(i*pi*k/half) and
+	// w2 = e^(i*pi*k/(2*half)).
+	std::vector<UINT> mPassHalf;
+	std::vector<UINT> mPassOffset;
+	std::vector<float> mTwiddles;
+};
+
+InverseFFT::InverseFFT(UINT size)
+: mSize(size), mOddPower(false)
+{
+	assert(size >= 2 && (size & (size - 1)) == 0);
+
+	UINT log2Size = 0;
+	while((1U << log2Size) < size)
+		++log2Size;
+	mOddPower = (log2Size & 1) != 0;
+
+	mBitReverse.resize(size);
+	for(UINT i = 0; i < size; ++i)
+	{
+		UINT r = 0;
+		for(UINT b = 0; b < log2Size; ++b)
+			r |= ((i >> b) & 1) << (log2Size - 1 - b);
+		mBitReverse[i] = r;
+	}
+
+	for(UINT half = mOddPower ? 2 : 1; half*4 <= size; half *= 4)
+	{
+		mPassHalf.push_back(half);
+		mPassOffset.push_back(UINT(mTwiddles.size()));
+
+		// Each array is padded to a multiple of four floats.
+		const UINT stride = (half + 3) & ~3U;
+		mTwiddles.resize(mTwiddles.size() + stride*4, 0.0f);
+
+		float* tw = &mTwiddles[mPassOffset.back()];
+		for(UINT k = 0; k < half; ++k)
+		{
+			const double a1 = 3.14159265358979323846*k / half;
+			const double a2 = 3.14159265358979323846*k / (2*half);
+			tw[k]            = float(cos(a1));
+			tw[stride + k]   = float(sin(a1));
+			tw[2*stride + k] = float(cos(a2));
+			tw[3*stride + k] = float(sin(a2));
+		}
+	}
+}
+
+void InverseFFT::Transform(float* re, float* im)const
+{
+	for(UINT i = 0; i < mSize; ++i)
+	{
+		const UINT j = mBitReverse[i];
+		if(i < j)
+		{
+			std::swap(re[i], re[j]);
+			std::swap(im[i], im[j]);
+		}
+	}
+
+	if(mOddPower)
+	{
+		for(UINT b = 0; b < mSize; b += 2)
+		{
+			const float ar = re[b], ai = im[b];
+			const float cr = re[b+1], ci = im[b+1];
+			re[b]   = ar + cr;
+			im[b]   = ai + ci;
+			re[b+1] = ar - cr;
+			im[b+1] = ai - ci;
+		}
+	}
+
+	for(size_t p = 0; p < mPassHalf.size(); ++p)
+	{
+		const UINT half = mPassHalf[p];
+		const float* tw = &mTwiddles[mPassOffset[p]];
+		if(half >= 4)
+			Radix4SSE(re, im, half, tw);
+		else
+			Radix4Scalar(re, im, half, tw);
+	}
+}
+
+// Does two radix-2 stages over groups of 4*half elements.  The first stage pairs x0/x1 and
+// x2/x3 with twiddle w1, the second pairs the results with w2 and i*w2.
+void InverseFFT::Radix4Scalar(float* re, float* im, UINT half, const float* tw)const
+{
+	const UINT stride = (half + 3) & ~3U;
+	const float* w1re = tw;
+	const float* w1im = tw + stride;
+	const float* w2re = tw + 2*stride;
+	const float* w2im = tw + 3*stride;
+
+	for(UINT b = 0; b < mSize; b += 4*half)
+	{
+		for(UINT k = 0; k < half; ++k)
+		{
+			const UINT p0 = b + k;
+			const UINT p1 = p0 + half;
+			const UINT p2 = p1 + half;
+			const UINT p3 = p2 + half;
+
+			// First stage.
+			float tr = w1re[k]*re[p1] - w1im[k]*im[p1];
+			float ti = w1re[k]*im[p1] + w1im[k]*re[p1];
+			const float ar = re[p0] + tr, ai = im[p0] + ti;
+			const float br = re[p0] - tr, bi = im[p0] - ti;
+
+			tr = w1re[k]*re[p3] - w1im[k]*im[p3];
+			ti = w1re[k]*im[p3] + w1im[k]*re[p3];
+			const float cr = re[p2] + tr, ci = im[p2] + ti;
+			const float dr = re[p2] - tr, di = im[p2] - ti;
+
+			// Second stage.  i*(w2*d) = (-Im(w2*d), Re(w2*d)).
+			tr = w2re[k]*cr - w2im[k]*ci;
+			ti = w2re[k]*ci + w2im[k]*cr;
+			const float ur = -(w2re[k]*di + w2im[k]*dr);
+			const float ui = w2re[k]*dr - w2im[k]*di;
+
+			re[p0] = ar + tr;
+			im[p0] = ai + ti;
+			re[p2] = ar - tr;
+			im[p2] = ai - ti;
+			re[p1] = br + ur;
+			im[p1] = bi + ui;
+			re[p3] = br - ur;
+			im[p3] = bi - ui;
+		}
+	}
+}
+
+// Same as Radix4Scalar(), four butterflies at a time.  half is a multiple of four here.
+void InverseFFT::Radix4SSE(float* re, float* im, UINT half, const float* tw)const
+{
+	const UINT stride = (half + 3) & ~3U;
+	const float* w1re = tw;
+	const float* w1im = tw + stride;
+	const float* w2re = tw + 2*stride;
+	const float* w2im = tw + 3*stride;
+
+	for(UINT b = 0; b < mSize; b += 4*half)
+	{
+		for(UINT k = 0; k < half; k += 4)
+		{
+			const UINT p0 = b + k;
+			const UINT p1 = p0 + half;
+			const UINT p2 = p1 + half;
+			const UINT p3 = p2 + half;
+
+			const __m128 vw1re = _mm_loadu_ps(w1re + k);
+			const __m128 vw1im = _mm_loadu_ps(w1im + k);
+			const __m128 vw2re = _mm_loadu_ps(w2re + k);
+			const __m128 vw2im = _mm_loadu_ps(w2im + k);
+
+			const __m128 x0re = _mm_load_ps(re + p0), x0im = _mm_load_ps(im + p0);
+			const __m128 x1re = _mm_load_ps(re + p1), x1im = _mm_load_ps(im + p1);
+			const __m128 x2re = _mm_load_ps(re + p2), x2im = _mm_load_ps(im + p2);
+			const __m128 x3re = _mm_load_ps(re + p3), x3im = _mm_load_ps(im + p3);
+
+			// First stage.
+			__m128 tr = _mm_sub_ps(_mm_mul_ps(vw1re, x1re), _mm_mul_ps(vw1im, x1im));
+			__m128 ti = _mm_add_ps(_mm_mul_ps(vw1re, x1im), _mm_mul_ps(vw1im, x1re));
+			const __m128 ar = _mm_add_ps(x0re, tr), ai = _mm_add_ps(x0im, ti);
+			const __m128 br = _mm_sub_ps(x0re, tr), bi = _mm_sub_ps(x0im, ti);
+
+			tr = _mm_sub_ps(_mm_mul_ps(vw1re, x3re), _mm_mul_ps(vw1im, x3im));
+			ti = _mm_add_ps(_mm_mul_ps(vw1re, x3im), _mm_mul_ps(vw1im, x3re));
+			const __m128 cr = _mm_add_ps(x2re, tr), ci = _mm_add_ps(x2im, ti);
+			const __m128 dr = _mm_sub_ps(x2re, tr), di = _mm_sub_ps(x2im, ti);
+
+			// Second stage.
+			tr = _mm_sub_ps(_mm_mul_ps(vw2re, cr), _mm_mul_ps(vw2im, ci));
+			ti = _mm_add_ps(_mm_mul_ps(vw2re, ci), _mm_mul_ps(vw2im, cr));
+			const __m128 ur = _mm_sub_ps(_mm_setzero_ps(), _mm_add_ps(_mm_mul_ps(vw2re, di), _mm_mul_ps(vw2im, dr)));
+			const __m128 ui = _mm_sub_ps(_mm_mul_ps(vw2re, dr), _mm_mul_ps(vw2im, di));
+
+			_mm_store_ps(re + p0, _mm_add_ps(ar, tr));
+			_mm_store_ps(im + p0, _mm_add_ps(ai, ti));
+			_mm_store_ps(re + p2, _mm_sub_ps(ar, tr));
+			_mm_store_ps(im + p2, _mm_sub_ps(ai, ti));
+			_mm_store_ps(re + p1, _mm_add_ps(br, ur));
+			_mm_store_ps(im + p1, _mm_add_ps(bi, ui));
+			_mm_store_ps(re + p3, _mm_sub_ps(br, ur));
+			_mm_store_ps(im + p3, _mm_sub_ps(bi, ui));
+		}
+	}
+}
+
+OceanWaves::OceanWaves()
+: mSize(0), mNumRows(0), mNumCols(0), mVertexCount(0), mTriangleCount(0),
+  mTime(0.0f), mLoopPeriod(0.0f), mExecution(WaveExecution::Serial), mThreadPool(0), mFFT(0),
+  mH0Re(0), mH0Im(0), mH0ConjRe(0), mH0ConjIm(0), mOmega(0), mScratchRe(0), mScratchIm(0),
+  mPositions(0), mNormals(0), mTangentX(0)
+{
+	for(UINT f = 0; f < NumFields; ++f)
+	{
+		mFieldRe[f] = 0;
+		mFieldIm[f] = 0;
+	}
+}
+
+OceanWaves::~OceanWaves()
+{
+	FreeGrids();
+}
+
+void OceanWaves::FreeGrids()
+{
+	delete mFFT;
+	_aligned_free(mH0Re);
+	_aligned_free(mH0Im);
+	_aligned_free(mH0ConjRe);
+	_aligned_free(mH0ConjIm);
+	_aligned_free(mOmega);
+	for(UINT f = 0; f < NumFields; ++f)
+	{
+		_aligned_free(mFieldRe[f]);
+		_aligned_free(mFieldIm[f]);
+		mFieldRe[f] = 0;
+		mFieldIm[f] = 0;
+	}
+	_aligned_free(mScratchRe);
+	_aligned_free(mScratchIm);
+	delete[] mPositions;
+	delete[] mNormals;
+	delete[] mTangentX;
+
+	mFFT       = 0;
+	mH0Re      = 0;
+	mH0Im      = 0;
+	mH0ConjRe  = 0;
+	mH0ConjIm  = 0;
+	mOmega     = 0;
+	mScratchRe = 0;
+	mScratchIm = 0;
+	mPositions = 0;
+	mNormals   = 0;
+	mTangentX  = 0;
+}
+
+UINT OceanWaves::RowCount()const
+{
+	return mNumRows;
+}
+
+UINT OceanWaves::ColumnCount()const
+{
+	return mNumCols;
+}
+
+UINT OceanWaves::VertexCount()const
+{
+	return mVertexCount;
+}
+
+UINT OceanWaves::TriangleCount()const
+{
+	return mTriangleCount;
+}
+
+float OceanWaves::Width()const
+{
+	return mSettings.PatchSize;
+}
+
+float OceanWaves::Depth()const
+{
+	return mSettings.PatchSize;
+}
+
+void OceanWaves::SetExecution(WaveExecution execution, GumshoeFramework10::ThreadPool* threadPool)
+{
+	mExecution  = execution;
+	mThreadPool = threadPool;
+}
+
+WaveExecution OceanWaves::Execution()const
+{
+	return mExecution;
+}
+
+// Calls func for every task index, on the thread pool in parallel mode.  Doesn't return until
+// all of the tasks are done.
+void OceanWaves::RunTasks(UINT numTasks, const TaskFunc& func)const
+{
+	if(mExecution == WaveExecution::Serial || mThreadPool == 0)
+	{
+		for(UINT i = 0; i < numTasks; ++i)
+			func(i);
+		return;
+	}
+
+	mThreadPool->ParallelFor(numTasks, [&](uint32 taskIdx) { func(taskIdx); });
+}
+
+void OceanWaves::Init(UINT n, const OceanSettings& settings)
+{
+	assert(n >= 4 && (n & (n - 1)) == 0);
+
+	// In case Init() called again.
+	FreeGrids();
+
+	mSize     = n;
+	mSettings = settings;
+	mTime     = 0.0f;
+
+	mNumRows       = n + 1;
+	mNumCols       = n + 1;
+	mVertexCount   = mNumRows*mNumCols;
+	mTriangleCount = n*n*2;
+
+	mFFT = new InverseFFT(n);
+
+	mH0Re     = AllocFloats(n*n);
+	mH0Im     = AllocFloats(n*n);
+	mH0ConjRe = AllocFloats(n*n);
+	mH0ConjIm = AllocFloats(n*n);
+	mOmega    = AllocFloats(n*n);
+	for(UINT f = 0; f < NumFields; ++f)
+	{
+		mFieldRe[f] = AllocFloats(n*n);
+		mFieldIm[f] = AllocFloats(n*n);
+	}
+	mScratchRe = AllocFloats(n*n);
+	mScratchIm = AllocFloats(n*n);
+
+	mPositions = new XMFLOAT3[mVertexCount];
+	mNormals   = new XMFLOAT3[mVertexCount];
+	mTangentX  = new XMFLOAT3[mVertexCount];
+
+	BuildSpectrum();
+	Update(0.0f);
+}
+
+// Evaluates h0(k) = (xi_r + i*xi_i)*sqrt(P(k)/2) for every wave vector, with xi_r and xi_i
+// drawn from a unit normal distribution.  Wave vectors are laid out in FFT order: index m
+// maps to m for m < N/2 and to m - N above that.  The Nyquist row and column are left at
+// zero, since they don't have a conjugate partner and would break the real-valued output.
+void OceanWaves::BuildSpectrum()
+{
+	const UINT n = mSize;
+	const float dk = 2.0f*Pi / mSettings.PatchSize;
+
+	XMFLOAT2 wind = mSettings.WindDirection;
+	const float windLength = sqrtf(wind.x*wind.x + wind.y*wind.y);
+	wind.x = windLength > 0.0f ? wind.x / windLength : 1.0f;
+	wind.y = windLength > 0.0f ? wind.y / windLength : 0.0f;
+
+	const float V = mSettings.WindSpeed;
+	const float L = V*V / Gravity;
+	const float smallWave = L*0.001f;
+
+	const float F = mSettings.Fetch;
+	const float alpha  = 0.076f*powf(V*V / (F*Gravity), 0.22f);
+	const float peakW  = 22.0f*powf(Gravity*Gravity / (V*F), 1.0f/3.0f);
+	const float gamma  = mSettings.PeakEnhancement;
+
+	// Rounding the frequencies to multiples of 2*pi/T makes the whole field periodic in T.
+	mLoopPeriod = mSettings.LoopPeriod;
+	const float baseW = mLoopPeriod > 0.0f ? 2.0f*Pi / mLoopPeriod : 0.0f;
+
+	std::mt19937 rng(mSettings.Seed);
+	std::normal_distribution<float> gauss(0.0f, 1.0f);
+
+	for(UINT i = 0; i < n; ++i)
+	{
+		const int mz = i < n/2 ? int(i) : int(i) - int(n);
+		for(UINT j = 0; j < n; ++j)
+		{
+			const int mx = j < n/2 ? int(j) : int(j) - int(n);
+			const float kx = mx*dk;
+			const float kz = mz*dk;
+			const float k  = sqrtf(kx*kx + kz*kz);
+
+			// Draw the random numbers for every entry so the pattern only depends on the seed.
+			const float xiR = gauss(rng);
+			const float xiI = gauss(rng);
+
+			float w = sqrtf(Gravity*k);
+			if(baseW > 0.0f)
+				w = floorf(w / baseW)*baseW;
+			mOmega[i*n+j] = w;
+
+			float P = 0.0f;
+			if(k > 0.0f && i != n/2 && j != n/2)
+			{
+				const float cosTheta = (kx*wind.x + kz*wind.y) / k;
+				if(mSettings.Spectrum == OceanSpectrum::Phillips)
+				{
+					P = mSettings.Amplitude*expf(-1.0f / (k*L*k*L)) / (k*k*k*k) * cosTheta*cosTheta;
+					P *= expf(-k*k*smallWave*smallWave);
+				}
+				else if(cosTheta > 0.0f)
+				{
+					// JONSWAP frequency spectrum, turned into a wavenumber spectrum with
+					// dw/dk = g/(2w) and a cos^2 spreading function over the half plane.
+					const float wk = sqrtf(Gravity*k);
+					const float sigma = wk <= peakW ? 0.07f : 0.09f;
+					const float r = expf(-(wk - peakW)*(wk - peakW) / (2.0f*sigma*sigma*peakW*peakW));
+					const float ratio = peakW / wk;
+					const float S = alpha*Gravity*Gravity / powf(wk, 5.0f) *
+									expf(-1.25f*ratio*ratio*ratio*ratio) * powf(gamma, r);
+					const float spreading = 2.0f / Pi * cosTheta*cosTheta;
+					P = mSettings.Amplitude * S * (Gravity / (2.0f*wk)) / k * spreading * dk*dk;
+				}
+			}
+
+			const float scale = sqrtf(P*0.5f);
+			mH0Re[i*n+j] = xiR*scale;
+			mH0Im[i*n+j] = xiI*scale;
+		}
+	}
+
+	// conj(h0(-k)), so that the per-frame update doesn't have to gather mirrored entries.
+	for(UINT i = 0; i < n; ++i)
+	{
+		const UINT mi = (n - i) & (n - 1);
+		for(UINT j = 0; j < n; ++j)
+		{
+			const UINT mj = (n - j) & (n - 1);
+			mH0ConjRe[i*n+j] =  mH0Re[mi*n+mj];
+			mH0ConjIm[i*n+j] = -mH0Im[mi*n+mj];
+		}
+	}
+}
+
+void OceanWaves::Update(float dt)
+{
+	mTime += dt;
+	if(mLoopPeriod > 0.0f)
+		mTime = fmodf(mTime, mLoopPeriod);
+
+	const UINT n = mSize;
+	const float t = mTime;
+	RunTasks(n, [&](UINT row) { UpdateSpectrumRows(row, row + 1, t); });
+
+	// The displacement field is only needed for choppy waves.
+	const UINT numFields = mSettings.Choppiness != 0.0f ? NumFields : NumFields - 1;
+	for(UINT f = 0; f < numFields; ++f)
+		TransformField(mFieldRe[f], mFieldIm[f]);
+
+	RunTasks(mNumRows, [this](UINT row) { UpdateVertexRows(row, row + 1); });
+}
+
+// Advances the spectrum to time t and builds the packed fields:
+//   h(k,t) = h0(k)*e^(iwt) + conj(h0(-k))*e^(-iwt)
+//   slope = i*k*h,  displacement = -i*(k/|k|)*h
+// Two real-valued fields A and B go through one complex transform as A + i*B.
+void OceanWaves::UpdateSpectrumRows(UINT rowBegin, UINT rowEnd, float t)
+{
+	const UINT n = mSize;
+	const float dk = 2.0f*Pi / mSettings.PatchSize;
+
+	for(UINT i = rowBegin; i < rowEnd; ++i)
+	{
+		const int mz = i < n/2 ? int(i) : int(i) - int(n);
+		const float kz = mz*dk;
+		for(UINT j = 0; j < n; ++j)
+		{
+			const UINT idx = i*n+j;
+			const int mx = j < n/2 ? int(j) : int(j) - int(n);
+			const float kx = mx*dk;
+			const float k  = sqrtf(kx*kx + kz*kz);
+
+			const float c = cosf(mOmega[idx]*t);
+			const float s = sinf(mOmega[idx]*t);
+
+			const float hr = (mH0Re[idx] + mH0ConjRe[idx])*c - (mH0Im[idx] - mH0ConjIm[idx])*s;
+			const float hi = (mH0Re[idx] - mH0ConjRe[idx])*s + (mH0Im[idx] + mH0ConjIm[idx])*c;
+
+			// height + i*(i*kx*h)
+			mFieldRe[0][idx] = hr - kx*hr;
+			mFieldIm[0][idx] = hi - kx*hi;
+
+			// (i*kz*h) + i*(-i*kx/k*h)
+			const float kxn = k > 0.0f ? kx / k : 0.0f;
+			const float kzn = k > 0.0f ? kz / k : 0.0f;
+			mFieldRe[1][idx] = -kz*hi + kxn*hr;
+			mFieldIm[1][idx] =  kz*hr + kxn*hi;
+
+			// -i*kz/k*h
+			mFieldRe[2][idx] =  kzn*hi;
+			mFieldIm[2][idx] = -kzn*hr;
+		}
+	}
+}
+
+// 2D inverse FFT: transform the rows, transpose, transform the rows again and transpose back.
+void OceanWaves::TransformField(float*& re, float*& im)
+{
+	const UINT n = mSize;
+	const InverseFFT& fft = *mFFT;
+
+	RunTasks(n, [&](UINT row) { fft.Transform(re + row*n, im + row*n); });
+	Transpose(re, im);
+	RunTasks(n, [&](UINT row) { fft.Transform(re + row*n, im + row*n); });
+	Transpose(re, im);
+}
+
+// Transposes a field into the scratch grids a block at a time, then swaps the two so that
+// the field points at the transposed data.
+void OceanWaves::Transpose(float*& re, float*& im)
+{
+	const UINT n = mSize;
+	const UINT blockSize = std::min(TransposeBlock, n);
+	const UINT numBlocks = n / blockSize;
+	const float* srcRe = re;
+	const float* srcIm = im;
+	float* dstRe = mScratchRe;
+	float* dstIm = mScratchIm;
+
+	RunTasks(numBlocks, [&](UINT blockRow)
+	{
+		const UINT i0 = blockRow*blockSize;
+		for(UINT j0 = 0; j0 < n; j0 += blockSize)
+		{
+			for(UINT i = i0; i < i0 + blockSize; ++i)
+			{
+				for(UINT j = j0; j < j0 + blockSize; ++j)
+				{
+					dstRe[j*n+i] = srcRe[i*n+j];
+					dstIm[j*n+i] = srcIm[i*n+j];
+				}
+			}
+		}
+	});
+
+	std::swap(re, mScratchRe);
+	std::swap(im, mScratchIm);
+}
+
+// Builds positions, normals and tangents from the transformed fields.  Grid row i runs along
+// -z like the Waves class, so z-derivatives and z-displacements flip sign on the way out.
+void OceanWaves::UpdateVertexRows(UINT rowBegin, UINT rowEnd)
+{
+	const UINT n = mSize;
+	const float dx = mSettings.PatchSize / n;
+	const float halfSize = mSettings.PatchSize*0.5f;
+	const float lambda = mSettings.Choppiness;
+
+	for(UINT i = rowBegin; i < rowEnd; ++i)
+	{
+		const UINT si = i & (n - 1);
+		for(UINT j = 0; j < mNumCols; ++j)
+		{
+			const UINT sj  = j & (n - 1);
+			const UINT idx = si*n + sj;
+
+			const float h      = mFieldRe[0][idx];
+			const float slopeX = mFieldIm[0][idx];
+			const float slopeZ = mFieldRe[1][idx];
+			const float dispX  = lambda != 0.0f ? mFieldIm[1][idx] : 0.0f;
+			const float dispZ  = lambda != 0.0f ? mFieldRe[2][idx] : 0.0f;
+
+			const UINT v = i*mNumCols + j;
+			mPositions[v] = XMFLOAT3(-halfSize + j*dx + lambda*dispX, h, halfSize - i*dx - lambda*dispZ);
+
+			XMFLOAT3 normal(-slopeX, 1.0f, slopeZ);
+			XMStoreFloat3(&mNormals[v], XMVector3Normalize(XMLoadFloat3(&normal)));
+
+			XMFLOAT3 tangent(1.0f, slopeX, 0.0f);
+			XMStoreFloat3(&mTangentX[v], XMVector3Normalize(XMLoadFloat3(&tangent)));
+		}
+	}
+}
@@ -0,0 +1,147 @@
+//-------------------------------------------------------------------------------
+//
+// Gumshoe Framework v1.00
+//   - Based on MJP's DX11 Sample Framework (http://mynameismjp.wordpress.com/)
+//
+// ------------------------- OceanWaves Class -------------------------
+//  Synthesizes a deep-water ocean patch from a wave spectrum, following Tessendorf's
+//  "Simulating Ocean Water".  Every frame the spectrum is advanced analytically to the
+//  current time and transformed back to heights, slopes and horizontal (choppy)
+//  displacements with an inverse FFT, so the cost is O(N^2 log N) no matter how long the
+//  simulation has been running.  The patch is periodic, so it can be tiled to cover open
+//  water instead of simulating a large grid.
+//
+//  The accessors match the Waves class, so the client copies the solution into vertex
+//  buffers the same way.  The grid has N+1 vertices per side, with the last row and column
+//  repeating the first so that neighbouring tiles line up.
+//
+//  All code licensed under the MIT license
+//
+//-------------------------------------------------------------------------------
+
+#pragma once
+
+#include <PCH.h>
+#include <ThreadPool.h>
+
+#include "Waves.h"
+
+enum class OceanSpectrum
+{
+	Phillips = 0,
+	JONSWAP,
+};
+
+struct OceanSettings
+{
+	OceanSpectrum Spectrum;
+
+	// Side length of the patch in world units.
+	float PatchSize;
+
+	// Wind speed in m/s and direction in the xz plane.
+	float WindSpeed;
+	XMFLOAT2 WindDirection;
+
+	// Phillips: the spectrum constant A.  JONSWAP: a multiplier on the physical spectrum.
+	float Amplitude;
+
+	// JONSWAP only: fetch length in meters and peak enhancement factor (gamma).
+	float Fetch;
+	float PeakEnhancement;
+
+	// Scale of the horizontal displacement that sharpens the crests.  0 turns it off.
+	float Choppiness;
+
+	// Frequencies are rounded so that the animation repeats after this many seconds.
+	float LoopPeriod;
+
+	UINT Seed;
+
+	OceanSettings()
+	: Spectrum(OceanSpectrum::Phillips), PatchSize(128.0f), WindSpeed(12.0f),
+	  WindDirection(1.0f, 0.0f), Amplitude(3.0e-6f), Fetch(100000.0f), PeakEnhancement(3.3f),
+	  Choppiness(0.8f), LoopPeriod(200.0f), Seed(0)
+	{
+	}
+};
+
+class InverseFFT;
+
+class OceanWaves
+{
+public:
+	OceanWaves();
+	~OceanWaves();
+
+	UINT RowCount()const;
+	UINT ColumnCount()const;
+	UINT VertexCount()const;
+	UINT TriangleCount()const;
+	float Width()const;
+	float Depth()const;
+
+	// Returns the solution at the ith grid point.
+	const XMFLOAT3& operator[](int i)const { return mPositions[i]; }
+
+	// Returns the solution normal at the ith grid point.
+	const XMFLOAT3& Normal(int i)const { return mNormals[i]; }
+
+	// Returns the unit tangent vector at the ith grid point in the local x-axis direction.
+	const XMFLOAT3& TangentX(int i)const { return mTangentX[i]; }
+
+	// Runs the spectrum update, the FFT rows/columns and the vertex pass on a thread pool.
+	void SetExecution(WaveExecution execution,
+					  GumshoeFramework10::ThreadPool* threadPool = &GumshoeFramework10::ThreadPool::GlobalPool);
+	WaveExecution Execution()const;
+
+	// n is the FFT size per side and has to be a power of two.
+	void Init(UINT n, const OceanSettings& settings);
+	void Update(float dt);
+
+private:
+	typedef std::function<void(UINT taskIdx)> TaskFunc;
+
+	void RunTasks(UINT numTasks, const TaskFunc& func)const;
+	void BuildSpectrum();
+	void UpdateSpectrumRows(UINT rowBegin, UINT rowEnd, float t);
+	void TransformField(float*& re, float*& im);
+	void Transpose(float*& re, float*& im);
+	void UpdateVertexRows(UINT rowBegin, UINT rowEnd);
+	void FreeGrids();
+
+	UINT mSize;
+	UINT mNumRows;
+	UINT mNumCols;
+
+	UINT mVertexCount;
+	UINT mTriangleCount;
+
+	OceanSettings mSettings;
+	float mTime;
+	float mLoopPeriod;
+
+	WaveExecution mExecution;
+	GumshoeFramework10::ThreadPool* mThreadPool;
+
+	InverseFFT* mFFT;
+
+	// Initial amplitudes h0(k), conj(h0(-k)) and dispersion w(k), mSize*mSize each.
+	float* mH0Re;
+	float* mH0Im;
+	float* mH0ConjRe;
+	float* mH0ConjIm;
+	float* mOmega;
+
+	// Packed fields, two real outputs per complex transform:
+	//   0: height + i*slope x, 1: slope z + i*displacement x, 2: displacement z.
+	static const UINT NumFields = 3;
+	float* mFieldRe[NumFields];
+	float* mFieldIm[NumFields];
+	float* mScratchRe;
+	float* mScratchIm;
+
+	XMFLOAT3* mPositions;
+	XMFLOAT3* mNormals;
+	XMFLOAT3* mTangentX;
+};
@@ -11,20 +11,173 @@
 #include <algorithm>
 #include <vector>
 #include <cassert>
+#include <intrin.h>
+#include <immintrin.h>
+
+// Height grids are allocated on a 32-byte boundary so that whole rows line up with AVX registers.
+static const size_t HeightAlignment = 32;
+
+static float* AllocHeights(UINT count)
+{
+	float* heights = reinterpret_cast<float*>(_aligned_malloc(sizeof(float)*count, HeightAlignment));
+	memset(heights, 0, sizeof(float)*count);
+	return heights;
+}
+
+static double QuerySecondsPerTick()
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	return 1.0 / double(frequency.QuadPart);
+}
+
+static const double SecondsPerTick = QuerySecondsPerTick();
+
+static double QuerySeconds()
+{
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return double(counter.QuadPart)*SecondsPerTick;
+}
+
+// Adds [begin, end) to a sorted list of disjoint row ranges, merging it with any ranges it
+// overlaps or touches.
+static void AddRowRange(std::vector<WaveRowRange>& ranges, UINT begin, UINT end)
+{
+	if(begin >= end)
+		return;
+
+	std::vector<WaveRowRange>::iterator it = ranges.begin();
+	while(it != ranges.end() && it->End < begin)
+		++it;
+
+	WaveRowRange merged = { begin, end };
+	while(it != ranges.end() && it->Begin <= end)
+	{
+		merged.Begin = std::min(merged.Begin, it->Begin);
+		merged.End   = std::max(merged.End, it->End);
+		it = ranges.erase(it);
+	}
+
+	ranges.insert(it, merged);
+}
+
+static bool CPUSupportsAVX()
+{
+	int info[4];
+	__cpuid(info, 1);
+
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	const bool avx     = (info[2] & (1 << 28)) != 0;
+	if(!osxsave || !avx)
+		return false;
+
+	// The OS also has to save the YMM registers on a context switch.
+	const unsigned long long xcr0 = _xgetbv(_XCR_XFEATURE_ENABLED_MASK);
+	return (xcr0 & 0x6) == 0x6;
+}
+
+//
+// Height stencil kernels.  Each one updates 'count' interior points of a single row, where
+// 'prev' and 'curr' point at the first interior column of the row and 'up'/'down' point at
+// the same column of the neighbouring rows.  All kernels evaluate the stencil in the same
+// order so they produce bit-identical results.
+//
+
+static void StepRowScalar(float* prev, const float* curr, const float* up, const float* down,
+						  UINT count, float k1, float k2, float k3)
+{
+	for(UINT j = 0; j < count; ++j)
+	{
+		const float* c = curr + j;
+		prev[j] = k1*prev[j] +
+				  k2*c[0] +
+				  k3*(down[j] + up[j] + c[1] + c[-1]);
+	}
+}
+
+static void StepRowSSE2(float* prev, const float* curr, const float* up, const float* down,
+						UINT count, float k1, float k2, float k3)
+{
+	const __m128 vK1 = _mm_set1_ps(k1);
+	const __m128 vK2 = _mm_set1_ps(k2);
+	const __m128 vK3 = _mm_set1_ps(k3);
+
+	UINT j = 0;
+	for(; j + 4 <= count; j += 4)
+	{
+		__m128 sum = _mm_add_ps(_mm_loadu_ps(down + j), _mm_loadu_ps(up + j));
+		sum = _mm_add_ps(sum, _mm_loadu_ps(curr + j + 1));
+		sum = _mm_add_ps(sum, _mm_loadu_ps(curr + j - 1));
+
+		__m128 h = _mm_add_ps(_mm_mul_ps(vK1, _mm_loadu_ps(prev + j)),
+							  _mm_mul_ps(vK2, _mm_loadu_ps(curr + j)));
+		h = _mm_add_ps(h, _mm_mul_ps(vK3, sum));
+		_mm_storeu_ps(prev + j, h);
+	}
+
+	StepRowScalar(prev + j, curr + j, up + j, down + j, count - j, k1, k2, k3);
+}
+
+static void StepRowAVX(float* prev, const float* curr, const float* up, const float* down,
+					   UINT count, float k1, float k2, float k3)
+{
+	const __m256 vK1 = _mm256_set1_ps(k1);
+	const __m256 vK2 = _mm256_set1_ps(k2);
+	const __m256 vK3 = _mm256_set1_ps(k3);
+
+	UINT j = 0;
+	for(; j + 8 <= count; j += 8)
+	{
+		__m256 sum = _mm256_add_ps(_mm256_loadu_ps(down + j), _mm256_loadu_ps(up + j));
+		sum = _mm256_add_ps(sum, _mm256_loadu_ps(curr + j + 1));
+		sum = _mm256_add_ps(sum, _mm256_loadu_ps(curr + j - 1));
+
+		__m256 h = _mm256_add_ps(_mm256_mul_ps(vK1, _mm256_loadu_ps(prev + j)),
+								 _mm256_mul_ps(vK2, _mm256_loadu_ps(curr + j)));
+		h = _mm256_add_ps(h, _mm256_mul_ps(vK3, sum));
+		_mm256_storeu_ps(prev + j, h);
+	}
+
+	// Avoid the AVX->SSE transition penalty in the scalar tail and in the caller.
+	_mm256_zeroupper();
+
+	StepRowScalar(prev + j, curr + j, up + j, down + j, count - j, k1, k2, k3);
+}
 
 Waves::Waves()
-: mNumRows(0), mNumCols(0), mVertexCount(0), mTriangleCount(0), 
+: mNumRows(0), mNumCols(0), mVertexCount(0), mTriangleCount(0),
   mK1(0.0f), mK2(0.0f), mK3(0.0f), mTimeStep(0.0f), mSpatialStep(0.0f),
-  mPrevSolution(0), mCurrSolution(0), mNormals(0), mTangentX(0)
+  mKernel(WaveKernel::Auto), mStepRow(0),
+  mExecution(WaveExecution::Serial), mBandRows(32), mThreadPool(0),
+  mAccumTime(0.0f), mMaxSubsteps(1), mCacheBytes(256*1024), mBlockDepth(1),
+  mPrevHeights(0), mCurrHeights(0), mTrackRegions(false), mQuietThreshold(1.0e-4f),
+  mTileSleeping(false), mTileSize(16), mSleepHeight(1.0e-4f), mSleepVelocity(1.0e-3f),
+  mNumTileRows(0), mNumTileCols(0), mPositions(0),
+  mNormals(0), mTangentX(0)
 {
+	SetKernel(WaveKernel::Auto);
+	ResetTimings();
 }
 
 Waves::~Waves()
 {
-	delete[] mPrevSolution;
-	delete[] mCurrSolution;
+	FreeGrids();
+}
+
+void Waves::FreeGrids()
+{
+	_aligned_free(mPrevHeights);
+	_aligned_free(mCurrHeights);
+	delete[] mPositions;
 	delete[] mNormals;
 	delete[] mTangentX;
+
+	mPrevHeights = 0;
+	mCurrHeights = 0;
+	mPositions   = 0;
+	mNormals     = 0;
+	mTangentX    = 0;
 }
 
 UINT Waves::RowCount()const
@@ -57,6 +210,194 @@ float Waves::Depth()const
 	return mNumRows*mSpatialStep;
 }
 
+void Waves::SetKernel(WaveKernel kernel)
+{
+	if(kernel == WaveKernel::Auto)
+		kernel = CPUSupportsAVX() ? WaveKernel::AVX : WaveKernel::SSE2;
+	else if(kernel == WaveKernel::AVX && !CPUSupportsAVX())
+		kernel = WaveKernel::SSE2;
+
+	mKernel = kernel;
+	if(kernel == WaveKernel::AVX)
+		mStepRow = StepRowAVX;
+	else if(kernel == WaveKernel::SSE2)
+		mStepRow = StepRowSSE2;
+	else
+		mStepRow = StepRowScalar;
+}
+
+WaveKernel Waves::Kernel()const
+{
+	return mKernel;
+}
+
+void Waves::SetExecution(WaveExecution execution, UINT bandRows, GumshoeFramework10::ThreadPool* threadPool)
+{
+	assert(bandRows > 0);
+
+	mExecution  = execution;
+	mBandRows   = bandRows;
+	mThreadPool = threadPool;
+}
+
+WaveExecution Waves::Execution()const
+{
+	return mExecution;
+}
+
+void Waves::SetSubsteps(UINT maxSubsteps, UINT cacheBytes)
+{
+	assert(maxSubsteps > 0);
+
+	mMaxSubsteps = maxSubsteps;
+	mCacheBytes  = cacheBytes;
+	UpdateBlockDepth();
+}
+
+UINT Waves::MaxSubsteps()const
+{
+	return mMaxSubsteps;
+}
+
+UINT Waves::BlockDepth()const
+{
+	return mBlockDepth;
+}
+
+const WaveTimings& Waves::Timings()const
+{
+	return mTimings;
+}
+
+void Waves::ResetTimings()
+{
+	memset(&mTimings, 0, sizeof(mTimings));
+}
+
+void Waves::SetRegionTracking(bool enable, float threshold)
+{
+	mTrackRegions   = enable;
+	mQuietThreshold = threshold;
+
+	// Anything could be moving when tracking starts, so begin with the whole interior.
+	mRegions.clear();
+	if(enable && mNumRows > 2 && mNumCols > 2)
+	{
+		Region all = { 1, mNumRows-1, 1, mNumCols-1 };
+		mRegions.push_back(all);
+	}
+}
+
+bool Waves::RegionTracking()const
+{
+	return mTrackRegions;
+}
+
+UINT Waves::ActiveRegionCount()const
+{
+	// Tiles take over from region tracking while they are on, so there are no regions then.
+	if(mTileSleeping)
+		return 0;
+
+	return mTrackRegions ? UINT(mRegions.size()) : 1;
+}
+
+const std::vector<WaveRowRange>& Waves::DirtyRows()const
+{
+	return mDirtyRows;
+}
+
+void Waves::ClearDirtyRows()
+{
+	mDirtyRows.clear();
+}
+
+void Waves::SetTileSleeping(bool enable, UINT tileSize, float heightThreshold, float velocityThreshold)
+{
+	assert(tileSize > 0);
+
+	mTileSleeping  = enable;
+	mTileSize      = tileSize;
+	mSleepHeight   = heightThreshold;
+	mSleepVelocity = velocityThreshold;
+
+	// The regions aren't grown or trimmed while tiles are in use, so they start over from the
+	// whole interior when tiles are turned off again.
+	if(mTileSleeping)
+	{
+		mRegions.clear();
+		BuildTiles();
+	}
+	else
+		SetRegionTracking(mTrackRegions, mQuietThreshold);
+}
+
+bool Waves::TileSleeping()const
+{
+	return mTileSleeping;
+}
+
+UINT Waves::ActiveTileCount()const
+{
+	if(!mTileSleeping)
+		return 0;
+
+	return UINT(std::count(mTileAwake.begin(), mTileAwake.end(), BYTE(1)));
+}
+
+UINT Waves::SleepingTileCount()const
+{
+	if(!mTileSleeping)
+		return 0;
+
+	return UINT(mTileAwake.size()) - ActiveTileCount();
+}
+
+// Picks how many levels to advance per sweep, so that the wavefront window of depth+2 rows
+// in both height buffers stays within mCacheBytes.
+void Waves::UpdateBlockDepth()
+{
+	const UINT rowBytes = std::max(mNumCols, 1U)*UINT(sizeof(float))*2;
+	const UINT windowRows = mCacheBytes / rowBytes;
+	mBlockDepth = std::min(std::max(windowRows, 3U) - 2, mMaxSubsteps);
+}
+
+// Calls func for every task index, on the thread pool in parallel mode.  Doesn't return until
+// all of the tasks are done.
+void Waves::RunTasks(UINT numTasks, const TaskFunc& func)const
+{
+	if(mExecution == WaveExecution::Serial || mThreadPool == 0)
+	{
+		for(UINT i = 0; i < numTasks; ++i)
+			func(i);
+		return;
+	}
+
+	mThreadPool->ParallelFor(numTasks, [&](uint32 taskIdx) { func(taskIdx); });
+}
+
+// Calls func on [rowBegin, rowEnd) split into bands of mBandRows rows.  In parallel mode the
+// bands run on the thread pool, and this doesn't return until all of them are done.
+void Waves::RunBands(UINT rowBegin, UINT rowEnd, const BandFunc& func)const
+{
+	if(rowEnd <= rowBegin)
+		return;
+
+	if(mExecution == WaveExecution::Serial || mThreadPool == 0)
+	{
+		func(rowBegin, rowEnd);
+		return;
+	}
+
+	const UINT bandRows = mBandRows;
+	const UINT numBands = (rowEnd - rowBegin + bandRows - 1) / bandRows;
+	RunTasks(numBands, [&](UINT band)
+	{
+		const UINT begin = rowBegin + band*bandRows;
+		func(begin, std::min(begin + bandRows, rowEnd));
+	});
+}
+
 void Waves::Init(UINT m, UINT n, float dx, float dt, float speed, float damping)
 {
 	mNumRows  = m;
@@ -67,6 +408,8 @@ void Waves::Init(UINT m, UINT n, float dx, float dt, float speed, float damping)
 
 	mTimeStep    = dt;
 	mSpatialStep = dx;
+	mAccumTime   = 0.0f;
+	UpdateBlockDepth();
 
 	float d = damping*dt+2.0f;
 	float e = (speed*speed)*(dt*dt)/(dx*dx);
@@ -75,17 +418,16 @@ void Waves::Init(UINT m, UINT n, float dx, float dt, float speed, float damping)
 	mK3     = (2.0f*e) / d;
 
 	// In case Init() called again.
-	delete[] mPrevSolution;
-	delete[] mCurrSolution;
-	delete[] mNormals;
-	delete[] mTangentX;
+	FreeGrids();
 
-	mPrevSolution = new XMFLOAT3[m*n];
-	mCurrSolution = new XMFLOAT3[m*n];
-	mNormals      = new XMFLOAT3[m*n];
-	mTangentX     = new XMFLOAT3[m*n];
+	mPrevHeights = AllocHeights(m*n);
+	mCurrHeights = AllocHeights(m*n);
+	mPositions   = new XMFLOAT3[m*n];
+	mNormals     = new XMFLOAT3[m*n];
+	mTangentX    = new XMFLOAT3[m*n];
 
-	// Generate grid vertices in system memory.
+	// Generate grid vertices in system memory.  Only the heights change after this,
+	// so x and z are written once here.
 
 	float halfWidth = (n-1)*dx*0.5f;
 	float halfDepth = (m-1)*dx*0.5f;
@@ -96,79 +438,308 @@ void Waves::Init(UINT m, UINT n, float dx, float dt, float speed, float damping)
 		{
 			float x = -halfWidth + j*dx;
 
-			mPrevSolution[i*n+j] = XMFLOAT3(x, 0.0f, z);
-			mCurrSolution[i*n+j] = XMFLOAT3(x, 0.0f, z);
-			mNormals[i*n+j]      = XMFLOAT3(0.0f, 1.0f, 0.0f);
-			mTangentX[i*n+j]     = XMFLOAT3(1.0f, 0.0f, 0.0f);
+			mPositions[i*n+j] = XMFLOAT3(x, 0.0f, z);
+			mNormals[i*n+j]   = XMFLOAT3(0.0f, 1.0f, 0.0f);
+			mTangentX[i*n+j]  = XMFLOAT3(1.0f, 0.0f, 0.0f);
 		}
 	}
+
+	// Everything is new, so the client has to upload the whole grid once.
+	mStaleRows.clear();
+	mDirtyRows.clear();
+	MarkRowsDirty(0, m);
+
+	// Init() can be called again with tracking already on; start over with the new grid.
+	SetRegionTracking(mTrackRegions, mQuietThreshold);
+	if(mTileSleeping)
+		BuildTiles();
 }
 
 void Waves::Update(float dt)
 {
-	static float t = 0;
+	ApplyQueuedImpulses();
 
 	// Accumulate time.
-	t += dt;
+	mAccumTime += dt;
+
+	// Only update the simulation at the specified time step.  If the frame's backlog reaches
+	// the substep limit, whatever is left over is dropped rather than carried forward.
+	UINT numSteps = std::min(UINT(mAccumTime / mTimeStep), mMaxSubsteps);
+	if(numSteps == 0)
+		return;
+
+	if(numSteps == mMaxSubsteps)
+		mAccumTime = 0.0f;
+	else
+		mAccumTime -= numSteps*mTimeStep;
+
+	const double stepStart = QuerySeconds();
 
-	// Only update the simulation at the specified time step.
-	if( t >= mTimeStep )
+	if(mTileSleeping)
+	{
+		StepTiles(numSteps);
+	}
+	else
 	{
 		// Only update interior points; we use zero boundary conditions.
-		for(UINT i = 1; i < mNumRows-1; ++i)
+		for(UINT stepsLeft = numSteps; stepsLeft > 0; )
 		{
-			for(UINT j = 1; j < mNumCols-1; ++j)
-			{
-				// After this update we will be discarding the old previous
-				// buffer, so overwrite that buffer with the new update.
-				// Note how we can do this inplace (read/write to same element) 
-				// because we won't need prev_ij again and the assignment happens last.
-
-				// Note j indexes x and i indexes z: h(x_j, z_i, t_k)
-				// Moreover, our +z axis goes "down"; this is just to 
-				// keep consistent with our row indices going down.
-
-				mPrevSolution[i*mNumCols+j].y = 
-					mK1*mPrevSolution[i*mNumCols+j].y +
-					mK2*mCurrSolution[i*mNumCols+j].y +
-					mK3*(mCurrSolution[(i+1)*mNumCols+j].y + 
-					     mCurrSolution[(i-1)*mNumCols+j].y + 
-					     mCurrSolution[i*mNumCols+j+1].y + 
-						 mCurrSolution[i*mNumCols+j-1].y);
-			}
+			const UINT depth = std::min(stepsLeft, mBlockDepth);
+			StepBlock(depth);
+			stepsLeft -= depth;
+		}
+	}
+
+	const double normalsStart = QuerySeconds();
+
+	//
+	// Compute normals using finite difference scheme.  This only needs to happen once
+	// for the final substep.  RunTasks() has already waited for every band of the height
+	// step, so all of the neighbouring rows are final.
+	//
+	if(mTileSleeping)
+		ComputeTileNormals();
+	else
+		ComputeStepNormals(numSteps);
+
+	mTimings.Updates += 1;
+	mTimings.Steps   += numSteps;
+	mTimings.StepSeconds    += normalsStart - stepStart;
+	mTimings.NormalsSeconds += QuerySeconds() - normalsStart;
+}
+
+void Waves::ComputeStepNormals(UINT numSteps)
+{
+	if(!mTrackRegions)
+	{
+		RunBands(1, mNumRows-1, [this](UINT rowBegin, UINT rowEnd) { ComputeNormals(rowBegin, rowEnd, 1, mNumCols-1); });
+		MarkRowsDirty(0, mNumRows);
+		return;
+	}
+
+	// A disturbance spreads at most one cell per step.  The normals depend on the
+	// neighbouring heights, so they change one cell further out than the heights do.
+	GrowRegions(numSteps);
+	for(size_t r = 0; r < mRegions.size(); ++r)
+	{
+		const UINT rowBegin = std::max(mRegions[r].RowBegin, 2U) - 1;
+		const UINT rowEnd   = std::min(mRegions[r].RowEnd + 1, mNumRows-1);
+		const UINT colBegin = std::max(mRegions[r].ColBegin, 2U) - 1;
+		const UINT colEnd   = std::min(mRegions[r].ColEnd + 1, mNumCols-1);
+
+		RunBands(rowBegin, rowEnd, [&](UINT bandBegin, UINT bandEnd) { ComputeNormals(bandBegin, bandEnd, colBegin, colEnd); });
+		MarkRowsDirty(rowBegin, rowEnd);
+	}
+
+	TrimRegions();
+}
+
+// Advances row i to time level 'level' of the current block.  Levels alternate between the
+// two buffers: odd levels land in mPrevHeights and even levels in mCurrHeights, the same
+// way a plain step overwrites the previous solution with the new one.
+void Waves::StepRow(UINT i, UINT level)
+{
+	float* dst       = (level & 1) ? mPrevHeights : mCurrHeights;
+	const float* src = (level & 1) ? mCurrHeights : mPrevHeights;
+
+	// Note j indexes x and i indexes z: h(x_j, z_i, t_k)
+	// Moreover, our +z axis goes "down"; this is just to
+	// keep consistent with our row indices going down.
+	const UINT row = i*mNumCols + 1;
+	mStepRow(dst + row, src + row, src + row - mNumCols, src + row + mNumCols,
+			 mNumCols - 2, mK1, mK2, mK3);
+}
+
+// Computes levels [1, depth] for the rows in [rowBegin, rowEnd) as a wavefront: each pass of
+// the outer loop moves every level down by one row, so a row is pulled into cache once and
+// then advanced 'depth' times while it is still resident.  Edges that border another band
+// shrink by one row per level so that the band never reads a neighbour's intermediate levels.
+void Waves::StepTrapezoid(UINT rowBegin, UINT rowEnd, UINT depth, bool shrinkTop, bool shrinkBottom)
+{
+	for(UINT r = rowBegin; r < rowEnd + depth - 1; ++r)
+	{
+		for(UINT level = 1; level <= depth && level - 1 <= r; ++level)
+		{
+			const UINT i = r - (level - 1);
+			const UINT first = rowBegin + (shrinkTop ? level - 1 : 0);
+			const UINT last  = rowEnd - (shrinkBottom ? level - 1 : 0);
+			if(i >= first && i < last)
+				StepRow(i, level);
 		}
+	}
+}
 
-		// We just overwrote the previous buffer with the new data, so
-		// this data needs to become the current solution and the old
-		// current solution becomes the new previous solution.
-		std::swap(mPrevSolution, mCurrSolution);
+// Fills in the rows around a band boundary that StepTrapezoid() left out, one level at a time.
+void Waves::StepTriangle(UINT boundaryRow, UINT depth)
+{
+	for(UINT level = 2; level <= depth; ++level)
+		for(UINT i = boundaryRow - (level - 1); i < boundaryRow + (level - 1); ++i)
+			StepRow(i, level);
+}
+
+// Advances the interior by 'depth' time steps.  In serial mode the whole grid is one
+// trapezoid.  In parallel mode each band does its trapezoid on the pool, then the triangles
+// between bands are finished off.  Every row of every level is still computed once, from
+// the same inputs, so the result matches stepping one level at a time.
+void Waves::StepBlock(UINT depth)
+{
+	const UINT interiorRows = mNumRows - 2;
+
+	UINT numBands = 1;
+	UINT bandRows = interiorRows;
+	if(mExecution == WaveExecution::Parallel && mThreadPool != 0)
+	{
+		// Bands need room for both triangles, and a short tail band is merged into the one above it.
+		bandRows = std::max(mBandRows, 2*depth);
+		numBands = std::max(interiorRows / bandRows, 1U);
+	}
+
+	RunTasks(numBands, [&](UINT band)
+	{
+		const UINT rowBegin = 1 + band*bandRows;
+		const UINT rowEnd   = band == numBands - 1 ? mNumRows - 1 : rowBegin + bandRows;
+		StepTrapezoid(rowBegin, rowEnd, depth, band > 0, band < numBands - 1);
+	});
 
-		t = 0.0f; // reset time
+	if(depth > 1)
+		RunTasks(numBands - 1, [&](UINT boundary) { StepTriangle(1 + (boundary + 1)*bandRows, depth); });
+
+	// After an odd number of levels the newest solution is in the old previous buffer.
+	if(depth & 1)
+		std::swap(mPrevHeights, mCurrHeights);
+}
+
+void Waves::ComputeNormals(UINT rowBegin, UINT rowEnd, UINT colBegin, UINT colEnd)
+{
+	const float* h = mCurrHeights;
+	for(UINT i = rowBegin; i < rowEnd; ++i)
+	{
+		for(UINT j = colBegin; j < colEnd; ++j)
+		{
+			float l = h[i*mNumCols+j-1];
+			float r = h[i*mNumCols+j+1];
+			float t = h[(i-1)*mNumCols+j];
+			float b = h[(i+1)*mNumCols+j];
+
+			XMFLOAT3 normal(-r+l, 2.0f*mSpatialStep, b-t);
+			XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&normal));
+			XMStoreFloat3(&mNormals[i*mNumCols+j], n);
+
+			XMFLOAT3 tangent(2.0f*mSpatialStep, r-l, 0.0f);
+			XMVECTOR T = XMVector3Normalize(XMLoadFloat3(&tangent));
+			XMStoreFloat3(&mTangentX[i*mNumCols+j], T);
+		}
+	}
+}
+
+void Waves::UpdatePositions()const
+{
+	const double start = QuerySeconds();
+
+	for(size_t r = 0; r < mStaleRows.size(); ++r)
+	{
+		RunBands(mStaleRows[r].Begin, mStaleRows[r].End, [this](UINT rowBegin, UINT rowEnd)
+		{
+			for(UINT i = rowBegin*mNumCols; i < rowEnd*mNumCols; ++i)
+				mPositions[i].y = mCurrHeights[i];
+		});
+	}
+
+	mStaleRows.clear();
+	mTimings.PositionsSeconds += QuerySeconds() - start;
+}
+
+void Waves::MarkRowsDirty(UINT rowBegin, UINT rowEnd)
+{
+	AddRowRange(mDirtyRows, rowBegin, rowEnd);
+	AddRowRange(mStaleRows, rowBegin, rowEnd);
+}
 
-		//
-		// Compute normals using finite difference scheme.
-		//
-		for(UINT i = 1; i < mNumRows-1; ++i)
+// Adds a region, merging it with any active regions it overlaps.  The merged region is
+// the bounding box of the pair, which can bring in more overlaps, so keep going until
+// the list is disjoint again.
+void Waves::AddRegion(Region region)
+{
+	bool merged = true;
+	while(merged)
+	{
+		merged = false;
+		for(size_t r = 0; r < mRegions.size(); ++r)
 		{
-			for(UINT j = 1; j < mNumCols-1; ++j)
+			const Region& other = mRegions[r];
+			if(region.RowBegin < other.RowEnd && other.RowBegin < region.RowEnd &&
+			   region.ColBegin < other.ColEnd && other.ColBegin < region.ColEnd)
 			{
-				float l = mCurrSolution[i*mNumCols+j-1].y;
-				float r = mCurrSolution[i*mNumCols+j+1].y;
-				float t = mCurrSolution[(i-1)*mNumCols+j].y;
-				float b = mCurrSolution[(i+1)*mNumCols+j].y;
-				mNormals[i*mNumCols+j].x = -r+l;
-				mNormals[i*mNumCols+j].y = 2.0f*mSpatialStep;
-				mNormals[i*mNumCols+j].z = b-t;
-
-				XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&mNormals[i*mNumCols+j]));
-				XMStoreFloat3(&mNormals[i*mNumCols+j], n);
-
-				mTangentX[i*mNumCols+j] = XMFLOAT3(2.0f*mSpatialStep, r-l, 0.0f);
-				XMVECTOR T = XMVector3Normalize(XMLoadFloat3(&mTangentX[i*mNumCols+j]));
-				XMStoreFloat3(&mTangentX[i*mNumCols+j], T);
+				region.RowBegin = std::min(region.RowBegin, other.RowBegin);
+				region.RowEnd   = std::max(region.RowEnd, other.RowEnd);
+				region.ColBegin = std::min(region.ColBegin, other.ColBegin);
+				region.ColEnd   = std::max(region.ColEnd, other.ColEnd);
+
+				mRegions.erase(mRegions.begin() + r);
+				merged = true;
+				break;
 			}
 		}
 	}
+
+	mRegions.push_back(region);
+}
+
+// Expands every region by 'cells' on each side, clamped to the interior.
+void Waves::GrowRegions(UINT cells)
+{
+	std::vector<Region> regions;
+	regions.swap(mRegions);
+
+	for(size_t r = 0; r < regions.size(); ++r)
+	{
+		Region region = regions[r];
+		region.RowBegin = std::max(region.RowBegin, cells + 1) - cells;
+		region.RowEnd   = std::min(region.RowEnd + cells, mNumRows-1);
+		region.ColBegin = std::max(region.ColBegin, cells + 1) - cells;
+		region.ColEnd   = std::min(region.ColEnd + cells, mNumCols-1);
+		AddRegion(region);
+	}
+}
+
+// Shrinks each region from the outside while its edge rows/columns are at rest, and drops
+// regions that have settled completely.
+void Waves::TrimRegions()
+{
+	for(size_t r = 0; r < mRegions.size(); )
+	{
+		Region& region = mRegions[r];
+		while(region.RowBegin < region.RowEnd && IsQuiet(region.RowBegin, region.RowBegin+1, region.ColBegin, region.ColEnd))
+			++region.RowBegin;
+		while(region.RowBegin < region.RowEnd && IsQuiet(region.RowEnd-1, region.RowEnd, region.ColBegin, region.ColEnd))
+			--region.RowEnd;
+		while(region.ColBegin < region.ColEnd && IsQuiet(region.RowBegin, region.RowEnd, region.ColBegin, region.ColBegin+1))
+			++region.ColBegin;
+		while(region.ColBegin < region.ColEnd && IsQuiet(region.RowBegin, region.RowEnd, region.ColEnd-1, region.ColEnd))
+			--region.ColEnd;
+
+		if(region.RowBegin >= region.RowEnd || region.ColBegin >= region.ColEnd)
+			mRegions.erase(mRegions.begin() + r);
+		else
+			++r;
+	}
+}
+
+// True if the heights in the rectangle are within mQuietThreshold of rest in both time
+// levels, which also bounds how fast they are moving.
+bool Waves::IsQuiet(UINT rowBegin, UINT rowEnd, UINT colBegin, UINT colEnd)const
+{
+	for(UINT i = rowBegin; i < rowEnd; ++i)
+	{
+		for(UINT j = colBegin; j < colEnd; ++j)
+		{
+			if(fabsf(mCurrHeights[i*mNumCols+j]) > mQuietThreshold ||
+			   fabsf(mPrevHeights[i*mNumCols+j]) > mQuietThreshold)
+				return false;
+		}
+	}
+
+	return true;
 }
 
 void Waves::Disturb(UINT i, UINT j, float magnitude)
@@ -180,10 +751,272 @@ void Waves::Disturb(UINT i, UINT j, float magnitude)
 	float halfMag = 0.5f*magnitude;
 
 	// Disturb the ijth vertex height and its neighbors.
-	mCurrSolution[i*mNumCols+j].y     += magnitude;
-	mCurrSolution[i*mNumCols+j+1].y   += halfMag;
-	mCurrSolution[i*mNumCols+j-1].y   += halfMag;
-	mCurrSolution[(i+1)*mNumCols+j].y += halfMag;
-	mCurrSolution[(i-1)*mNumCols+j].y += halfMag;
+	mCurrHeights[i*mNumCols+j]     += magnitude;
+	mCurrHeights[i*mNumCols+j+1]   += halfMag;
+	mCurrHeights[i*mNumCols+j-1]   += halfMag;
+	mCurrHeights[(i+1)*mNumCols+j] += halfMag;
+	mCurrHeights[(i-1)*mNumCols+j] += halfMag;
+
+	TouchCells(i-1, i+2, j-1, j+2);
+}
+
+void Waves::DisturbMany(const WaveImpulse* impulses, UINT count)
+{
+	if(count == 0)
+		return;
+
+	// Apply the impulses in row order so that neighbouring impulses hit the same cache lines.
+	mImpulseScratch.assign(impulses, impulses + count);
+	std::sort(mImpulseScratch.begin(), mImpulseScratch.end(), [](const WaveImpulse& a, const WaveImpulse& b)
+	{
+		return a.Row < b.Row || (a.Row == b.Row && a.Col < b.Col);
+	});
+
+	for(size_t k = 0; k < mImpulseScratch.size(); ++k)
+		ApplyImpulse(mImpulseScratch[k]);
+}
+
+void Waves::QueueImpulses(const WaveImpulse* impulses, UINT count)
+{
+	std::lock_guard<std::mutex> lock(mQueueMutex);
+	mQueuedImpulses.insert(mQueuedImpulses.end(), impulses, impulses + count);
+}
+
+// Applies everything queued by QueueImpulses() since the last call.
+void Waves::ApplyQueuedImpulses()
+{
+	{
+		std::lock_guard<std::mutex> lock(mQueueMutex);
+		mQueuedImpulses.swap(mQueueScratch);
+	}
+
+	DisturbMany(mQueueScratch.data(), UINT(mQueueScratch.size()));
+	mQueueScratch.clear();
+}
+
+// Adds the impulse's tent footprint: the weight falls off linearly with the city-block
+// distance from the center and reaches zero at Radius+1.  Radius 1 is the same footprint
+// as Disturb().  Cells outside the interior are skipped.
+void Waves::ApplyImpulse(const WaveImpulse& impulse)
+{
+	const UINT radius   = impulse.Radius;
+	const UINT rowBegin = std::max(impulse.Row, radius + 1) - radius;
+	const UINT rowEnd   = std::min(impulse.Row + radius + 1, mNumRows-1);
+	const UINT colBegin = std::max(impulse.Col, radius + 1) - radius;
+	const UINT colEnd   = std::min(impulse.Col + radius + 1, mNumCols-1);
+	if(rowBegin >= rowEnd || colBegin >= colEnd)
+		return;
+
+	const float falloff = 1.0f / float(radius + 1);
+	for(UINT i = rowBegin; i < rowEnd; ++i)
+	{
+		const UINT di = i > impulse.Row ? i - impulse.Row : impulse.Row - i;
+		for(UINT j = colBegin; j < colEnd; ++j)
+		{
+			const UINT dj = j > impulse.Col ? j - impulse.Col : impulse.Col - j;
+			if(di + dj > radius)
+				continue;
+
+			const float weight = 1.0f - float(di + dj)*falloff;
+			mCurrHeights[i*mNumCols+j] += weight*impulse.Magnitude;
+		}
+	}
+
+	TouchCells(rowBegin, rowEnd, colBegin, colEnd);
+}
+
+// Lets the dirty rows, regions and sleeping tiles know that heights in the rectangle changed.
+void Waves::TouchCells(UINT rowBegin, UINT rowEnd, UINT colBegin, UINT colEnd)
+{
+	MarkRowsDirty(rowBegin, rowEnd);
+
+	if(mTileSleeping)
+		WakeTiles(rowBegin, rowEnd, colBegin, colEnd);
+
+	if(mTrackRegions && !mTileSleeping)
+	{
+		Region region = { rowBegin, rowEnd, colBegin, colEnd };
+		AddRegion(region);
+	}
+}
+
+// Splits the interior into tiles, all of them awake.
+void Waves::BuildTiles()
+{
+	const UINT interiorRows = mNumRows > 2 ? mNumRows - 2 : 0;
+	const UINT interiorCols = mNumCols > 2 ? mNumCols - 2 : 0;
+	mNumTileRows = (interiorRows + mTileSize - 1) / mTileSize;
+	mNumTileCols = (interiorCols + mTileSize - 1) / mTileSize;
+
+	const UINT numTiles = mNumTileRows*mNumTileCols;
+	mTileAwake.assign(numTiles, 1);
+	mTileMoving.assign(numTiles, 0);
+	mTileStepped.assign(numTiles, 0);
+	mAwakeTiles.clear();
+	mAwakeTiles.reserve(numTiles);
+}
+
+void Waves::TileBounds(UINT tile, UINT& rowBegin, UINT& rowEnd, UINT& colBegin, UINT& colEnd)const
+{
+	const UINT tileRow = tile / mNumTileCols;
+	const UINT tileCol = tile % mNumTileCols;
+
+	rowBegin = 1 + tileRow*mTileSize;
+	rowEnd   = std::min(rowBegin + mTileSize, mNumRows-1);
+	colBegin = 1 + tileCol*mTileSize;
+	colEnd   = std::min(colBegin + mTileSize, mNumCols-1);
+}
+
+// Steps the awake tiles one time level at a time.  Each tile only writes its own cells and
+// the stencil update is done in place, so the awake tiles can all be stepped in parallel.
+// Sleeping tiles hold zero in both buffers, so swapping the buffers doesn't disturb them.
+void Waves::StepTiles(UINT numSteps)
+{
+	std::fill(mTileStepped.begin(), mTileStepped.end(), BYTE(0));
+
+	for(UINT step = 0; step < numSteps; ++step)
+	{
+		mAwakeTiles.clear();
+		for(UINT t = 0; t < UINT(mTileAwake.size()); ++t)
+		{
+			if(mTileAwake[t])
+			{
+				mAwakeTiles.push_back(t);
+				mTileStepped[t] = 1;
+			}
+		}
+
+		RunTasks(UINT(mAwakeTiles.size()), [this](UINT idx) { StepTile(mAwakeTiles[idx]); });
+		std::swap(mPrevHeights, mCurrHeights);
+
+		RunTasks(UINT(mAwakeTiles.size()), [this](UINT idx) { mTileMoving[mAwakeTiles[idx]] = IsTileMoving(mAwakeTiles[idx]); });
+		UpdateTileStates();
+	}
+}
+
+void Waves::ComputeTileNormals()
+{
+	// Recompute normals for every tile that moved this update, including the ones that just
+	// went to sleep so that they end up flat.  The normals along a tile's edges also depend
+	// on the heights across the edge, so the neighbours of those tiles need them too.
+	mAwakeTiles.clear();
+	for(UINT t = 0; t < UINT(mTileStepped.size()); ++t)
+	{
+		const UINT tileRow = t / mNumTileCols;
+		const UINT tileCol = t % mNumTileCols;
+		if(mTileStepped[t] ||
+		   (tileRow > 0 && mTileStepped[t - mNumTileCols]) ||
+		   (tileRow < mNumTileRows-1 && mTileStepped[t + mNumTileCols]) ||
+		   (tileCol > 0 && mTileStepped[t - 1]) ||
+		   (tileCol < mNumTileCols-1 && mTileStepped[t + 1]))
+			mAwakeTiles.push_back(t);
+	}
+
+	RunTasks(UINT(mAwakeTiles.size()), [this](UINT idx)
+	{
+		UINT rowBegin, rowEnd, colBegin, colEnd;
+		TileBounds(mAwakeTiles[idx], rowBegin, rowEnd, colBegin, colEnd);
+		ComputeNormals(rowBegin, rowEnd, colBegin, colEnd);
+	});
+
+	for(size_t t = 0; t < mAwakeTiles.size(); ++t)
+	{
+		UINT rowBegin, rowEnd, colBegin, colEnd;
+		TileBounds(mAwakeTiles[t], rowBegin, rowEnd, colBegin, colEnd);
+		MarkRowsDirty(rowBegin, rowEnd);
+	}
+}
+
+void Waves::StepTile(UINT tile)
+{
+	UINT rowBegin, rowEnd, colBegin, colEnd;
+	TileBounds(tile, rowBegin, rowEnd, colBegin, colEnd);
+
+	for(UINT i = rowBegin; i < rowEnd; ++i)
+	{
+		const UINT row = i*mNumCols + colBegin;
+		mStepRow(mPrevHeights + row, mCurrHeights + row, mCurrHeights + row - mNumCols,
+				 mCurrHeights + row + mNumCols, colEnd - colBegin, mK1, mK2, mK3);
+	}
+}
+
+// True if any cell in the tile is above the height or velocity threshold.
+BYTE Waves::IsTileMoving(UINT tile)const
+{
+	UINT rowBegin, rowEnd, colBegin, colEnd;
+	TileBounds(tile, rowBegin, rowEnd, colBegin, colEnd);
+
+	const float maxVelocityStep = mSleepVelocity*mTimeStep;
+	for(UINT i = rowBegin; i < rowEnd; ++i)
+	{
+		for(UINT j = colBegin; j < colEnd; ++j)
+		{
+			const float h = mCurrHeights[i*mNumCols+j];
+			if(fabsf(h) > mSleepHeight || fabsf(h - mPrevHeights[i*mNumCols+j]) > maxVelocityStep)
+				return 1;
+		}
+	}
+
+	return 0;
+}
+
+// Puts quiet tiles to sleep, but keeps a ring of awake tiles around every moving one.  The
+// stencil pushes small values ahead of a wave front long before they pass the thresholds,
+// and snapping those to zero would noticeably distort the front once it arrives.
+void Waves::UpdateTileStates()
+{
+	std::fill(mTileAwake.begin(), mTileAwake.end(), BYTE(0));
+
+	for(size_t t = 0; t < mAwakeTiles.size(); ++t)
+	{
+		const UINT tile = mAwakeTiles[t];
+		if(!mTileMoving[tile])
+			continue;
+
+		const UINT tileRow = tile / mNumTileCols;
+		const UINT tileCol = tile % mNumTileCols;
+
+		mTileAwake[tile] = 1;
+		if(tileRow > 0)
+			mTileAwake[tile - mNumTileCols] = 1;
+		if(tileRow < mNumTileRows-1)
+			mTileAwake[tile + mNumTileCols] = 1;
+		if(tileCol > 0)
+			mTileAwake[tile - 1] = 1;
+		if(tileCol < mNumTileCols-1)
+			mTileAwake[tile + 1] = 1;
+	}
+
+	for(size_t t = 0; t < mAwakeTiles.size(); ++t)
+	{
+		if(!mTileAwake[mAwakeTiles[t]])
+			SleepTile(mAwakeTiles[t]);
+	}
+}
+
+// Snaps a tile to rest.  Both time levels are cleared, so the tile stays put while it
+// sleeps no matter which buffer is current.
+void Waves::SleepTile(UINT tile)
+{
+	UINT rowBegin, rowEnd, colBegin, colEnd;
+	TileBounds(tile, rowBegin, rowEnd, colBegin, colEnd);
+
+	for(UINT i = rowBegin; i < rowEnd; ++i)
+	{
+		memset(mPrevHeights + i*mNumCols + colBegin, 0, sizeof(float)*(colEnd - colBegin));
+		memset(mCurrHeights + i*mNumCols + colBegin, 0, sizeof(float)*(colEnd - colBegin));
+	}
+}
+
+// Wakes every tile that overlaps the given cells.
+void Waves::WakeTiles(UINT rowBegin, UINT rowEnd, UINT colBegin, UINT colEnd)
+{
+	const UINT firstRow = (std::max(rowBegin, 1U) - 1) / mTileSize;
+	const UINT lastRow  = std::min((rowEnd - 2) / mTileSize, mNumTileRows-1);
+	const UINT firstCol = (std::max(colBegin, 1U) - 1) / mTileSize;
+	const UINT lastCol  = std::min((colEnd - 2) / mTileSize, mNumTileCols-1);
+
+	for(UINT ti = firstRow; ti <= lastRow; ++ti)
+		for(UINT tj = firstCol; tj <= lastCol; ++tj)
+			mTileAwake[ti*mNumTileCols + tj] = 1;
 }
-	
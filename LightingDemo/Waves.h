@@ -8,6 +8,30 @@
 //  updated, the client must copy the current solution into vertex buffers for rendering.
 //  This class only does the calculations, it does not do any drawing.
 //
+//  The heights are stored as two contiguous float grids (structure-of-arrays), since the
+//  solver only ever touches the y component.  The full XYZ positions are only built when
+//  the client asks for them through operator[].
+//
+//  In parallel mode the grid is split into bands of rows that are handed out to a
+//  thread pool.  Every row is computed by the same code in both modes, so the results
+//  are bit-identical to the serial solver.
+//
+//  When a frame covers several time steps, Update() can run them all in one call.  The
+//  substeps are temporally blocked: a window of rows small enough to stay in L2 is advanced
+//  through several time levels before the sweep moves on, so the grid is streamed from
+//  memory once per block instead of once per substep.
+//
+//  With region tracking on, the class keeps a list of active rectangles around recent
+//  disturbances.  They grow by the stencil radius every step and are trimmed back once
+//  their edges settle, and normals are only recomputed inside them.  The rows that
+//  changed are reported through DirtyRows() so that the client can upload just those.
+//
+//  With tile sleeping on, the interior is split into square tiles.  A tile whose heights
+//  and velocities have all settled below a threshold is snapped to rest and put to sleep,
+//  and is skipped by both the stencil and the normal pass until a disturbance or a moving
+//  neighbour wakes it up again.  A few drops on a big pond then only cost as much as the
+//  tiles around them.
+//
 //  All code licensed under the MIT license
 //
 //-------------------------------------------------------------------------------
@@ -15,6 +39,52 @@
 #pragma once
 
 #include <PCH.h>
+#include <ThreadPool.h>
+
+#include <mutex>
+
+// Implementations of the height stencil.  Auto picks the widest one the CPU supports.
+enum class WaveKernel
+{
+	Auto = 0,
+	Scalar,
+	SSE2,
+	AVX,
+};
+
+enum class WaveExecution
+{
+	Serial = 0,
+	Parallel,
+};
+
+// Time spent in each phase since the last ResetTimings().  Normals and tangents are computed
+// in the same pass.  Positions are only rebuilt when the client reads them.
+struct WaveTimings
+{
+	uint64 Updates;
+	uint64 Steps;
+	double StepSeconds;
+	double NormalsSeconds;
+	double PositionsSeconds;
+};
+
+// A point disturbance for DisturbMany().  Radius is the size of the footprint in cells,
+// radius 1 affects the same cells as Disturb().
+struct WaveImpulse
+{
+	UINT Row;
+	UINT Col;
+	float Magnitude;
+	UINT Radius;
+};
+
+// Half-open range of grid rows, [Begin, End).
+struct WaveRowRange
+{
+	UINT Begin;
+	UINT End;
+};
 
 class Waves
 {
@@ -30,7 +100,18 @@ public:
 	float Depth()const;
 
 	// Returns the solution at the ith grid point.
-	const XMFLOAT3& operator[](int i)const { return mCurrSolution[i]; }
+	const XMFLOAT3& operator[](int i)const
+	{
+		if(!mStaleRows.empty())
+			UpdatePositions();
+		return mPositions[i];
+	}
+
+	// Returns the solution height at the ith grid point.
+	float Height(int i)const { return mCurrHeights[i]; }
+
+	// Returns the current height grid, mNumRows*mNumCols floats.
+	const float* Heights()const { return mCurrHeights; }
 
 	// Returns the solution normal at the ith grid point.
 	const XMFLOAT3& Normal(int i)const { return mNormals[i]; }
@@ -38,11 +119,101 @@ public:
 	// Returns the unit tangent vector at the ith grid point in the local x-axis direction.
 	const XMFLOAT3& TangentX(int i)const { return mTangentX[i]; }
 
+	// Forces a specific stencil implementation.  Falls back to the best supported one
+	// if the CPU can't run the requested kernel.
+	void SetKernel(WaveKernel kernel);
+	WaveKernel Kernel()const;
+
+	// Runs the height and normal passes on a thread pool, bandRows rows per task.
+	void SetExecution(WaveExecution execution, UINT bandRows = 32,
+					  GumshoeFramework10::ThreadPool* threadPool = &GumshoeFramework10::ThreadPool::GlobalPool);
+	WaveExecution Execution()const;
+
+	// Lets Update() take up to maxSubsteps time steps per call.  Substeps are computed in
+	// blocks whose working set fits in cacheBytes.
+	void SetSubsteps(UINT maxSubsteps, UINT cacheBytes = 256*1024);
+	UINT MaxSubsteps()const;
+
+	// Number of time levels advanced per sweep of the grid.
+	UINT BlockDepth()const;
+
+	const WaveTimings& Timings()const;
+	void ResetTimings();
+
+	// Only recomputes normals inside the active regions.  A region is trimmed once the
+	// heights along its edges are within threshold of rest in both time levels.  Tile sleeping
+	// overrides this, and ActiveRegionCount() is 0 while it is on.
+	void SetRegionTracking(bool enable, float threshold = 1.0e-4f);
+	bool RegionTracking()const;
+	UINT ActiveRegionCount()const;
+
+	// Rows whose positions or normals have changed since the last ClearDirtyRows(),
+	// sorted and non-overlapping.
+	const std::vector<WaveRowRange>& DirtyRows()const;
+	void ClearDirtyRows();
+
+	// Lets quiet tiles of tileSize x tileSize cells go to sleep.  Thresholds are on |height|
+	// and |velocity|.  Sleeping tiles are stepped one time level at a time, so temporal
+	// blocking doesn't apply, and this takes over from region tracking while it is on.
+	void SetTileSleeping(bool enable, UINT tileSize = 16, float heightThreshold = 1.0e-4f,
+						 float velocityThreshold = 1.0e-3f);
+	bool TileSleeping()const;
+	UINT ActiveTileCount()const;
+	UINT SleepingTileCount()const;
+
 	void Init(UINT m, UINT n, float dx, float dt, float speed, float damping);
 	void Update(float dt);
 	void Disturb(UINT i, UINT j, float magnitude);
 
+	// Applies a batch of impulses right away.  Must be called from the thread that runs Update().
+	void DisturbMany(const WaveImpulse* impulses, UINT count);
+
+	// Thread-safe.  Queued impulses are applied at the start of the next Update().
+	void QueueImpulses(const WaveImpulse* impulses, UINT count);
+
 private:
+	typedef std::function<void(UINT taskIdx)> TaskFunc;
+	typedef std::function<void(UINT rowBegin, UINT rowEnd)> BandFunc;
+	struct Region
+	{
+		UINT RowBegin;
+		UINT RowEnd;
+		UINT ColBegin;
+		UINT ColEnd;
+	};
+
+	typedef void (*StepRowFunc)(float* prev, const float* curr, const float* up, const float* down,
+								UINT count, float k1, float k2, float k3);
+
+	void RunTasks(UINT numTasks, const TaskFunc& func)const;
+	void RunBands(UINT rowBegin, UINT rowEnd, const BandFunc& func)const;
+	void UpdatePositions()const;
+	void UpdateBlockDepth();
+	void StepRow(UINT i, UINT level);
+	void StepTrapezoid(UINT rowBegin, UINT rowEnd, UINT depth, bool shrinkTop, bool shrinkBottom);
+	void StepTriangle(UINT boundaryRow, UINT depth);
+	void StepBlock(UINT depth);
+	void ComputeStepNormals(UINT numSteps);
+	void ComputeNormals(UINT rowBegin, UINT rowEnd, UINT colBegin, UINT colEnd);
+	void AddRegion(Region region);
+	void GrowRegions(UINT cells);
+	void TrimRegions();
+	bool IsQuiet(UINT rowBegin, UINT rowEnd, UINT colBegin, UINT colEnd)const;
+	void MarkRowsDirty(UINT rowBegin, UINT rowEnd);
+	void ApplyQueuedImpulses();
+	void ApplyImpulse(const WaveImpulse& impulse);
+	void TouchCells(UINT rowBegin, UINT rowEnd, UINT colBegin, UINT colEnd);
+	void BuildTiles();
+	void TileBounds(UINT tile, UINT& rowBegin, UINT& rowEnd, UINT& colBegin, UINT& colEnd)const;
+	void StepTiles(UINT numSteps);
+	void ComputeTileNormals();
+	void StepTile(UINT tile);
+	BYTE IsTileMoving(UINT tile)const;
+	void UpdateTileStates();
+	void SleepTile(UINT tile);
+	void WakeTiles(UINT rowBegin, UINT rowEnd, UINT colBegin, UINT colEnd);
+	void FreeGrids();
+
 	UINT mNumRows;
 	UINT mNumCols;
 
@@ -57,8 +228,48 @@ private:
 	float mTimeStep;
 	float mSpatialStep;
 
-	XMFLOAT3* mPrevSolution;
-	XMFLOAT3* mCurrSolution;
+	WaveKernel mKernel;
+	StepRowFunc mStepRow;
+
+	WaveExecution mExecution;
+	UINT mBandRows;
+	GumshoeFramework10::ThreadPool* mThreadPool;
+
+	float mAccumTime;
+	UINT mMaxSubsteps;
+	UINT mCacheBytes;
+	UINT mBlockDepth;
+
+	float* mPrevHeights;
+	float* mCurrHeights;
+
+	bool mTrackRegions;
+	float mQuietThreshold;
+	std::vector<Region> mRegions;
+	std::vector<WaveRowRange> mDirtyRows;
+
+	bool mTileSleeping;
+	UINT mTileSize;
+	float mSleepHeight;
+	float mSleepVelocity;
+	UINT mNumTileRows;
+	UINT mNumTileCols;
+	std::vector<BYTE> mTileAwake;
+	std::vector<BYTE> mTileMoving;
+	std::vector<BYTE> mTileStepped;
+	std::vector<UINT> mAwakeTiles;
+
+	std::vector<WaveImpulse> mImpulseScratch;
+	std::mutex mQueueMutex;
+	std::vector<WaveImpulse> mQueuedImpulses;
+	std::vector<WaveImpulse> mQueueScratch;
+
+	mutable WaveTimings mTimings;
+
+	// XYZ view of mCurrHeights, rebuilt on demand for the rows listed in mStaleRows.
+	mutable XMFLOAT3* mPositions;
+	mutable std::vector<WaveRowRange> mStaleRows;
+
 	XMFLOAT3* mNormals;
 	XMFLOAT3* mTangentX;
-};
\ No newline at end of file
+};
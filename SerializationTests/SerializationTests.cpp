@@ -0,0 +1,101 @@
+//-------------------------------------------------------------------------------
+//
+// SerializationTests
+//   - Using GumshoeFramework (v1.00)
+//
+//  Round-trips data through the serializers in Serialization.h and checks that
+//  it comes back unchanged. Returns 0 if every test passes.
+//
+//  Usage: SerializationTests
+//
+//  All code licensed under the MIT license
+//
+//-------------------------------------------------------------------------------
+
+#include <PCH.h>
+
+#include <Serialization.h>
+#include <ThreadPool.h>
+#include <Utility.h>
+
+using namespace GumshoeFramework10;
+
+static const uint32 TestBlockSize = 1024;
+static const uint32 TrailerValue = 0x51A7F00D;
+
+// Compresses numBytes of data followed by a value written straight to the inner serializer,
+// then reads both back. The value can only be read correctly if the reader consumed the
+// whole compressed stream, including its end.
+static bool TestCompressedRoundTrip(uint64 numBytes)
+{
+    std::vector<uint8> data(static_cast<size_t>(numBytes));
+    for(uint64 i = 0; i < numBytes; ++i)
+        data[size_t(i)] = uint8((i * 7) ^ (i >> 5));
+
+    std::vector<uint8> stored;
+    MemoryWriteSerializer writeSerializer(stored);
+    {
+        CompressedWriteSerializer<MemoryWriteSerializer> compressor(writeSerializer, TestBlockSize);
+        if(numBytes > 0)
+            compressor.SerializeData(numBytes, data.data());
+        compressor.Finish();
+    }
+
+    uint32 trailer = TrailerValue;
+    writeSerializer.SerializeItem(trailer);
+
+    std::vector<uint8> readData(static_cast<size_t>(numBytes));
+    MemoryReadSerializer readSerializer(stored.data(), stored.size());
+    {
+        CompressedReadSerializer<MemoryReadSerializer> decompressor(readSerializer);
+        if(numBytes > 0)
+            decompressor.SerializeData(numBytes, readData.data());
+    }
+
+    trailer = 0;
+    readSerializer.SerializeItem(trailer);
+
+    return readData == data && trailer == TrailerValue;
+}
+
+int wmain(int argc, wchar** argv)
+{
+    ThreadPool::GlobalPool.Initialize();
+
+    // Blocks are read in batches of this many, so test streams that end on either side of a
+    // batch boundary as well as exactly on one
+    const uint32 batchSize = (ThreadPool::GlobalPool.NumWorkers() + 1) * 2;
+    const uint32 blockCounts[] = { 0, 1, batchSize - 1, batchSize, batchSize + 1, batchSize * 2 };
+
+    uint32 numFailed = 0;
+    uint32 numTests = 0;
+    for(uint64 i = 0; i < ArraySize_(blockCounts); ++i)
+    {
+        for(uint32 partialBlock = 0; partialBlock < 2; ++partialBlock)
+        {
+            const uint64 numBytes = uint64(blockCounts[i]) * TestBlockSize + partialBlock * (TestBlockSize / 3);
+
+            bool passed = false;
+            try
+            {
+                passed = TestCompressedRoundTrip(numBytes);
+            }
+            catch(Exception& e)
+            {
+                fwprintf(stderr, L"  %ls\n", e.GetMessage().c_str());
+            }
+
+            if(passed == false)
+            {
+                fwprintf(stderr, L"Compressed round trip of %llu bytes failed\n", numBytes);
+                ++numFailed;
+            }
+            ++numTests;
+        }
+    }
+
+    ThreadPool::GlobalPool.Shutdown();
+
+    wprintf(L"%u of %u tests passed\n", numTests - numFailed, numTests);
+    return numFailed > 0 ? 1 : 0;
+}
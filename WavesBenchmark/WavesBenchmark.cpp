@@ -0,0 +1,272 @@
+//-------------------------------------------------------------------------------
+//
+// WavesBenchmark
+//   - Using GumshoeFramework (v1.00)
+//
+//  Runs the Waves solver without a window or a D3D device and reports throughput
+//  and per-phase timings as JSON, so results can be diffed between releases.
+//
+//  Usage: WavesBenchmark [-minsize N] [-maxsize N] [-substeps 1,2,4,8]
+//                        [-serial] [-parallel] [-cellsteps N] [-out file.json]
+//
+//  All code licensed under the MIT license
+//
+//-------------------------------------------------------------------------------
+
+#include <PCH.h>
+
+#include <ThreadPool.h>
+#include "..\\LightingDemo\\Waves.h"
+
+using namespace GumshoeFramework10;
+
+// Same simulation constants as the lighting demo
+static const float SpatialStep = 1.0f;
+static const float TimeStep = 0.03f;
+static const float WaveSpeed = 3.25f;
+static const float Damping = 0.4f;
+
+struct BenchmarkOptions
+{
+    uint32 MinSize;
+    uint32 MaxSize;
+    std::vector<uint32> Substeps;
+    bool RunSerial;
+    bool RunParallel;
+
+    // Roughly how many cell updates to time per configuration
+    uint64 CellSteps;
+
+    const char* OutputPath;
+};
+
+struct BenchmarkResult
+{
+    uint32 Size;
+    uint32 Substeps;
+    uint32 BlockDepth;
+    WaveExecution Execution;
+    WaveTimings Timings;
+    double TotalSeconds;
+
+    // Sum of the final heights, to catch changes in the results along with the timings
+    double Checksum;
+};
+
+static double QuerySeconds()
+{
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return double(counter.QuadPart) / double(frequency.QuadPart);
+}
+
+static const char* KernelName(WaveKernel kernel)
+{
+    switch(kernel)
+    {
+    case WaveKernel::Scalar: return "Scalar";
+    case WaveKernel::SSE2: return "SSE2";
+    case WaveKernel::AVX: return "AVX";
+    default: return "Auto";
+    }
+}
+
+static void ParseSubsteps(const char* arg, std::vector<uint32>& substeps)
+{
+    substeps.clear();
+    while(*arg != 0)
+    {
+        char* end = nullptr;
+        const uint32 count = strtoul(arg, &end, 10);
+        if(end == arg)
+            break;
+        if(count > 0)
+            substeps.push_back(count);
+        arg = *end == ',' ? end + 1 : end;
+    }
+}
+
+static bool ParseOptions(int argc, char** argv, BenchmarkOptions& options)
+{
+    options.MinSize = 128;
+    options.MaxSize = 8192;
+    options.Substeps.clear();
+    options.Substeps.push_back(1);
+    options.Substeps.push_back(2);
+    options.Substeps.push_back(4);
+    options.Substeps.push_back(8);
+    options.RunSerial = true;
+    options.RunParallel = true;
+    options.CellSteps = 1ULL << 28;
+    options.OutputPath = nullptr;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        const char* arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if(strcmp(arg, "-minsize") == 0 && hasValue)
+            options.MinSize = strtoul(argv[++i], nullptr, 10);
+        else if(strcmp(arg, "-maxsize") == 0 && hasValue)
+            options.MaxSize = strtoul(argv[++i], nullptr, 10);
+        else if(strcmp(arg, "-substeps") == 0 && hasValue)
+            ParseSubsteps(argv[++i], options.Substeps);
+        else if(strcmp(arg, "-cellsteps") == 0 && hasValue)
+            options.CellSteps = _strtoui64(argv[++i], nullptr, 10);
+        else if(strcmp(arg, "-out") == 0 && hasValue)
+            options.OutputPath = argv[++i];
+        else if(strcmp(arg, "-serial") == 0)
+            options.RunParallel = false;
+        else if(strcmp(arg, "-parallel") == 0)
+            options.RunSerial = false;
+        else
+        {
+            fprintf(stderr, "Unknown argument: %s\n", arg);
+            return false;
+        }
+    }
+
+    if(options.MinSize < 8 || options.MaxSize < options.MinSize || options.Substeps.size() == 0)
+    {
+        fprintf(stderr, "Invalid size or substep range\n");
+        return false;
+    }
+
+    return true;
+}
+
+static BenchmarkResult RunBenchmark(uint32 size, uint32 substeps, WaveExecution execution, uint64 cellSteps)
+{
+    Waves waves;
+    waves.SetExecution(execution);
+    waves.SetSubsteps(substeps);
+    waves.Init(size, size, SpatialStep, TimeStep, WaveSpeed, Damping);
+
+    // Start from a field of drops so that the normals aren't trivially flat
+    for(uint32 i = 4; i < size - 4; i += 37)
+        for(uint32 j = 4; j < size - 4; j += 41)
+            waves.Disturb(i, j, 0.5f);
+
+    // Slightly over the frame time so that rounding never drops a substep
+    const float frameTime = TimeStep * substeps * 1.001f;
+    const uint64 cellsPerUpdate = uint64(size) * size * substeps;
+    const uint64 numUpdates = std::max<uint64>(cellSteps / cellsPerUpdate, 3);
+
+    // One untimed update to fault in the pages and warm up the pool
+    waves.Update(frameTime);
+    waves[0];
+    waves.ResetTimings();
+
+    const double start = QuerySeconds();
+    for(uint64 u = 0; u < numUpdates; ++u)
+    {
+        waves.Update(frameTime);
+
+        // Reading a position rebuilds the XYZ view, the same as the demo's vertex copy
+        waves[0];
+    }
+
+    BenchmarkResult result;
+    result.Size = size;
+    result.Substeps = substeps;
+    result.BlockDepth = waves.BlockDepth();
+    result.Execution = execution;
+    result.Timings = waves.Timings();
+    result.TotalSeconds = QuerySeconds() - start;
+
+    result.Checksum = 0.0;
+    const float* heights = waves.Heights();
+    for(uint32 i = 0; i < waves.VertexCount(); ++i)
+        result.Checksum += heights[i];
+
+    return result;
+}
+
+static void WriteResult(FILE* file, const BenchmarkResult& result, bool last)
+{
+    const WaveTimings& t = result.Timings;
+    const double cells = double(result.Size) * result.Size;
+    const double updates = double(t.Updates);
+    const double steps = double(t.Steps);
+
+    // Resident bytes per cell: two height levels, plus positions, normals and tangents
+    const double bytesPerCell = double(2 * sizeof(float) + 3 * sizeof(XMFLOAT3));
+
+    // Each sweep of the grid reads both height levels and writes one, and temporal
+    // blocking advances BlockDepth levels per sweep
+    const double sweeps = double((result.Substeps + result.BlockDepth - 1) / result.BlockDepth);
+    const double stepTrafficPerCell = double(3 * sizeof(float)) * sweeps / result.Substeps;
+
+    fprintf(file, "    {\n");
+    fprintf(file, "      \"rows\": %u,\n", result.Size);
+    fprintf(file, "      \"cols\": %u,\n", result.Size);
+    fprintf(file, "      \"substeps\": %u,\n", result.Substeps);
+    fprintf(file, "      \"block_depth\": %u,\n", result.BlockDepth);
+    fprintf(file, "      \"execution\": \"%s\",\n", result.Execution == WaveExecution::Parallel ? "parallel" : "serial");
+    fprintf(file, "      \"updates\": %llu,\n", t.Updates);
+    fprintf(file, "      \"steps\": %llu,\n", t.Steps);
+    fprintf(file, "      \"step_ms\": %.6f,\n", t.StepSeconds * 1000.0 / updates);
+    fprintf(file, "      \"normals_tangents_ms\": %.6f,\n", t.NormalsSeconds * 1000.0 / updates);
+    fprintf(file, "      \"positions_ms\": %.6f,\n", t.PositionsSeconds * 1000.0 / updates);
+    fprintf(file, "      \"total_ms\": %.6f,\n", result.TotalSeconds * 1000.0 / updates);
+    fprintf(file, "      \"step_mcells_per_s\": %.3f,\n", cells * steps / t.StepSeconds / 1.0e6);
+    fprintf(file, "      \"total_mcells_per_s\": %.3f,\n", cells * steps / result.TotalSeconds / 1.0e6);
+    fprintf(file, "      \"bytes_per_cell\": %.1f,\n", bytesPerCell);
+    fprintf(file, "      \"step_traffic_bytes_per_cell\": %.3f,\n", stepTrafficPerCell);
+    fprintf(file, "      \"checksum\": %.9g\n", result.Checksum);
+    fprintf(file, "    }%s\n", last ? "" : ",");
+    fflush(file);
+}
+
+int main(int argc, char** argv)
+{
+    BenchmarkOptions options;
+    if(!ParseOptions(argc, argv, options))
+        return 1;
+
+    FILE* file = stdout;
+    if(options.OutputPath != nullptr && fopen_s(&file, options.OutputPath, "w") != 0)
+    {
+        fprintf(stderr, "Couldn't open %s for writing\n", options.OutputPath);
+        return 1;
+    }
+
+    ThreadPool::GlobalPool.Initialize();
+
+    Waves probe;
+    std::vector<WaveExecution> executions;
+    if(options.RunSerial)
+        executions.push_back(WaveExecution::Serial);
+    if(options.RunParallel)
+        executions.push_back(WaveExecution::Parallel);
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"benchmark\": \"Waves\",\n");
+    fprintf(file, "  \"kernel\": \"%s\",\n", KernelName(probe.Kernel()));
+    fprintf(file, "  \"threads\": %u,\n", ThreadPool::GlobalPool.NumWorkers() + 1);
+    fprintf(file, "  \"results\": [\n");
+
+    for(uint32 size = options.MinSize; size <= options.MaxSize; size *= 2)
+    {
+        for(uint64 s = 0; s < options.Substeps.size(); ++s)
+        {
+            for(uint64 e = 0; e < executions.size(); ++e)
+            {
+                const BenchmarkResult result = RunBenchmark(size, options.Substeps[s], executions[e], options.CellSteps);
+                const bool last = size * 2 > options.MaxSize && s + 1 == options.Substeps.size() && e + 1 == executions.size();
+                WriteResult(file, result, last);
+            }
+        }
+    }
+
+    fprintf(file, "  ]\n");
+    fprintf(file, "}\n");
+
+    if(file != stdout)
+        fclose(file);
+
+    ThreadPool::GlobalPool.Shutdown();
+
+    return 0;
+}